@@ -0,0 +1,178 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Conversion of coils between Modbus frames and memory.
+//
+// The legacy functions are copies of parse_bits() and serialize_bits() as
+// they were before the SIMD kernels were introduced. The kernels are
+// measured individually on arrays of bools, and through the std::vector<bool>
+// interface, which converts in chunks.
+
+#include <memory>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "bit_pack.hpp"
+#include "modbus_protocol_common.hpp"
+
+using namespace mboxid;
+
+static size_t legacy_parse_bits(
+        std::span<const uint8_t> src, std::vector<bool>& bits, size_t cnt) {
+    auto byte_count = bit_to_byte_count(cnt);
+
+    bits.resize(cnt);
+
+    for (size_t i = 0; i < byte_count; ++i) {
+        unsigned val = src[i];
+        for (size_t j = 0; j < bits_per_byte; ++j) {
+            size_t ix = bits_per_byte * i + j;
+            if (ix >= cnt)
+                break;
+            bits[ix] = val & (1U << j);
+        }
+    }
+
+    return byte_count;
+}
+
+static size_t legacy_serialize_bits(
+        std::span<uint8_t> dst, const std::vector<bool>& bits) {
+    auto byte_count = bit_to_byte_count(bits.size());
+
+    for (size_t i = 0; i < byte_count; ++i) {
+        uint8_t val = 0;
+        for (size_t j = 0; j < bits_per_byte; ++j) {
+            size_t ix = bits_per_byte * i + j;
+            if (ix >= bits.size())
+                break;
+            val |= (bits[ix] << j);
+        }
+        dst[i] = val;
+    }
+
+    return byte_count;
+}
+
+static std::vector<uint8_t> random_bytes(size_t cnt) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> bytes(cnt);
+    for (auto& v : bytes)
+        v = static_cast<uint8_t>(rng());
+    return bytes;
+}
+
+static std::vector<bool> random_bits(size_t cnt) {
+    std::vector<bool> bits;
+    parse_bits(random_bytes(bit_to_byte_count(cnt)), bits, cnt);
+    return bits;
+}
+
+static void BM_SerializeBitsLegacy(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto bits = random_bits(cnt);
+    std::vector<uint8_t> dst(bit_to_byte_count(cnt));
+
+    for (auto _ : state) {
+        legacy_serialize_bits(dst, bits);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_SerializeBits(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto bits = random_bits(cnt);
+    std::vector<uint8_t> dst(bit_to_byte_count(cnt));
+
+    for (auto _ : state) {
+        serialize_bits(dst, bits);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_ParseBitsLegacy(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto src = random_bytes(bit_to_byte_count(cnt));
+    std::vector<bool> bits(cnt);
+
+    for (auto _ : state) {
+        legacy_parse_bits(src, bits, cnt);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_ParseBits(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto src = random_bytes(bit_to_byte_count(cnt));
+    std::vector<bool> bits(cnt);
+
+    for (auto _ : state) {
+        parse_bits(src, bits, cnt);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_PackBits(benchmark::State& state, pack_bits_fn kernel) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto src = std::make_unique<bool[]>(cnt);
+    unpack_bits_scalar(random_bytes(bit_to_byte_count(cnt)).data(), cnt,
+            src.get());
+    std::vector<uint8_t> dst(bit_to_byte_count(cnt));
+
+    for (auto _ : state) {
+        kernel(src.get(), cnt, dst.data());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_UnpackBits(benchmark::State& state, unpack_bits_fn kernel) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto src = random_bytes(bit_to_byte_count(cnt));
+    auto dst = std::make_unique<bool[]>(cnt);
+
+    for (auto _ : state) {
+        kernel(src.data(), cnt, dst.get());
+        benchmark::DoNotOptimize(dst.get());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Number of bits: a single byte, a typical request and the largest request.
+#define BIT_COUNTS Arg(8)->Arg(256)->Arg(2000)
+
+BENCHMARK(BM_SerializeBitsLegacy)->BIT_COUNTS;
+BENCHMARK(BM_SerializeBits)->BIT_COUNTS;
+BENCHMARK(BM_ParseBitsLegacy)->BIT_COUNTS;
+BENCHMARK(BM_ParseBits)->BIT_COUNTS;
+
+BENCHMARK_CAPTURE(BM_PackBits, scalar, pack_bits_scalar)->BIT_COUNTS;
+BENCHMARK_CAPTURE(BM_UnpackBits, scalar, unpack_bits_scalar)->BIT_COUNTS;
+#if defined(MBOXID_HAVE_X86_SIMD)
+BENCHMARK_CAPTURE(BM_PackBits, sse2, pack_bits_sse2)->BIT_COUNTS;
+BENCHMARK_CAPTURE(BM_UnpackBits, sse2, unpack_bits_sse2)->BIT_COUNTS;
+#endif
+
+int main(int argc, char** argv) {
+#if defined(MBOXID_HAVE_X86_SIMD)
+    if (cpu_has_avx2()) {
+        benchmark::RegisterBenchmark(
+                "BM_PackBits/avx2", BM_PackBits, pack_bits_avx2)
+                ->BIT_COUNTS;
+        benchmark::RegisterBenchmark(
+                "BM_UnpackBits/avx2", BM_UnpackBits, unpack_bits_avx2)
+                ->BIT_COUNTS;
+    }
+#endif
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
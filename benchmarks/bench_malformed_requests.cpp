@@ -0,0 +1,81 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Cost of rejecting garbage, as sent by a misbehaving client.
+//
+// The server closes the connection after the first malformed request, so a
+// flood of garbage costs a rejection per connection. The benchmarks measure
+// the rejection itself: framing ADUs with invalid MBAP headers, and executing
+// PDUs which are malformed for the function code. Valid requests are measured
+// for comparison.
+
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <mboxid/register_map_backend.hpp>
+#include "frame_buffer.hpp"
+#include "modbus_protocol_common.hpp"
+#include "modbus_protocol_server.hpp"
+
+using namespace mboxid;
+
+using U8Vec = std::vector<uint8_t>;
+
+static const U8Vec malformed_pdus[] = {
+    {0x03},                                     // too short for any PDU
+    {0x03, 0x00, 0x00, 0x00, 0x01, 0x00},       // wrong length
+    {0x0f, 0x00, 0x00, 0x00, 0x10, 0x02, 0xff}, // data truncated
+    {0x10, 0x00, 0x00, 0x00, 0x02, 0x04, 0x00, 0x01}, // data truncated
+};
+
+static const U8Vec valid_pdus[] = {
+    {0x03, 0x00, 0x00, 0x00, 0x01},
+    {0x06, 0x00, 0x00, 0x12, 0x34},
+    {0x0f, 0x00, 0x00, 0x00, 0x10, 0x02, 0xff, 0x00},
+    {0x10, 0x00, 0x00, 0x00, 0x02, 0x04, 0x00, 0x01, 0x00, 0x02},
+};
+
+static void BM_ExecutePdu(benchmark::State& state, const U8Vec (&pdus)[4]) {
+    register_map_backend backend(16, 0, 0, 16);
+    backend_state st;
+    U8Vec rsp(max_pdu_size);
+    size_t i = 0;
+
+    for (auto _ : state) {
+        size_t cnt = 0;
+        auto res = server_engine(backend, &st, 1, pdus[i++ % 4], rsp, cnt);
+        benchmark::DoNotOptimize(res);
+        benchmark::DoNotOptimize(cnt);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_ExecutePdu, malformed, malformed_pdus);
+BENCHMARK_CAPTURE(BM_ExecutePdu, valid, valid_pdus);
+
+// ADUs with an invalid protocol identifier and an invalid length field, and a
+// valid one.
+static const U8Vec adus[] = {
+    {0x00, 0x01, 0xca, 0xfe, 0x00, 0x06, 0xff, 0x03, 0x00, 0x00, 0x00, 0x01},
+    {0x00, 0x01, 0x00, 0x00, 0xff, 0xff, 0xff, 0x03, 0x00, 0x00, 0x00, 0x01},
+    {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0xff, 0x03, 0x00, 0x00, 0x00, 0x01},
+};
+
+static void BM_FrameAdu(benchmark::State& state) {
+    const auto& adu = adus[state.range(0)];
+    mbap_header header; // NOLINT(*-pro-type-member-init)
+
+    for (auto _ : state) {
+        // A new buffer per iteration, as it is unusable after an error.
+        frame_buffer fb;
+        auto space = fb.space();
+        std::copy(adu.begin(), adu.end(), space.begin());
+        fb.commit(adu.size());
+
+        auto frame = fb.next_frame(header);
+        benchmark::DoNotOptimize(frame);
+        benchmark::DoNotOptimize(fb.error());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrameAdu)->ArgName("adu")->Arg(0)->Arg(1)->Arg(2);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,449 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Encoding and decoding of Modbus frames.
+//
+// The benchmarks cover the server engine for every function code, the MBAP
+// header, the conversion of coils and registers at the minimum and maximum
+// quantities, and the client side serialization of requests together with
+// the parsing of their responses. Besides the time per operation, each
+// benchmark reports the heap allocations per operation, counted by the
+// replaced global operator new. Buffers are reused across iterations, as by
+// the library itself, and warmed up by a first operation before counting.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <mboxid/register_map_backend.hpp>
+#include "modbus_protocol_common.hpp"
+#include "modbus_protocol_client.hpp"
+#include "modbus_protocol_server.hpp"
+
+using namespace mboxid;
+
+using U8Vec = std::vector<uint8_t>;
+
+static std::atomic<uint64_t> n_allocs{0};
+
+// GCC takes malloc() and free() within the inlined operators for a mismatch.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    n_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return ::operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+// Reports the heap allocations from its construction until the end of the
+// benchmark as counter allocs/op.
+class alloc_meter {
+public:
+    explicit alloc_meter(benchmark::State& state)
+            : state(state), start(n_allocs.load()) {}
+
+    alloc_meter(const alloc_meter&) = delete;
+    alloc_meter& operator=(const alloc_meter&) = delete;
+
+    ~alloc_meter() {
+        state.counters["allocs/op"] = benchmark::Counter(
+                static_cast<double>(n_allocs.load() - start),
+                benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state;
+    uint64_t start;
+};
+
+// Backend with tables large enough for the maximum quantities.
+static std::unique_ptr<register_map_backend> make_backend() {
+    return std::make_unique<register_map_backend>(max_read_bits,
+            max_read_bits, max_read_registers, max_read_registers);
+}
+
+static U8Vec make_request(auto serialize) {
+    U8Vec req(max_pdu_size);
+    req.resize(serialize(std::span(req)));
+    return req;
+}
+
+static U8Vec read_bits_request(function_code fc, size_t cnt) {
+    return make_request([=](auto dst) {
+        return serialize_read_bits_request(dst, fc, 0, cnt);
+    });
+}
+
+static U8Vec read_registers_request(function_code fc, size_t cnt) {
+    return make_request([=](auto dst) {
+        return serialize_read_registers_request(dst, fc, 0, cnt);
+    });
+}
+
+static U8Vec write_single_coil_request() {
+    return make_request([](auto dst) {
+        return serialize_write_single_coil_request(dst, 1, true);
+    });
+}
+
+static U8Vec write_single_register_request() {
+    return make_request([](auto dst) {
+        return serialize_write_single_register_request(dst, 1, 0x1234);
+    });
+}
+
+static U8Vec write_multiple_coils_request(size_t cnt) {
+    return make_request([=](auto dst) {
+        return serialize_write_multiple_coils_request(
+                dst, 0, std::vector<bool>(cnt, true));
+    });
+}
+
+static U8Vec write_multiple_registers_request(size_t cnt) {
+    return make_request([=](auto dst) {
+        return serialize_write_multiple_registers_request(
+                dst, 0, std::vector<uint16_t>(cnt, 0x1234));
+    });
+}
+
+static U8Vec mask_write_register_request() {
+    return make_request([](auto dst) {
+        return serialize_mask_write_register_request(dst, 1, 0xf0f0, 0x0101);
+    });
+}
+
+static U8Vec read_write_multiple_registers_request(
+        size_t cnt_wr, size_t cnt_rd) {
+    return make_request([=](auto dst) {
+        return serialize_read_write_multiple_registers_request(
+                dst, 0, std::vector<uint16_t>(cnt_wr, 0x1234), 0, cnt_rd);
+    });
+}
+
+static U8Vec read_device_identification_request() {
+    return make_request([](auto dst) {
+        return serialize_read_device_identification_request(dst);
+    });
+}
+
+static void BM_ServerEngine(benchmark::State& state, const U8Vec& req) {
+    auto backend = make_backend();
+    backend_state st;
+    U8Vec rsp(max_pdu_size);
+    size_t cnt = 0;
+
+    // The first request fills the device identification cache.
+    auto res = server_engine(*backend, &st, 1, req, rsp, cnt);
+    if (res != errc::none)
+        state.SkipWithError("request failed");
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        res = server_engine(*backend, &st, 1, req, rsp, cnt);
+        benchmark::DoNotOptimize(res);
+        benchmark::DoNotOptimize(rsp.data());
+    }
+}
+BENCHMARK_CAPTURE(BM_ServerEngine, read_coils_1,
+        read_bits_request(function_code::read_coils, 1));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_coils_max,
+        read_bits_request(function_code::read_coils, max_read_bits));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_discrete_inputs_1,
+        read_bits_request(function_code::read_discrete_inputs, 1));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_discrete_inputs_max,
+        read_bits_request(function_code::read_discrete_inputs, max_read_bits));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_holding_registers_1,
+        read_registers_request(function_code::read_holding_registers, 1));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_holding_registers_max,
+        read_registers_request(
+                function_code::read_holding_registers, max_read_registers));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_input_registers_1,
+        read_registers_request(function_code::read_input_registers, 1));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_input_registers_max,
+        read_registers_request(
+                function_code::read_input_registers, max_read_registers));
+BENCHMARK_CAPTURE(
+        BM_ServerEngine, write_single_coil, write_single_coil_request());
+BENCHMARK_CAPTURE(BM_ServerEngine, write_single_register,
+        write_single_register_request());
+BENCHMARK_CAPTURE(BM_ServerEngine, write_multiple_coils_1,
+        write_multiple_coils_request(1));
+BENCHMARK_CAPTURE(BM_ServerEngine, write_multiple_coils_max,
+        write_multiple_coils_request(max_write_coils));
+BENCHMARK_CAPTURE(BM_ServerEngine, write_multiple_registers_1,
+        write_multiple_registers_request(1));
+BENCHMARK_CAPTURE(BM_ServerEngine, write_multiple_registers_max,
+        write_multiple_registers_request(max_write_registers));
+BENCHMARK_CAPTURE(
+        BM_ServerEngine, mask_write_register, mask_write_register_request());
+BENCHMARK_CAPTURE(BM_ServerEngine, read_write_multiple_registers_1,
+        read_write_multiple_registers_request(1, 1));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_write_multiple_registers_max,
+        read_write_multiple_registers_request(
+                max_rdwr_write_registers, max_rdwr_read_registers));
+BENCHMARK_CAPTURE(BM_ServerEngine, read_device_identification,
+        read_device_identification_request());
+
+static void BM_ParseMbapHeader(benchmark::State& state) {
+    const U8Vec adu{0x12, 0x34, 0x00, 0x00, 0x00, 0x06, 0xff};
+    mbap_header header; // NOLINT(*-pro-type-member-init)
+    const char* what = nullptr;
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        auto res = parse_mbap_header(adu, header, what);
+        benchmark::DoNotOptimize(res);
+        benchmark::DoNotOptimize(header);
+    }
+}
+BENCHMARK(BM_ParseMbapHeader);
+
+static void BM_SerializeMbapHeader(benchmark::State& state) {
+    const mbap_header header{0x1234, 0x0000, 0x0006, 0xff};
+    U8Vec adu(mbap_header_size);
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        auto cnt = serialize_mbap_header(adu, header);
+        benchmark::DoNotOptimize(cnt);
+        benchmark::DoNotOptimize(adu.data());
+    }
+}
+BENCHMARK(BM_SerializeMbapHeader);
+
+static U8Vec random_bytes(size_t cnt) {
+    std::mt19937 gen(42); // NOLINT(*-msc51-cpp)
+    std::uniform_int_distribution<unsigned> dist(0, 0xff);
+    U8Vec v(cnt);
+    for (auto& b : v)
+        b = static_cast<uint8_t>(dist(gen));
+    return v;
+}
+
+static void BM_ParseBits(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto src = random_bytes(bit_to_byte_count(cnt));
+    std::vector<bool> bits;
+    parse_bits(src, bits, cnt);
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parse_bits(src, bits, cnt));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ParseBits)->Arg(1)->Arg(max_read_bits);
+
+static void BM_SerializeBits(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    std::vector<bool> bits(cnt);
+    for (size_t i = 0; i < cnt; ++i)
+        bits[i] = (i % 3) == 0;
+    U8Vec dst(bit_to_byte_count(cnt));
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(serialize_bits(dst, bits));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_SerializeBits)->Arg(1)->Arg(max_read_bits);
+
+static void BM_ParseRegs(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    auto src = random_bytes(2 * cnt);
+    std::vector<uint16_t> regs;
+    parse_regs(src, regs, cnt);
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parse_regs(src, regs, cnt));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ParseRegs)->Arg(1)->Arg(max_read_registers);
+
+static void BM_SerializeRegs(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    std::vector<uint16_t> regs(cnt, 0x1234);
+    U8Vec dst(2 * cnt);
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(serialize_regs(dst, regs));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_SerializeRegs)->Arg(1)->Arg(max_read_registers);
+
+// Serializes a request and parses the response to it, as a client does per
+// transaction. The response is prepared by the server engine.
+static void run_transaction(
+        benchmark::State& state, auto serialize, auto parse) {
+    auto backend = make_backend();
+    backend_state st;
+    U8Vec req(max_pdu_size);
+    U8Vec rsp(max_pdu_size);
+    size_t cnt = 0;
+
+    auto req_size = serialize(std::span(req));
+    auto res = server_engine(
+            *backend, &st, 1, std::span(req).first(req_size), rsp, cnt);
+    if (res != errc::none)
+        state.SkipWithError("request failed");
+    rsp.resize(cnt);
+    parse(std::span<const uint8_t>(rsp));
+
+    alloc_meter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(serialize(std::span(req)));
+        benchmark::DoNotOptimize(parse(std::span<const uint8_t>(rsp)));
+        benchmark::ClobberMemory();
+    }
+}
+
+static void BM_ClientReadBits(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    std::vector<bool> bits;
+    run_transaction(
+            state,
+            [&](auto dst) {
+                return serialize_read_bits_request(
+                        dst, function_code::read_coils, 0, cnt);
+            },
+            [&](auto src) {
+                return parse_read_bits_response(
+                        src, function_code::read_coils, bits, cnt);
+            });
+}
+BENCHMARK(BM_ClientReadBits)->Arg(1)->Arg(max_read_bits);
+
+static void BM_ClientReadRegisters(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    std::vector<uint16_t> regs;
+    run_transaction(
+            state,
+            [&](auto dst) {
+                return serialize_read_registers_request(
+                        dst, function_code::read_holding_registers, 0, cnt);
+            },
+            [&](auto src) {
+                return parse_read_registers_response(src,
+                        function_code::read_holding_registers, regs, cnt);
+            });
+}
+BENCHMARK(BM_ClientReadRegisters)->Arg(1)->Arg(max_read_registers);
+
+static void BM_ClientWriteSingleCoil(benchmark::State& state) {
+    run_transaction(
+            state,
+            [](auto dst) {
+                return serialize_write_single_coil_request(dst, 1, true);
+            },
+            [](auto src) {
+                return parse_write_single_coil_response(src, 1, true);
+            });
+}
+BENCHMARK(BM_ClientWriteSingleCoil);
+
+static void BM_ClientWriteSingleRegister(benchmark::State& state) {
+    run_transaction(
+            state,
+            [](auto dst) {
+                return serialize_write_single_register_request(dst, 1, 0x1234);
+            },
+            [](auto src) {
+                return parse_write_single_register_response(src, 1, 0x1234);
+            });
+}
+BENCHMARK(BM_ClientWriteSingleRegister);
+
+static void BM_ClientWriteMultipleCoils(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    std::vector<bool> bits(cnt, true);
+    run_transaction(
+            state,
+            [&](auto dst) {
+                return serialize_write_multiple_coils_request(dst, 0, bits);
+            },
+            [&](auto src) {
+                return parse_write_multiple_coils_response(src, 0, cnt);
+            });
+}
+BENCHMARK(BM_ClientWriteMultipleCoils)->Arg(1)->Arg(max_write_coils);
+
+static void BM_ClientWriteMultipleRegisters(benchmark::State& state) {
+    auto cnt = static_cast<size_t>(state.range(0));
+    std::vector<uint16_t> regs(cnt, 0x1234);
+    run_transaction(
+            state,
+            [&](auto dst) {
+                return serialize_write_multiple_registers_request(dst, 0, regs);
+            },
+            [&](auto src) {
+                return parse_write_multiple_registers_response(src, 0, cnt);
+            });
+}
+BENCHMARK(BM_ClientWriteMultipleRegisters)->Arg(1)->Arg(max_write_registers);
+
+static void BM_ClientMaskWriteRegister(benchmark::State& state) {
+    run_transaction(
+            state,
+            [](auto dst) {
+                return serialize_mask_write_register_request(
+                        dst, 1, 0xf0f0, 0x0101);
+            },
+            [](auto src) {
+                return parse_mask_write_register_response(
+                        src, 1, 0xf0f0, 0x0101);
+            });
+}
+BENCHMARK(BM_ClientMaskWriteRegister);
+
+static void BM_ClientReadWriteMultipleRegisters(benchmark::State& state) {
+    auto cnt_wr = static_cast<size_t>(state.range(0));
+    auto cnt_rd = static_cast<size_t>(state.range(1));
+    std::vector<uint16_t> regs_wr(cnt_wr, 0x1234);
+    std::vector<uint16_t> regs_rd;
+    run_transaction(
+            state,
+            [&](auto dst) {
+                return serialize_read_write_multiple_registers_request(
+                        dst, 0, regs_wr, 0, cnt_rd);
+            },
+            [&](auto src) {
+                return parse_read_write_multiple_registers_response(
+                        src, regs_rd, cnt_rd);
+            });
+}
+BENCHMARK(BM_ClientReadWriteMultipleRegisters)
+        ->Args({1, 1})
+        ->Args({max_rdwr_write_registers, max_rdwr_read_registers});
+
+static void BM_ClientReadDeviceIdentification(benchmark::State& state) {
+    std::string vendor, product, version;
+    run_transaction(
+            state,
+            [](auto dst) {
+                return serialize_read_device_identification_request(dst);
+            },
+            [&](auto src) {
+                return parse_read_device_identification_response(
+                        src, vendor, product, version);
+            });
+}
+BENCHMARK(BM_ClientReadDeviceIdentification);
+
+BENCHMARK_MAIN();
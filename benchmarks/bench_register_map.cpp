@@ -0,0 +1,79 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Read requests served from the register map backend while application
+// threads update registers.
+//
+// The writers update 32-bit values either within the range read by the
+// server, so that the reader has to retry, or in a distant range, which only
+// costs the coherence traffic of the shared cache lines, if any.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <mboxid/register_map_backend.hpp>
+#include "modbus_protocol_common.hpp"
+#include "modbus_protocol_server.hpp"
+
+using namespace mboxid;
+
+constexpr unsigned n_regs = 1024;
+constexpr unsigned read_cnt = 125;
+
+class writers {
+public:
+    writers(register_map_backend& backend, int n, unsigned addr) {
+        for (int i = 0; i < n; ++i) {
+            threads.emplace_back([this, &backend, addr, i] {
+                uint16_t regs[2];
+                auto a = addr + 2 * static_cast<unsigned>(i);
+                for (uint32_t v = 0; !done.load(std::memory_order_relaxed);
+                        ++v) {
+                    regs[0] = static_cast<uint16_t>(v >> 16);
+                    regs[1] = static_cast<uint16_t>(v);
+                    backend.set_holding_registers(a, regs);
+                    ++updates;
+                }
+            });
+        }
+    }
+
+    ~writers() {
+        done = true;
+        for (auto& t : threads)
+            t.join();
+    }
+
+    uint64_t update_count() const { return updates.load(); }
+
+private:
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> updates{0};
+    std::vector<std::thread> threads;
+};
+
+static void BM_ReadRegisters(benchmark::State& state, bool overlapping) {
+    register_map_backend backend(0, 0, 0, n_regs);
+    std::vector<uint8_t> req{0x03, 0x00, 0x00, 0x00, read_cnt};
+    std::vector<uint8_t> rsp(max_pdu_size);
+    auto n_writers = static_cast<int>(state.range(0));
+
+    writers w(backend, n_writers, overlapping ? 60 : n_regs - 64);
+    for (auto _ : state) {
+        server_engine(backend, req, rsp);
+        benchmark::DoNotOptimize(rsp.data());
+    }
+    state.SetItemsProcessed(state.iterations() * read_cnt);
+    state.counters["updates"] = benchmark::Counter(
+            static_cast<double>(w.update_count()),
+            benchmark::Counter::kIsRate);
+}
+
+// Number of writer threads.
+#define WRITER_COUNTS Arg(0)->Arg(1)->Arg(2)->Arg(4)->UseRealTime()
+
+BENCHMARK_CAPTURE(BM_ReadRegisters, overlapping, true)->WRITER_COUNTS;
+BENCHMARK_CAPTURE(BM_ReadRegisters, disjoint, false)->WRITER_COUNTS;
+
+BENCHMARK_MAIN();
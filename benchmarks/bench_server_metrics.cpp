@@ -0,0 +1,47 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Cost of recording the server metrics of a request.
+//
+// A request updates the request counter of its function code and the byte
+// counters. With the latency histograms enabled, the reactor additionally
+// reads the clock twice and updates both histograms.
+
+#include <chrono>
+#include <benchmark/benchmark.h>
+#include "metrics_recorder.hpp"
+
+using namespace mboxid;
+
+static void BM_RecordRequest(benchmark::State& state) {
+    metrics_recorder rec;
+    uint8_t fc = 0;
+
+    for (auto _ : state) {
+        rec.received(12);
+        rec.request(fc++ & 0x07);
+        rec.sent(11);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RecordRequest);
+
+static void BM_RecordLatency(benchmark::State& state) {
+    using clock = std::chrono::steady_clock;
+    metrics_recorder rec;
+    auto t0 = clock::now();
+
+    for (auto _ : state) {
+        auto t1 = clock::now();
+        auto t2 = clock::now();
+        rec.processing(t2 - t0);
+        rec.backend(t2 - t1);
+        t0 = t1;
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RecordLatency);
+
+BENCHMARK_MAIN();
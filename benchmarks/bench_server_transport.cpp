@@ -0,0 +1,140 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Request/response round trips over loopback, served with epoll and io_uring.
+//
+// Each iteration sends one request on every connection before it collects
+// the responses, so the server sees a batch of ready connections per loop
+// iteration, as under load. The client side is the same for both transports.
+
+#include <cstdio>
+#include <thread>
+#include <exception>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <benchmark/benchmark.h>
+#include <mboxid/logger.hpp>
+#include <mboxid/modbus_tcp_server.hpp>
+#include "modbus_protocol_common.hpp"
+#include "network_private.hpp"
+#include "unique_fd.hpp"
+
+using namespace mboxid;
+using transport = modbus_tcp_server::transport;
+
+constexpr const char* port = "1503";
+
+// Connection and disconnection messages would clutter the results.
+class quiet_logger : public log::logger_base {
+public:
+    void debug(std::string_view) const override {}
+    void info(std::string_view) const override {}
+    void warning(std::string_view) const override {}
+    void error(std::string_view msg) const override {
+        fprintf(stderr, "%.*s\n", static_cast<int>(msg.size()), msg.data());
+    }
+    void auth(std::string_view) const override {}
+};
+
+class bench_backend : public backend_connector {
+public:
+    errc read_holding_registers(unsigned, std::size_t cnt,
+            std::vector<uint16_t>& regs) override {
+        regs.assign(cnt, 0x1234);
+        return errc::none;
+    }
+};
+
+static unique_fd connect_to_server() {
+    auto endpoints = net::resolve_endpoint("localhost", port,
+            net::ip_protocol_version::v4, net::endpoint_usage::active_open);
+    auto& ep = endpoints.front();
+
+    // The server may still be busy with its passive open.
+    for (int i = 0; i < 100; ++i) {
+        unique_fd fd(socket(ep.family, ep.socktype, ep.protocol));
+        if (fd.get() == -1)
+            throw system_error(errno, "socket");
+        if (connect(fd.get(), ep.addr.get(), ep.addrlen) == 0) {
+            int on = 1;
+            setsockopt(fd.get(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            return fd;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    throw system_error(errno, "connect");
+}
+
+static void receive_all(int fd, uint8_t* buf, size_t cnt) {
+    while (cnt) {
+        auto res = TEMP_FAILURE_RETRY(read(fd, buf, cnt));
+        if (res <= 0)
+            throw system_error(res ? errno : ECONNRESET, "read");
+        buf += res;
+        cnt -= res;
+    }
+}
+
+static void BM_RequestResponse(benchmark::State& state) {
+    auto t = static_cast<transport>(state.range(0));
+    auto n_conns = state.range(1);
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", port, net::ip_protocol_version::v4);
+    server.set_backend(std::make_unique<bench_backend>());
+    server.set_transport(t);
+
+    std::exception_ptr error;
+    std::thread server_thd([&]() {
+        try {
+            server.run();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+
+    std::vector<unique_fd> conns;
+    for (int i = 0; i < n_conns; ++i)
+        conns.push_back(connect_to_server());
+
+    // read holding registers, 1 register at address 0
+    const uint8_t req[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0xff, 0x03,
+            0x00, 0x00, 0x00, 0x01};
+    uint8_t rsp[mbap_header_size + 4];
+
+    for (auto _ : state) {
+        for (const auto& fd : conns) {
+            if (write(fd.get(), req, sizeof(req)) != sizeof(req))
+                throw system_error(errno, "write");
+        }
+        for (const auto& fd : conns)
+            receive_all(fd.get(), rsp, sizeof(rsp));
+    }
+
+    state.SetItemsProcessed(state.iterations() * n_conns);
+    state.SetLabel((t == transport::io_uring) ? "io_uring" : "epoll");
+
+    conns.clear();
+    server.shutdown();
+    server_thd.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+BENCHMARK(BM_RequestResponse)
+        ->ArgNames({"transport", "conns"})
+        ->ArgsProduct({{static_cast<int64_t>(transport::epoll),
+                               static_cast<int64_t>(transport::io_uring)},
+                {1, 8, 32}})
+        ->UseRealTime();
+
+int main(int argc, char** argv) {
+    log::install_logger(std::make_unique<quiet_logger>());
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
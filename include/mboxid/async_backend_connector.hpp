@@ -0,0 +1,125 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+/*!
+ *\file
+ * Connector between Modbus server and user application with deferred
+ * request execution.
+ */
+#ifndef LIBMBOXID_ASYNC_BACKEND_CONNECTOR_HPP
+#define LIBMBOXID_ASYNC_BACKEND_CONNECTOR_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mboxid/backend_connector.hpp>
+
+namespace mboxid {
+
+/*!
+ * Handle of a request whose execution has been deferred by the backend.
+ *
+ * The server passes a handle to async_backend_connector::submit() for every
+ * request. The backend completes the request by a call to execute() or
+ * fail(), from any thread and at any time. Afterwards the handle is empty.
+ *
+ * A handle is movable, but not copyable. If a handle is destroyed before the
+ * request has been completed, the request is completed with the Modbus
+ * exception errc::modbus_exception_server_device_failure.
+ */
+class deferred_request {
+public:
+    //! Type used as client identifier.
+    using client_id = backend_connector::client_id;
+
+    //! State of a request, private to the server.
+    struct state;
+
+    //! Creates an empty handle.
+    deferred_request() noexcept;
+
+    /*!
+     * Creates a handle for a request.
+     * \internal
+     * Used by the server only.
+     */
+    explicit deferred_request(std::unique_ptr<state> st) noexcept;
+
+    //! Move constructor.
+    deferred_request(deferred_request&&) noexcept;
+
+    //! Move assignment operator. A pending request is failed first.
+    deferred_request& operator=(deferred_request&&) noexcept;
+
+    //! Destructor. A pending request is failed.
+    ~deferred_request();
+
+    //! True if the handle refers to a request not completed yet.
+    explicit operator bool() const noexcept { return st != nullptr; }
+
+    //! Client which sent the request.
+    client_id client() const;
+
+    //! Function code of the request.
+    std::uint8_t function_code() const;
+
+    /*!
+     * Executes the request with the methods of \a backend and completes it.
+     *
+     * The methods of \a backend are invoked by the calling thread, the same
+     * way the server invokes them for a synchronous backend. This includes
+     * the treatment of their return values, the handlers registered with
+     * modbus_tcp_server::set_function_handler() and the response cache, see
+     * modbus_tcp_server::set_response_cache().
+     */
+    void execute(backend_connector& backend);
+
+    /*!
+     * Completes the request with an error.
+     *
+     * If \a e is a Modbus exception, it is sent to the client. Otherwise, the
+     * server logs the error and closes the connection.
+     */
+    void fail(errc e);
+
+private:
+    std::unique_ptr<state> st;
+
+    void complete();
+};
+
+/*!
+ * Modbus backend interface with deferred request execution.
+ *
+ * A synchronous backend executes requests by the thread serving the
+ * connection, so a slow backend method stalls all other clients served by
+ * that thread. A backend derived from this class gets each request as a
+ * handle instead, which it may complete later on, e.g. from a thread of its
+ * own or from the completion handler of an asynchronous operation.
+ *
+ * The server continues to serve other clients in the meantime. The
+ * responses to the requests of a client are sent in the order of the
+ * requests, even if the requests are completed in a different order. The
+ * number of outstanding requests per client is limited by
+ * modbus_tcp_server::set_pipeline_depth().
+ *
+ * The methods authorize(), disconnect(), alive() and ticker() are still
+ * invoked synchronously.
+ */
+class async_backend_connector : public backend_connector {
+public:
+    /*!
+     * Accepts a request for execution.
+     *
+     * This method is invoked by the server thread for every request and must
+     * not block. The backend takes over the handle and completes the request
+     * by deferred_request::execute() or deferred_request::fail().
+     *
+     * The default implementation executes the request right away.
+     *
+     * \param[in] req Handle of the request.
+     */
+    virtual void submit(deferred_request req) { req.execute(*this); }
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_ASYNC_BACKEND_CONNECTOR_HPP
@@ -13,12 +13,40 @@
 #include <iostream>
 #include <cstdint>
 #include <vector>
+#include <map>
+#include <string>
+#include <span>
+#include <mboxid/bit_span.hpp>
 #include <mboxid/network.hpp>
 #include <mboxid/error.hpp>
 #include <mboxid/version.hpp>
 
 namespace mboxid {
 
+/*!
+ * Objects of the device identification.
+ *
+ * The basic objects are mandatory. The regular objects are optional and only
+ * reported if they are not empty. Extended objects are private objects with
+ * the ids 0x80 to 0xff, defined by the application.
+ *
+ * All objects are reported by the server as they are, hence their values
+ * should be ASCII strings. Each object must be shorter than 245 bytes to fit
+ * into a response.
+ */
+struct device_identification {
+    std::string vendor_name;           //!< Basic object 0x00.
+    std::string product_code;          //!< Basic object 0x01.
+    std::string major_minor_revision;  //!< Basic object 0x02.
+    std::string vendor_url;            //!< Regular object 0x03.
+    std::string product_name;          //!< Regular object 0x04.
+    std::string model_name;            //!< Regular object 0x05.
+    std::string user_application_name; //!< Regular object 0x06.
+
+    //! Extended objects, by object id (0x80 to 0xff).
+    std::map<std::uint8_t, std::string> extended;
+};
+
 /*!
  * Modbus backend interface.
  *
@@ -264,16 +292,154 @@ public:
     }
 
     /*!
-     * Read basic device identification.
+     * \defgroup backend_span_doc Allocation-free backend interface
+     *
+     * The methods with the suffix `_span` exchange data with the server
+     * through buffers provided by the server, instead of vectors. Bits are
+     * passed as bit_span, which refers to the packed bits in the Modbus frame.
+     * Registers are passed in host byte order.
      *
-     * This method is invoked by the sever when the client requests to read
-     * the device identification.
+     * The server always invokes these methods. By default, they forward the
+     * request to the corresponding method of the vector-based interface. A
+     * backend overriding the `_span` methods instead lets the server execute
+     * requests without allocating memory.
+     */
+
+    /*!
+     * Read status of contiguous coils into packed bits.
+     *
+     * \param[in] addr Address of the first coil.
+     * \param[out] bits
+     *      Status of the requested coils. The size of the view is the number
+     *      of coils to read. All bits are cleared by the server.
+     *
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc read_coils_span(unsigned addr, bit_span bits);
+
+    /*!
+     * Read status of contiguous discrete inputs into packed bits.
+     *
+     * \param[in] addr Address of the first discrete input.
+     * \param[out] bits
+     *      Status of the requested discrete inputs. The size of the view is
+     *      the number of discrete inputs to read. All bits are cleared by the
+     *      server.
      *
-     * \note
-     * The server currently only supports basic device identification. The
-     * returned vendor, product and version information must be short enough to
-     * fit into a single Modbus frame.
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc read_discrete_inputs_span(unsigned addr, bit_span bits);
+
+    /*!
+     * Read status of contiguous holding registers into a buffer.
+     *
+     * \param[in] addr Address of the first holding register.
+     * \param[out] regs
+     *      Status of the requested holding registers. The size of the buffer
+     *      is the number of registers to read.
+     *
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc read_holding_registers_span(
+            unsigned addr, std::span<std::uint16_t> regs);
+
+    /*!
+     * Read status of contiguous input registers into a buffer.
+     *
+     * \param[in] addr Address of the first input register.
+     * \param[out] regs
+     *      Status of the requested input registers. The size of the buffer
+     *      is the number of registers to read.
+     *
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc read_input_registers_span(
+            unsigned addr, std::span<std::uint16_t> regs);
+
+    /*!
+     * Write packed bits to coils.
+     *
+     * \param[in] addr Address of the first coil.
+     * \param[in] bits Values to write to the coils.
+     *
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc write_coils_span(unsigned addr, const_bit_span bits);
+
+    /*!
+     * Write to holding registers from a buffer.
+     *
+     * \param[in] addr Address of the first holding register.
+     * \param[in] regs Values to write to the holding registers.
+     *
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc write_holding_registers_span(
+            unsigned addr, std::span<const std::uint16_t> regs);
+
+    /*!
+     * Write to and read from holding registers using buffers.
+     *
+     * See write_read_holding_registers() for the requirements.
+     *
+     * \param[in] addr_wr Address of the first holding register to write to.
+     * \param[in] regs_wr Values to write to the holding registers.
+     * \param[in] addr_rd Address of the first holding register to read from.
+     * \param[out] regs_rd
+     *      Status of the requested holding registers. The size of the buffer
+     *      is the number of registers to read.
+     *
+     * \copydetails backend_return_doc
+     * \see backend_span_doc
+     */
+    virtual errc write_read_holding_registers_span(unsigned addr_wr,
+            std::span<const std::uint16_t> regs_wr, unsigned addr_rd,
+            std::span<std::uint16_t> regs_rd);
+
+    /*!
+     * Read the device identification.
+     *
+     * The server serializes the objects once and answers the requests to
+     * read the device identification from that copy. It invokes this method
+     * again only if device_identification_revision() has changed.
+     *
+     * The default implementation provides the basic objects returned by
+     * get_basic_device_identification().
+     *
+     * \param[out] id Objects of the device identification.
+     *
+     * \copydetails backend_return_doc
+     */
+    virtual errc get_device_identification(device_identification& id) {
+        return get_basic_device_identification(
+                id.vendor_name, id.product_code, id.major_minor_revision);
+    }
+
+    /*!
+     * Revision of the device identification.
+     *
+     * The server checks the revision on each request to read the device
+     * identification. A backend changing its device identification at
+     * runtime signals the change by returning a new revision, so that the
+     * server reads the objects again.
+     *
+     * This method may be invoked by several threads at once.
+     *
+     * \return Revision of the objects returned by get_device_identification().
+     */
+    virtual std::uint64_t device_identification_revision() { return 0; }
+
+    /*!
+     * Read basic device identification.
      *
+     * This method is invoked by the default implementation of
+     * get_device_identification().
      *
      * \param[out] vendor Vendor of the server application.
      * \param[out] product Product name.
@@ -0,0 +1,132 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+/*!
+ * \file
+ * View of packed bits.
+ *
+ * This file provides a lightweight view of a sequence of bits, which are
+ * packed in the same layout as coils and discrete inputs in Modbus frames.
+ */
+#ifndef LIBMBOXID_BIT_SPAN_HPP
+#define LIBMBOXID_BIT_SPAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+namespace mboxid {
+
+/*!
+ * View of a sequence of packed bits.
+ *
+ * Bit \a i is held by bit `i % 8` of byte `i / 8`, i.e. the bits are packed
+ * least significant bit first, as in Modbus frames. Like `std::span`, the
+ * view does not own the bytes, and copying the view does not copy the bits.
+ *
+ * Use bit_span to modify bits, and const_bit_span to inspect them.
+ *
+ * \tparam Byte Either std::uint8_t or const std::uint8_t.
+ */
+template <typename Byte> class basic_bit_span {
+    static_assert(std::is_same_v<std::remove_const_t<Byte>, std::uint8_t>);
+
+public:
+    //! Constructs an empty view.
+    constexpr basic_bit_span() noexcept = default;
+
+    /*!
+     * Constructs a view of bits.
+     *
+     * \param[in] data Bytes holding the bits.
+     * \param[in] n_bits Number of bits.
+     */
+    constexpr basic_bit_span(Byte* data, std::size_t n_bits) noexcept
+            : p(data), n(n_bits) {}
+
+    //! Converts a view of modifiable bits into a view of constant bits.
+    template <typename B>
+        requires(std::is_const_v<Byte> && std::is_same_v<B, std::uint8_t>)
+    constexpr basic_bit_span(basic_bit_span<B> other) noexcept
+            : p(other.data()), n(other.size()) {}
+
+    //! Returns the number of bits.
+    [[nodiscard]] constexpr std::size_t size() const noexcept { return n; }
+
+    //! Returns true if the view holds no bits.
+    [[nodiscard]] constexpr bool empty() const noexcept { return !n; }
+
+    //! Returns the number of bytes holding the bits.
+    [[nodiscard]] constexpr std::size_t size_bytes() const noexcept {
+        return (n + 7) / 8;
+    }
+
+    //! Returns a pointer to the bytes holding the bits.
+    [[nodiscard]] constexpr Byte* data() const noexcept { return p; }
+
+    //! Returns the bytes holding the bits.
+    [[nodiscard]] constexpr std::span<Byte> bytes() const noexcept {
+        return {p, size_bytes()};
+    }
+
+    //! Returns the value of bit \a i.
+    [[nodiscard]] constexpr bool test(std::size_t i) const noexcept {
+        return (p[i / 8] >> (i % 8)) & 1U;
+    }
+
+    //! Returns the value of bit \a i.
+    constexpr bool operator[](std::size_t i) const noexcept { return test(i); }
+
+    //! Sets bit \a i to \a val.
+    constexpr void set(std::size_t i, bool val = true) const noexcept
+        requires(!std::is_const_v<Byte>)
+    {
+        auto mask = static_cast<std::uint8_t>(1U << (i % 8));
+        if (val)
+            p[i / 8] |= mask;
+        else
+            p[i / 8] &= ~mask;
+    }
+
+    //! Clears bit \a i.
+    constexpr void reset(std::size_t i) const noexcept
+        requires(!std::is_const_v<Byte>)
+    {
+        set(i, false);
+    }
+
+private:
+    Byte* p = nullptr;
+    std::size_t n = 0;
+};
+
+//! View of modifiable packed bits.
+using bit_span = basic_bit_span<std::uint8_t>;
+
+//! View of constant packed bits.
+using const_bit_span = basic_bit_span<const std::uint8_t>;
+
+/*!
+ * Packs an array of bools.
+ *
+ * The function uses SIMD instructions if the CPU supports them. The unused
+ * bits of the last byte of \a dst are cleared.
+ *
+ * \param[in] src Values to pack.
+ * \param[out] dst Packed bits. Must hold as many bits as \a src.
+ */
+void pack_bits(std::span<const bool> src, bit_span dst);
+
+/*!
+ * Unpacks bits into an array of bools.
+ *
+ * The function uses SIMD instructions if the CPU supports them.
+ *
+ * \param[in] src Packed bits.
+ * \param[out] dst Unpacked values. Must hold as many values as \a src bits.
+ */
+void unpack_bits(const_bit_span src, std::span<bool> dst);
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_BIT_SPAN_HPP
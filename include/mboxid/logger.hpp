@@ -7,6 +7,8 @@
 #ifndef LIBMBOXID_LOGGER_HPP
 #define LIBMBOXID_LOGGER_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string_view>
 
@@ -41,6 +43,85 @@ public:
 //! Smart pointer for logger class.
 using logger_unique_ptr = std::unique_ptr<const logger_base>;
 
+//! Levels of log messages, in ascending order, see set_level().
+enum class level {
+    debug,   //!< Debug messages.
+    info,    //!< Informational messages.
+    auth,    //!< Security-related messages, e.g. on accepted connections.
+    warning, //!< Warnings.
+    error,   //!< Errors.
+    off,     //!< Disables logging, if passed to set_level().
+};
+
+/*!
+ * Sets the minimum level of the messages to be logged.
+ *
+ * Messages below the level are discarded before they are formatted, so
+ * they cost hardly more than a comparison. By default, all messages are
+ * logged.
+ *
+ * This function may be called at any time, from any thread.
+ */
+void set_level(level lvl);
+
+//! Returns the minimum level of the messages to be logged.
+level get_level();
+
+/*!
+ * Logger passing the messages to another logger, the sink, from a background
+ * thread.
+ *
+ * The library's own messages are not formatted by the threads producing
+ * them. Their arguments are captured and queued in a lock-free ring buffer,
+ * from which the background thread formats them and passes them to the
+ * sink. So, neither formatting nor slow I/O, e.g. to a terminal, delays the
+ * threads serving requests. Messages passed to the methods of this class
+ * directly are queued as they are.
+ *
+ * If the ring buffer is full, messages are dropped, rather than blocking the
+ * producing thread. The background thread reports the number of dropped
+ * messages to the sink with a warning, and dropped() returns their total.
+ *
+ * Messages queued when the logger is destroyed are passed to the sink
+ * before the destructor returns. As for any logger, the logger must not be
+ * replaced while the library is logging, e.g. while a server is running.
+ */
+class async_logger final : public logger_base {
+public:
+    /*!
+     * Starts the background thread.
+     *
+     * \param[in] sink The logger receiving the messages.
+     * \param[in] capacity Number of messages the ring buffer holds, rounded
+     *      up to a power of two.
+     *
+     * \exception mboxid_error(errc::invalid_argument)
+     *      \a sink is a null pointer.
+     */
+    explicit async_logger(logger_unique_ptr sink, std::size_t capacity = 1024);
+
+    //! Passes the queued messages to the sink and stops the background thread.
+    ~async_logger() final;
+
+    void debug(std::string_view msg) const final;
+    void info(std::string_view msg) const final;
+    void warning(std::string_view msg) const final;
+    void error(std::string_view msg) const final;
+    void auth(std::string_view msg) const final;
+
+    //! Waits until all messages queued so far have been passed to the sink.
+    void flush() const;
+
+    //! Number of messages dropped because the ring buffer was full.
+    std::uint64_t dropped() const noexcept;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl;
+
+    friend void install_logger(logger_unique_ptr new_logger);
+};
+
 //! Create an instance of the standard logger.
 logger_unique_ptr make_standard_logger();
 
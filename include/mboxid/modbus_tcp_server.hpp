@@ -7,12 +7,17 @@
 #ifndef LIBMBOXID_MODBUS_TCP_SERVER_HPP
 #define LIBMBOXID_MODBUS_TCP_SERVER_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <span>
 #include <string>
+#include <functional>
 #include <mboxid/common.hpp>
 #include <mboxid/error.hpp>
 #include <mboxid/network.hpp>
 #include <mboxid/backend_connector.hpp>
+#include <mboxid/server_metrics.hpp>
 
 namespace mboxid {
 
@@ -22,6 +27,54 @@ public:
     //! Type used as client identifier.
     using client_id = backend_connector::client_id;
 
+    //! Function creating a backend instance, see set_backend_factory().
+    using backend_factory =
+            std::function<std::unique_ptr<backend_connector>()>;
+
+    //! Decides which requests are executed by worker threads, see
+    //! set_offload_policy().
+    using offload_policy = std::function<bool(std::uint8_t function_code)>;
+
+    //! Executes requests with a function code not implemented by the
+    //! library, see set_function_handler().
+    using function_handler = std::function<errc(backend_connector& backend,
+            std::span<const std::uint8_t> req, std::span<std::uint8_t> rsp,
+            std::size_t& rsp_size)>;
+
+    //! Points in time passed by a request, see set_request_tracer().
+    struct request_trace {
+        //! Clock of the timestamps.
+        using time_point = std::chrono::steady_clock::time_point;
+
+        client_id client = 0;              //!< Client sending the request.
+        std::uint16_t transaction_id = 0;  //!< As in the MBAP header.
+        std::uint8_t unit_id = 0;          //!< As in the MBAP header.
+        std::uint8_t function_code = 0;    //!< Of the request.
+
+        //! The first byte of the request has been received.
+        time_point first_byte_received;
+        //! The request has been received completely and is about to be
+        //! dispatched.
+        time_point frame_complete;
+        //! Execution of the request has started. Zero if the request has
+        //! not been executed, e.g. as it has been coalesced with another one.
+        time_point backend_entered;
+        //! Execution of the request has finished. Zero if the request has
+        //! not been executed.
+        time_point backend_returned;
+        //! The response has been passed to the kernel completely.
+        time_point response_sent;
+    };
+
+    //! Receives the traces of requests, see set_request_tracer().
+    using request_tracer = std::function<void(const request_trace& trace)>;
+
+    //! Mechanisms used to perform the network I/O, see set_transport().
+    enum class transport {
+        epoll,    //!< Readiness notification by epoll (default).
+        io_uring, //!< Asynchronous I/O with io_uring (Linux 6.1 or later).
+    };
+
     //! Default constructor.
     modbus_tcp_server();
 
@@ -81,17 +134,63 @@ public:
      *
      * This method sets the backend which connects the server with the user
      * application. The server takes ownership of the backend.
+     *
+     * The backend is shared by all threads of the server. If the server runs
+     * more than one thread (see set_thread_count()), the methods of the
+     * backend may be invoked concurrently from different threads, hence the
+     * backend must be thread-safe. The method backend_connector::ticker() is
+     * an exception: it is only invoked by the thread executing run().
+     *
+     * If the backend is derived from async_backend_connector, requests are
+     * submitted to it for deferred execution.
+     *
+     * Replaces a factory set with set_backend_factory().
      */
     void set_backend(std::unique_ptr<backend_connector> backend);
 
+    /*!
+     * Sets a factory which creates a separate backend for each thread.
+     *
+     * When run() is invoked, the server calls \a factory once per thread of
+     * the server. The methods of each backend instance, including
+     * backend_connector::ticker(), are only invoked from the thread the
+     * instance has been created for. So the instances need no
+     * synchronization on their own, but data shared among them does. The
+     * instances are destroyed when run() returns.
+     *
+     * As worker threads would break this guarantee, a factory cannot be
+     * combined with set_worker_threads(). run() rejects the combination.
+     *
+     * Replaces a backend set with set_backend().
+     */
+    void set_backend_factory(backend_factory factory);
+
     /*!
      * Get access to the backend without taking ownership.
      * \internal
      * This function is provided for unit tests, but can also be used for other
-     * purposes.
+     * purposes. It returns a null pointer if backends are created by a
+     * factory.
      */
     backend_connector* borrow_backend();
 
+    /*!
+     * Sets the number of threads serving client connections.
+     *
+     * By default, the server serves all connections from the thread executing
+     * run(). If \a cnt is greater than one, run() starts \a cnt - 1
+     * additional threads. Each thread binds its own listening socket(s) with
+     * the socket option SO_REUSEPORT, and the operating system distributes
+     * incoming connections among them. A connection is served by the thread
+     * which accepted it for its whole lifetime.
+     *
+     * See set_backend() and set_backend_factory() for the implications on
+     * the backend.
+     *
+     * \param[in] cnt Number of threads (1 to 256).
+     */
+    void set_thread_count(unsigned cnt);
+
     /*!
      * Server run loop.
      *
@@ -100,7 +199,8 @@ public:
      * shutdown() is  called.
      *
      * It is suggested to execute run() in its own thread. It is safe to call
-     * shutdown() from a different thread.
+     * shutdown() from a different thread. If the server is configured to use
+     * several threads, run() returns after all of them have stopped.
      *
      * \throw mboxid::system_error
      *      A system call returned an error that is not handled further by the
@@ -110,6 +210,8 @@ public:
      *      error not handled within the library.
      * \throw mboxid::mboxid_error(errc::passive_open_error)
      *      Open listening port(s) failed.
+     * \throw mboxid::mboxid_error(errc::invalid_argument)
+     *      Worker threads are configured together with a backend factory.
      * \throw mboxid::mboxid_error(errc::*)
      *      Some other error.
      */
@@ -141,6 +243,253 @@ public:
     //! Sets the time limit within a request must be complete.
     void set_request_complete_timeout(milliseconds to);
 
+    /*!
+     * Selects the mechanism used to perform the network I/O.
+     *
+     * With transport::io_uring, connections are accepted and served by
+     * requests which stay queued in the kernel, and the requests issued while
+     * processing a batch of events are submitted at once. Under load this
+     * saves most of the system calls spent per request with epoll.
+     *
+     * The transport is set up when run() is invoked. If io_uring is not
+     * available, e.g. because the kernel is too old or io_uring is disabled,
+     * the server logs a warning and falls back to epoll.
+     */
+    void set_transport(transport t);
+
+    /*!
+     * Sets the number of outstanding requests per connection.
+     *
+     * A client may send further requests before it has received the
+     * responses to its previous ones. The server executes up to \a depth of
+     * them, while their responses are still waiting to be sent. Responses
+     * are sent in the order of the requests, and responses which have
+     * queued up are passed to the network together. Requests exceeding the
+     * limit stay in the receive buffer of the connection until responses
+     * have been sent.
+     *
+     * A depth of 1 executes a request not before the response to its
+     * predecessor has been sent completely.
+     *
+     * \param[in] depth Maximum number of outstanding requests (1 to 64,
+     *      default 8).
+     */
+    void set_pipeline_depth(unsigned depth);
+
+    /*!
+     * Sets the maximum length of the queue of pending connections.
+     *
+     * The value is passed to listen() for each listening socket. The kernel
+     * queues up to \a backlog connections which have been established but
+     * not accepted by the server yet, and drops further connection attempts.
+     * Linux silently caps the value at net.core.somaxconn.
+     *
+     * A large backlog helps when many clients connect at once, e.g. after
+     * a network outage.
+     *
+     * \param[in] backlog Queue length (at least 1, default SOMAXCONN).
+     */
+    void set_listen_backlog(int backlog);
+
+    /*!
+     * Number of connection attempts dropped by the kernel (thread-safe).
+     *
+     * Connection attempts are dropped if the queue of pending connections is
+     * full, see set_listen_backlog(). The server samples the counters of its
+     * listening sockets once per second and logs a warning if they have
+     * increased. The result is the sum over all listening sockets since
+     * run() has been invoked.
+     */
+    uint64_t accept_queue_overflows() const;
+
+    /*!
+     * Sets the number of worker threads executing requests.
+     *
+     * By default, requests are executed by the thread serving the connection.
+     * A backend method taking long, e.g. because it computes its results,
+     * thereby delays all other clients served by that thread. With worker
+     * threads, the requests selected by the offload policy are executed by
+     * a worker instead, while the serving thread continues with other
+     * clients.
+     *
+     * The requests of a client are executed one after the other in the
+     * order of their arrival, and their responses are sent in that order.
+     * The methods of the backend may be invoked concurrently by different
+     * workers, hence the backend must be thread-safe. Worker threads require
+     * a backend set with set_backend(), they cannot be used with
+     * set_backend_factory().
+     *
+     * The setting has no effect on backends derived from
+     * async_backend_connector, which decide on the execution of requests
+     * themselves.
+     *
+     * \param[in] cnt Number of worker threads (0 to 256, default 0).
+     */
+    void set_worker_threads(unsigned cnt);
+
+    /*!
+     * Selects the requests executed by worker threads.
+     *
+     * When run() is invoked, the server asks \a policy once for each
+     * function code whether requests with this function code shall be
+     * executed by a worker thread. Requests with other function codes are
+     * executed by the thread serving the connection, which avoids the
+     * overhead of the hand-over for requests served quickly anyway. By
+     * default all requests are offloaded.
+     *
+     * A request is offloaded anyway if requests of the same client are
+     * still executed by a worker. This preserves the order of execution.
+     *
+     * \param[in] policy Returns true for function codes to be offloaded.
+     */
+    void set_offload_policy(offload_policy policy);
+
+    /*!
+     * Enables the cache of responses to read requests.
+     *
+     * Clients often poll the same ranges many times per second. With the
+     * cache enabled, the server keeps the responses to read requests
+     * (function codes 1 to 4) and answers a request for the same unit id,
+     * function code, address and count with a copy of the previous response,
+     * without invoking the backend. Exception responses are not cached.
+     *
+     * A cached response is used for at most \a max_staleness. Write requests
+     * received by the server invalidate the cached responses to overlapping
+     * ranges right away. Updates the application makes to the backend
+     * directly are only seen by clients once the cached responses have
+     * expired, so \a max_staleness should be chosen accordingly.
+     *
+     * Each backend has its own cache, so the cache works with a shared
+     * backend as well as with a backend factory. For backends derived from
+     * async_backend_connector, the cache is consulted when the backend
+     * executes a request, see deferred_request::execute().
+     *
+     * \param[in] max_staleness Maximum age of a cached response. 0 disables
+     *      the cache (default).
+     *
+     * \exception mboxid_error(errc::invalid_argument)
+     *      \a max_staleness is negative.
+     */
+    void set_response_cache(milliseconds max_staleness);
+
+    /*!
+     * Enables the coalescing of identical read requests.
+     *
+     * Requests submitted to an asynchronous backend or executed by worker
+     * threads are outstanding until the backend completes them. With
+     * coalescing enabled, a read request (function codes 1 to 4) with the
+     * same unit id, function code, address and count as an outstanding one
+     * is not passed to the backend. It receives a copy of the response to
+     * the outstanding request instead. So, if many clients poll the same
+     * registers from a slow backend, e.g. a gateway to a field bus, the
+     * backend reads them once.
+     *
+     * Coalescing is performed among the clients served by the same thread,
+     * see set_thread_count(). As the response to the outstanding request may
+     * have been read before a coalesced request arrived, it may miss a write
+     * of another server thread completed in the meantime. Hence, coalescing
+     * is disabled by default. Writes received by the same thread are
+     * respected: a read request is not coalesced with a request outstanding
+     * before a write, nor while its client has a write outstanding.
+     *
+     * \param[in] enable True to enable coalescing.
+     */
+    void set_read_coalescing(bool enable);
+
+    /*!
+     * Registers a handler for a custom function code.
+     *
+     * Requests are dispatched by a table indexed by the function code, which
+     * holds the handlers of the function codes implemented by the library.
+     * Requests with any other function code are answered with the Modbus
+     * exception errc::modbus_exception_illegal_function, unless the
+     * application registers a handler for the function code, e.g. for a
+     * vendor-specific bulk transfer.
+     *
+     * The handler gets the backend serving the request, the request PDU \a
+     * req, starting with the function code, and the buffer \a rsp for the
+     * response PDU. It stores the response PDU, starting with the function
+     * code, in \a rsp, sets \a rsp_size to its size and returns
+     * errc::none. To reject the request, it returns a Modbus exception
+     * instead, which is sent to the client. For a malformed request, it
+     * returns errc::parse_error, which closes the connection to the client.
+     * Any other error code is handled like an error code returned by a
+     * method of the backend. If the handler returns errc::none with a
+     * \a rsp_size of 0 or larger than \a rsp, the error is logged and the
+     * request is answered with errc::modbus_exception_server_device_failure.
+     *
+     * The handler is invoked like the backend methods: by the thread serving
+     * the connection or by a worker thread, subject to
+     * set_offload_policy(), and therefore concurrently if more than one
+     * thread is used. Requests for asynchronous backends are executed by
+     * the backend's thread.
+     *
+     * Handlers must be registered before run() is invoked.
+     *
+     * \param[in] function_code The function code, in the range 1 to 127.
+     * \param[in] handler The handler, or an empty function to remove the
+     *      handler of \a function_code.
+     *
+     * \exception mboxid_error(errc::invalid_argument)
+     *      \a function_code is out of range or implemented by the library.
+     */
+    void set_function_handler(
+            std::uint8_t function_code, function_handler handler);
+
+    /*!
+     * Enables the latency histograms of the server metrics.
+     *
+     * The histograms server_metrics::processing_time and
+     * server_metrics::backend_time take two readings of the clock per
+     * request, which costs more than all counters together. Hence, they are
+     * disabled by default.
+     *
+     * \param[in] enable True to record the histograms.
+     */
+    void set_latency_histograms(bool enable);
+
+    /*!
+     * Returns a snapshot of the server metrics (thread-safe).
+     *
+     * Each thread serving connections records its own metrics, which are
+     * summed up by this method. The threads are not interrupted, so the
+     * method may be invoked at any time while the server is running. As the
+     * threads keep on counting while the snapshot is taken, the counters are
+     * not necessarily consistent with each other, e.g. a response may
+     * already be counted while its request is not.
+     */
+    server_metrics metrics() const;
+
+    /*!
+     * Sets a tracer receiving the timestamps of requests.
+     *
+     * To find out where the time goes for individual requests, the server
+     * records for every \a sample_interval-th request the points in time
+     * it passes, see request_trace. Once the response has been sent, the
+     * trace is passed to \a tracer. Traces of requests whose connection
+     * is closed in the meantime are dropped.
+     *
+     * The tracer is invoked by the thread serving the connection, and
+     * therefore concurrently if set_thread_count() configures more than one
+     * thread. It should return quickly, as it delays the requests of all
+     * connections served by the thread.
+     *
+     * Requests which are not sampled cost a decrement of a counter. If the
+     * library is built with the CMake option MBOXID_ENABLE_TRACING turned
+     * off, the tracing code is compiled out and this method only logs a
+     * warning.
+     *
+     * \param[in] tracer The tracer, or an empty function to disable
+     *      tracing (default).
+     * \param[in] sample_interval Trace one request out of \a
+     *      sample_interval, at least 1.
+     *
+     * \exception mboxid_error(errc::invalid_argument)
+     *      \a sample_interval is 0.
+     */
+    void set_request_tracer(
+            request_tracer tracer, unsigned sample_interval = 1);
+
 private:
     class impl;
     std::unique_ptr<impl> pimpl;
@@ -0,0 +1,207 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+/*!
+ *\file
+ * Backend holding the Modbus data model in memory.
+ */
+#ifndef LIBMBOXID_REGISTER_MAP_BACKEND_HPP
+#define LIBMBOXID_REGISTER_MAP_BACKEND_HPP
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <mboxid/backend_connector.hpp>
+#include <mboxid/bit_span.hpp>
+
+namespace mboxid {
+
+/*!
+ * Backend serving coils, discrete inputs and registers from memory.
+ *
+ * The backend holds a table for each of the four object types of the Modbus
+ * data model, sized at construction. The tables start at address 0. Requests
+ * referring to addresses beyond the size of a table are answered with the
+ * Modbus exception errc::modbus_exception_illegal_data_address.
+ *
+ * The application accesses the tables with the get_ and set_ methods. All
+ * methods are thread-safe, so application threads may update values while the
+ * server serves requests. Each coil and discrete input is read and written
+ * atomically.
+ *
+ * Registers are read and written as consistent blocks. A request or a
+ * get_ method reading several registers sees either all or none of the
+ * registers written by a concurrent request or set_ method. Values spanning
+ * several registers, e.g. 32-bit or 64-bit values, are therefore never torn
+ * if they are written with a single call. Reading never blocks: readers retry
+ * instead if a writer modifies the registers in the meantime. Writers of
+ * overlapping register ranges wait for each other for the duration of the
+ * copy only.
+ *
+ * The tables are aligned to cache lines and do not share cache lines with
+ * each other.
+ */
+class register_map_backend : public backend_connector {
+public:
+    /*!
+     * Creates the tables. All values are initialized to zero.
+     *
+     * \param[in] n_coils Number of coils.
+     * \param[in] n_discrete_inputs Number of discrete inputs.
+     * \param[in] n_input_registers Number of input registers.
+     * \param[in] n_holding_registers Number of holding registers.
+     *
+     * \exception mboxid_error(errc::invalid_argument)
+     *      A size exceeds the Modbus address space of 65536 objects.
+     */
+    register_map_backend(std::size_t n_coils, std::size_t n_discrete_inputs,
+            std::size_t n_input_registers, std::size_t n_holding_registers);
+
+    //! Destructor.
+    ~register_map_backend() override;
+
+    //! Number of coils.
+    std::size_t coil_count() const noexcept;
+
+    //! Number of discrete inputs.
+    std::size_t discrete_input_count() const noexcept;
+
+    //! Number of input registers.
+    std::size_t input_register_count() const noexcept;
+
+    //! Number of holding registers.
+    std::size_t holding_register_count() const noexcept;
+
+    /*!
+     * \defgroup register_map_range_doc Register map range checks
+     *
+     * \exception mboxid_error(errc::invalid_argument)
+     *      The addressed values exceed the size of the table.
+     */
+
+    /*!
+     * Returns the value of a coil.
+     * \copydetails register_map_range_doc
+     */
+    bool get_coil(unsigned addr) const;
+
+    /*!
+     * Sets the value of a coil.
+     * \copydetails register_map_range_doc
+     */
+    void set_coil(unsigned addr, bool val);
+
+    /*!
+     * Copies the values of contiguous coils, starting at \a addr, to \a bits.
+     * \copydetails register_map_range_doc
+     */
+    void get_coils(unsigned addr, bit_span bits) const;
+
+    /*!
+     * Sets contiguous coils, starting at \a addr, to the values of \a bits.
+     * \copydetails register_map_range_doc
+     */
+    void set_coils(unsigned addr, const_bit_span bits);
+
+    /*!
+     * Returns the value of a discrete input.
+     * \copydetails register_map_range_doc
+     */
+    bool get_discrete_input(unsigned addr) const;
+
+    /*!
+     * Sets the value of a discrete input.
+     * \copydetails register_map_range_doc
+     */
+    void set_discrete_input(unsigned addr, bool val);
+
+    /*!
+     * Copies the values of contiguous discrete inputs, starting at \a addr,
+     * to \a bits.
+     * \copydetails register_map_range_doc
+     */
+    void get_discrete_inputs(unsigned addr, bit_span bits) const;
+
+    /*!
+     * Sets contiguous discrete inputs, starting at \a addr, to the values of
+     * \a bits.
+     * \copydetails register_map_range_doc
+     */
+    void set_discrete_inputs(unsigned addr, const_bit_span bits);
+
+    /*!
+     * Returns the value of an input register.
+     * \copydetails register_map_range_doc
+     */
+    std::uint16_t get_input_register(unsigned addr) const;
+
+    /*!
+     * Sets the value of an input register.
+     * \copydetails register_map_range_doc
+     */
+    void set_input_register(unsigned addr, std::uint16_t val);
+
+    /*!
+     * Copies the values of contiguous input registers, starting at \a addr,
+     * to \a regs.
+     * \copydetails register_map_range_doc
+     */
+    void get_input_registers(
+            unsigned addr, std::span<std::uint16_t> regs) const;
+
+    /*!
+     * Sets contiguous input registers, starting at \a addr, to the values of
+     * \a regs.
+     * \copydetails register_map_range_doc
+     */
+    void set_input_registers(
+            unsigned addr, std::span<const std::uint16_t> regs);
+
+    /*!
+     * Returns the value of a holding register.
+     * \copydetails register_map_range_doc
+     */
+    std::uint16_t get_holding_register(unsigned addr) const;
+
+    /*!
+     * Sets the value of a holding register.
+     * \copydetails register_map_range_doc
+     */
+    void set_holding_register(unsigned addr, std::uint16_t val);
+
+    /*!
+     * Copies the values of contiguous holding registers, starting at \a addr,
+     * to \a regs.
+     * \copydetails register_map_range_doc
+     */
+    void get_holding_registers(
+            unsigned addr, std::span<std::uint16_t> regs) const;
+
+    /*!
+     * Sets contiguous holding registers, starting at \a addr, to the values
+     * of \a regs.
+     * \copydetails register_map_range_doc
+     */
+    void set_holding_registers(
+            unsigned addr, std::span<const std::uint16_t> regs);
+
+    errc read_coils_span(unsigned addr, bit_span bits) override;
+    errc read_discrete_inputs_span(unsigned addr, bit_span bits) override;
+    errc read_holding_registers_span(
+            unsigned addr, std::span<std::uint16_t> regs) override;
+    errc read_input_registers_span(
+            unsigned addr, std::span<std::uint16_t> regs) override;
+    errc write_coils_span(unsigned addr, const_bit_span bits) override;
+    errc write_holding_registers_span(
+            unsigned addr, std::span<const std::uint16_t> regs) override;
+    errc write_read_holding_registers_span(unsigned addr_wr,
+            std::span<const std::uint16_t> regs_wr, unsigned addr_rd,
+            std::span<std::uint16_t> regs_rd) override;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl;
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_REGISTER_MAP_BACKEND_HPP
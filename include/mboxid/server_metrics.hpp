@@ -0,0 +1,142 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+/*!
+ * \file
+ * Metrics of the Modbus TCP/IP server.
+ */
+#ifndef LIBMBOXID_SERVER_METRICS_HPP
+#define LIBMBOXID_SERVER_METRICS_HPP
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace mboxid {
+
+/*!
+ * Distribution of durations.
+ *
+ * The histogram has log-linear buckets as a HDR histogram: every power of two
+ * is divided into 16 buckets of equal width. Therefore, a duration is
+ * reported with a relative error below 1/16, i.e. 6.25%. Durations from 0 ns
+ * to about 68 s are distinguished, longer ones are counted in the last
+ * bucket.
+ */
+struct latency_histogram {
+    //! Number of buckets each power of two is divided into.
+    static constexpr unsigned sub_buckets = 16;
+
+    //! Largest power of two distinguished.
+    static constexpr unsigned max_exponent = 35;
+
+    //! Number of buckets.
+    static constexpr unsigned n_buckets = sub_buckets * (max_exponent - 2);
+
+    //! Number of durations per bucket.
+    std::array<std::uint64_t, n_buckets> counts{};
+
+    //! Index of the bucket counting the duration \a ns in nanoseconds.
+    static unsigned bucket(std::uint64_t ns) {
+        if (ns < sub_buckets)
+            return static_cast<unsigned>(ns);
+        unsigned e = std::bit_width(ns) - 1;
+        if (e > max_exponent)
+            return n_buckets - 1;
+        auto sub = static_cast<unsigned>(ns >> (e - 4)) - sub_buckets;
+        return sub_buckets * (e - 3) + sub;
+    }
+
+    //! Smallest duration in nanoseconds counted by the bucket \a index.
+    static std::uint64_t lower_bound(unsigned index);
+
+    //! Largest duration in nanoseconds counted by the bucket \a index.
+    static std::uint64_t upper_bound(unsigned index);
+
+    //! Total number of durations.
+    std::uint64_t count() const;
+
+    /*!
+     * Duration not exceeded by the fraction \a q of all durations.
+     *
+     * The result is the upper bound of the bucket containing the quantile,
+     * e.g. quantile(0.99) returns the 99th percentile. An empty histogram
+     * returns zero.
+     *
+     * \param[in] q The fraction, in the range 0 to 1.
+     */
+    std::chrono::nanoseconds quantile(double q) const;
+
+    //! Adds the counts of \a other to the histogram.
+    latency_histogram& operator+=(const latency_histogram& other);
+};
+
+/*!
+ * Snapshot of the metrics of a Modbus TCP/IP server.
+ *
+ * The counters start at zero when the server is created and are never
+ * reset. Requests and exception responses are counted per function code of
+ * the request.
+ */
+struct server_metrics {
+    //! Number of requests received, per function code.
+    std::array<std::uint64_t, 256> requests{};
+
+    //! Number of exception responses sent, per function code.
+    std::array<std::uint64_t, 256> exceptions{};
+
+    //! Number of bytes received from clients.
+    std::uint64_t bytes_received = 0;
+
+    //! Number of bytes sent to clients.
+    std::uint64_t bytes_sent = 0;
+
+    //! Number of connections accepted.
+    std::uint64_t connections_accepted = 0;
+
+    //! Number of connections denied by the backend.
+    std::uint64_t connections_denied = 0;
+
+    //! Number of accepted connections closed, for whatever reason.
+    std::uint64_t connections_closed = 0;
+
+    //! Number of connections closed because the idle timeout expired.
+    std::uint64_t idle_timeouts = 0;
+
+    //! Number of connections closed because the request complete timeout
+    //! expired.
+    std::uint64_t request_complete_timeouts = 0;
+
+    /*!
+     * Time from the reception of a request until its response is ready to
+     * be sent.
+     *
+     * Only recorded if enabled by
+     * modbus_tcp_server::set_latency_histograms().
+     */
+    latency_histogram processing_time;
+
+    /*!
+     * Time spent executing a request, including the calls to the backend.
+     *
+     * Only recorded if enabled by
+     * modbus_tcp_server::set_latency_histograms(). Requests answered with
+     * the response to an identical request, see
+     * modbus_tcp_server::set_read_coalescing(), are not executed and not
+     * recorded.
+     */
+    latency_histogram backend_time;
+
+    //! Total number of requests received.
+    std::uint64_t total_requests() const;
+
+    //! Total number of exception responses sent.
+    std::uint64_t total_exceptions() const;
+
+    //! Adds the counters of \a other to the snapshot.
+    server_metrics& operator+=(const server_metrics& other);
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_SERVER_METRICS_HPP
@@ -0,0 +1,99 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <mboxid/async_backend_connector.hpp>
+#include "error_private.hpp"
+#include "completion_queue.hpp"
+#include "modbus_protocol_server.hpp"
+
+namespace mboxid {
+
+deferred_request::deferred_request() noexcept = default;
+
+deferred_request::deferred_request(std::unique_ptr<state> st) noexcept
+        : st(std::move(st)) {}
+
+deferred_request::deferred_request(deferred_request&&) noexcept = default;
+
+deferred_request& deferred_request::operator=(
+        deferred_request&& other) noexcept {
+    if (this != &other) {
+        if (st) {
+            try {
+                fail(errc::modbus_exception_server_device_failure);
+            } catch (...) {
+                // nothing we can do about it
+            }
+        }
+        st = std::move(other.st);
+    }
+    return *this;
+}
+
+deferred_request::~deferred_request() {
+    if (st) {
+        try {
+            fail(errc::modbus_exception_server_device_failure);
+        } catch (...) {
+            // nothing we can do about it
+        }
+    }
+}
+
+auto deferred_request::client() const -> client_id {
+    expects(st != nullptr, "deferred_request: empty handle");
+    return st->client;
+}
+
+std::uint8_t deferred_request::function_code() const {
+    expects(st != nullptr, "deferred_request: empty handle");
+    return st->req_size ? st->req[0] : 0;
+}
+
+void deferred_request::execute(backend_connector& backend) {
+    expects(st != nullptr, "deferred_request: empty handle");
+
+    if (st->timed)
+        st->exec_begin = std::chrono::steady_clock::now();
+
+    try {
+        auto res = server_engine(backend, st->backend_st.get(), st->unit_id,
+                std::span(st->req, st->req_size), std::span(st->rsp),
+                st->rsp_size);
+        if (res != errc::none) {
+            st->error = make_error_code(res);
+            st->error_msg = (res == errc::parse_error)
+                    ? "malformed request"
+                    : "backend failed request";
+        }
+    } catch (const mboxid_error& e) {
+        st->error = e.code();
+        st->error_msg = e.what();
+    }
+
+    if (st->timed)
+        st->exec_end = std::chrono::steady_clock::now();
+    complete();
+}
+
+void deferred_request::fail(errc e) {
+    expects(st != nullptr, "deferred_request: empty handle");
+
+    if (is_modbus_exception(e)) {
+        auto fc = static_cast<mboxid::function_code>(function_code());
+        st->rsp_size = serialize_exception_response(std::span(st->rsp), fc, e);
+    } else {
+        st->error = make_error_code(e);
+        st->error_msg = "backend failed deferred request";
+    }
+    st->timed = false; // not executed
+    complete();
+}
+
+void deferred_request::complete() {
+    // Queued requests don't refer to the queue, which would keep it alive.
+    auto queue = std::move(st->queue);
+    queue->post(std::move(st));
+}
+
+} // namespace mboxid
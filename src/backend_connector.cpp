@@ -0,0 +1,98 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <mboxid/backend_connector.hpp>
+#include "error_private.hpp"
+#include "modbus_protocol_common.hpp"
+
+namespace mboxid {
+
+// The default implementations of the span-based interface adapt it to the
+// vector-based interface, which existing backends implement.
+
+errc backend_connector::read_coils_span(unsigned addr, bit_span bits) {
+    std::vector<bool> v;
+    v.reserve(bits.size());
+
+    auto res = read_coils(addr, bits.size(), v);
+    if (res == errc::none) {
+        expects(v.size() == bits.size(),
+                "backend returned wrong number of bits");
+        serialize_bits(bits.bytes(), v);
+    }
+    return res;
+}
+
+errc backend_connector::read_discrete_inputs_span(
+        unsigned addr, bit_span bits) {
+    std::vector<bool> v;
+    v.reserve(bits.size());
+
+    auto res = read_discrete_inputs(addr, bits.size(), v);
+    if (res == errc::none) {
+        expects(v.size() == bits.size(),
+                "backend returned wrong number of bits");
+        serialize_bits(bits.bytes(), v);
+    }
+    return res;
+}
+
+errc backend_connector::read_holding_registers_span(
+        unsigned addr, std::span<std::uint16_t> regs) {
+    std::vector<std::uint16_t> v;
+    v.reserve(regs.size());
+
+    auto res = read_holding_registers(addr, regs.size(), v);
+    if (res == errc::none) {
+        expects(v.size() == regs.size(),
+                "backend returned wrong number of registers");
+        std::copy(v.begin(), v.end(), regs.begin());
+    }
+    return res;
+}
+
+errc backend_connector::read_input_registers_span(
+        unsigned addr, std::span<std::uint16_t> regs) {
+    std::vector<std::uint16_t> v;
+    v.reserve(regs.size());
+
+    auto res = read_input_registers(addr, regs.size(), v);
+    if (res == errc::none) {
+        expects(v.size() == regs.size(),
+                "backend returned wrong number of registers");
+        std::copy(v.begin(), v.end(), regs.begin());
+    }
+    return res;
+}
+
+errc backend_connector::write_coils_span(unsigned addr, const_bit_span bits) {
+    std::vector<bool> v;
+    parse_bits(bits.bytes(), v, bits.size());
+    return write_coils(addr, v);
+}
+
+errc backend_connector::write_holding_registers_span(
+        unsigned addr, std::span<const std::uint16_t> regs) {
+    return write_holding_registers(
+            addr, std::vector<std::uint16_t>(regs.begin(), regs.end()));
+}
+
+errc backend_connector::write_read_holding_registers_span(unsigned addr_wr,
+        std::span<const std::uint16_t> regs_wr, unsigned addr_rd,
+        std::span<std::uint16_t> regs_rd) {
+    std::vector<std::uint16_t> v;
+    v.reserve(regs_rd.size());
+
+    auto res = write_read_holding_registers(addr_wr,
+            std::vector<std::uint16_t>(regs_wr.begin(), regs_wr.end()),
+            addr_rd, regs_rd.size(), v);
+    if (res == errc::none) {
+        expects(v.size() == regs_rd.size(),
+                "backend returned wrong number of registers");
+        std::copy(v.begin(), v.end(), regs_rd.begin());
+    }
+    return res;
+}
+
+} // namespace mboxid
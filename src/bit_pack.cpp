@@ -0,0 +1,177 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <bit>
+#include <cstring>
+#include <mboxid/bit_span.hpp>
+#include "error_private.hpp"
+#include "bit_pack.hpp"
+
+#if defined(MBOXID_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace mboxid {
+
+// Packs 8 bools held by the bytes of x into the bits of a byte. Multiplying
+// by the magic number moves the value of byte j to bit 56 + j without
+// carries, as each bool is either 0 or 1.
+static inline uint8_t pack8(uint64_t x) {
+    return static_cast<uint8_t>((x * 0x0102040810204080ULL) >> 56);
+}
+
+static void pack_tail(const bool* src, size_t n, uint8_t* dst) {
+    unsigned v = 0;
+    for (size_t j = 0; j < n; ++j)
+        v |= static_cast<unsigned>(src[j]) << j;
+    *dst = static_cast<uint8_t>(v);
+}
+
+void pack_bits_scalar(const bool* src, size_t n, uint8_t* dst) {
+    size_t i = 0;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        for (; i + 8 <= n; i += 8) {
+            uint64_t x;
+            std::memcpy(&x, src + i, sizeof(x));
+            *dst++ = pack8(x);
+        }
+    }
+    for (; i + 8 <= n; i += 8)
+        pack_tail(src + i, 8, dst++);
+    if (i < n)
+        pack_tail(src + i, n - i, dst);
+}
+
+void unpack_bits_scalar(const uint8_t* src, size_t n, bool* dst) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        unsigned v = *src++;
+        for (unsigned j = 0; j < 8; ++j)
+            dst[i + j] = (v >> j) & 1U;
+    }
+    for (unsigned j = 0; i < n; ++i, ++j)
+        dst[i] = (*src >> j) & 1U;
+}
+
+#if defined(MBOXID_HAVE_X86_SIMD)
+
+// The SIMD kernels compare the bools against zero, so that the most
+// significant bit of each byte is set for true values, and gather these bits
+// with movemask. Bit i of the mask then holds bool i, which is exactly the
+// packed layout. Unpacking broadcasts each source byte to 8 lanes and tests
+// a different bit in each lane.
+
+void pack_bits_sse2(const bool* src, size_t n, uint8_t* dst) {
+    const auto zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        auto m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        auto bits = static_cast<uint16_t>(m);
+        std::memcpy(dst, &bits, sizeof(bits));
+        dst += sizeof(bits);
+    }
+    pack_bits_scalar(src + i, n - i, dst);
+}
+
+void unpack_bits_sse2(const uint8_t* src, size_t n, bool* dst) {
+    const auto mask = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8,
+            16, 32, 64, -128);
+    const auto one = _mm_set1_epi8(1);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint16_t bits;
+        std::memcpy(&bits, src + i / 8, sizeof(bits));
+
+        // byte 0 to lanes 0..7, byte 1 to lanes 8..15
+        auto v = _mm_set1_epi16(static_cast<short>(bits));
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+        _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(dst + i), _mm_and_si128(v, one));
+    }
+    for (; i < n; ++i)
+        dst[i] = (src[i / 8] >> (i % 8)) & 1U;
+}
+
+__attribute__((target("avx2"))) void pack_bits_avx2(
+        const bool* src, size_t n, uint8_t* dst) {
+    const auto zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        auto v = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(src + i));
+        auto m = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        auto bits = static_cast<uint32_t>(m);
+        std::memcpy(dst, &bits, sizeof(bits));
+        dst += sizeof(bits);
+    }
+    pack_bits_sse2(src + i, n - i, dst);
+}
+
+__attribute__((target("avx2"))) void unpack_bits_avx2(
+        const uint8_t* src, size_t n, bool* dst) {
+    // The shuffle operates within 128-bit lanes. As all four source bytes
+    // are broadcast to both lanes, each lane can pick any of them.
+    const auto spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+            1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const auto mask = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4,
+            8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16,
+            32, 64, -128);
+    const auto one = _mm256_set1_epi8(1);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        uint32_t bits;
+        std::memcpy(&bits, src + i / 8, sizeof(bits));
+
+        auto v = _mm256_set1_epi32(static_cast<int>(bits));
+        v = _mm256_shuffle_epi8(v, spread);
+        v = _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                _mm256_and_si256(v, one));
+    }
+    unpack_bits_sse2(src + i / 8, n - i, dst + i);
+}
+
+#endif
+
+static pack_bits_fn select_pack_kernel() {
+#if defined(MBOXID_HAVE_X86_SIMD)
+    return cpu_has_avx2() ? pack_bits_avx2 : pack_bits_sse2;
+#else
+    return pack_bits_scalar;
+#endif
+}
+
+static unpack_bits_fn select_unpack_kernel() {
+#if defined(MBOXID_HAVE_X86_SIMD)
+    return cpu_has_avx2() ? unpack_bits_avx2 : unpack_bits_sse2;
+#else
+    return unpack_bits_scalar;
+#endif
+}
+
+void pack_bits(std::span<const bool> src, bit_span dst) {
+    static const auto kernel = select_pack_kernel();
+
+    validate_argument(dst.size() == src.size(), "pack_bits: size mismatch");
+    kernel(src.data(), src.size(), dst.data());
+}
+
+void unpack_bits(const_bit_span src, std::span<bool> dst) {
+    static const auto kernel = select_unpack_kernel();
+
+    validate_argument(dst.size() == src.size(), "unpack_bits: size mismatch");
+    kernel(src.data(), src.size(), dst.data());
+}
+
+} // namespace mboxid
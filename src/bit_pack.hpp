@@ -0,0 +1,39 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_BIT_PACK_HPP
+#define LIBMBOXID_BIT_PACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "cpu_features.hpp"
+
+namespace mboxid {
+
+// Kernels converting between arrays of bools and bits packed least
+// significant bit first. pack_bits() and unpack_bits() dispatch to the best
+// kernel supported by the CPU. The individual kernels are exposed for tests
+// and benchmarks.
+//
+// The pack kernels write bit_to_byte_count(n) bytes and clear the unused bits
+// of the last byte.
+
+using pack_bits_fn = void (*)(
+        const bool* src, std::size_t n, std::uint8_t* dst);
+using unpack_bits_fn = void (*)(
+        const std::uint8_t* src, std::size_t n, bool* dst);
+
+void pack_bits_scalar(const bool* src, std::size_t n, std::uint8_t* dst);
+void unpack_bits_scalar(const std::uint8_t* src, std::size_t n, bool* dst);
+
+#if defined(MBOXID_HAVE_X86_SIMD)
+void pack_bits_sse2(const bool* src, std::size_t n, std::uint8_t* dst);
+void unpack_bits_sse2(const std::uint8_t* src, std::size_t n, bool* dst);
+
+void pack_bits_avx2(const bool* src, std::size_t n, std::uint8_t* dst);
+void unpack_bits_avx2(const std::uint8_t* src, std::size_t n, bool* dst);
+#endif
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_BIT_PACK_HPP
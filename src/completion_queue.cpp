@@ -0,0 +1,76 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include "error_private.hpp"
+#include "completion_queue.hpp"
+
+namespace mboxid {
+
+completion_queue::completion_queue(int fd) {
+    if (auto dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0); dup_fd == -1)
+        throw system_error(errno, "fcntl F_DUPFD_CLOEXEC");
+    else
+        event_fd.reset(dup_fd);
+}
+
+completion_queue::~completion_queue() { close(); }
+
+void completion_queue::open() {
+    consumer.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    is_open.store(true, std::memory_order_release);
+}
+
+void completion_queue::close() {
+    is_open.store(false, std::memory_order_release);
+
+    // Requests posted concurrently may still be pushed. They are dropped by
+    // the next call to close() at the latest, which is the destructor.
+    auto p = head.exchange(nullptr, std::memory_order_acquire);
+    while (p) {
+        auto next = p->next;
+        delete p;
+        p = next;
+    }
+}
+
+void completion_queue::post(entry e) {
+    if (!is_open.load(std::memory_order_acquire))
+        return;
+
+    // Once pushed, the node belongs to the consumer and must not be touched
+    // anymore. Hence, the previous head is tracked in a local variable.
+    auto node = e.release();
+    auto prev = head.load(std::memory_order_relaxed);
+    do {
+        node->next = prev;
+    } while (!head.compare_exchange_weak(prev, node,
+            std::memory_order_release, std::memory_order_relaxed));
+
+    // The consumer collects completions before it waits for events again,
+    // so it doesn't need to be woken up by itself. If the list was not empty,
+    // a wakeup is pending already.
+    if (!prev &&
+            (std::this_thread::get_id() !=
+                    consumer.load(std::memory_order_relaxed)) &&
+            (eventfd_write(event_fd.get(), 1) == -1))
+        throw system_error(errno, "eventfd_write");
+}
+
+void completion_queue::take(std::vector<entry>& entries) {
+    auto p = head.exchange(nullptr, std::memory_order_acquire);
+    auto first = entries.size();
+
+    // The list is in reverse order of completion.
+    while (p) {
+        auto next = p->next;
+        entries.emplace_back(p);
+        p = next;
+    }
+    std::reverse(entries.begin() + static_cast<ptrdiff_t>(first),
+            entries.end());
+}
+
+} // namespace mboxid
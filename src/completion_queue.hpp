@@ -0,0 +1,100 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_COMPLETION_QUEUE_HPP
+#define LIBMBOXID_COMPLETION_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <system_error>
+#include <mboxid/async_backend_connector.hpp>
+#include "modbus_protocol_common.hpp"
+#include "unique_fd.hpp"
+
+namespace mboxid {
+
+class completion_queue;
+struct backend_state;
+
+// A request handed over to an asynchronous backend, together with its
+// response once the request has been completed.
+struct deferred_request::state {
+    std::shared_ptr<completion_queue> queue; // where to report completion
+    client_id client = 0;
+    uint64_t seq = 0; // sequence number of the request within its client
+    // State of the backend, e.g. its response cache. Shared, as a request
+    // held by an asynchronous backend may outlive the server's run loop.
+    std::shared_ptr<backend_state> backend_st;
+    unsigned unit_id = 0;
+
+    uint8_t req[max_pdu_size]; // NOLINT(*-pro-type-member-init)
+    size_t req_size = 0;
+    uint8_t rsp[max_pdu_size]; // NOLINT(*-pro-type-member-init)
+    size_t rsp_size = 0;
+
+    // Set if the request failed without a Modbus exception response.
+    std::error_code error;
+    std::string error_msg;
+
+    // Start and end of the execution of the request. The reactor sets timed
+    // to have them recorded, it is reset if the request fails without being
+    // executed.
+    bool timed = false;
+    std::chrono::steady_clock::time_point exec_begin;
+    std::chrono::steady_clock::time_point exec_end;
+
+    state* next = nullptr; // link in the completion queue
+};
+
+/**
+ * Queue passing completed requests from any thread back to a reactor.
+ *
+ * The queue is a lock-free list with many producers and a single consumer.
+ * Producers push requests with a compare-and-swap onto the head of the list,
+ * the consumer takes the whole list at once and restores the order of
+ * completion. So neither side ever blocks the other.
+ *
+ * The reactor opens the queue while it is running. A producer pushing onto
+ * an empty list wakes the reactor up through an eventfd, unless the producer
+ * is the reactor itself, so a batch of completions costs a single wakeup.
+ * Requests completed while the queue is closed are dropped, as their
+ * connections are gone.
+ *
+ * The queue may outlive its reactor, as long as requests refer to it.
+ * Therefore, it uses its own duplicate of the eventfd.
+ */
+class completion_queue {
+public:
+    using entry = std::unique_ptr<deferred_request::state>;
+
+    explicit completion_queue(int event_fd);
+    completion_queue(const completion_queue&) = delete;
+    completion_queue& operator=(const completion_queue&) = delete;
+    ~completion_queue();
+
+    // Opens the queue. The calling thread becomes the consumer.
+    void open();
+
+    // Closes the queue and drops all queued requests.
+    void close();
+
+    // Queues a completed request (thread-safe).
+    void post(entry e);
+
+    // Appends all queued requests to \a entries in the order of completion.
+    void take(std::vector<entry>& entries);
+
+private:
+    std::atomic<deferred_request::state*> head{nullptr};
+    std::atomic<bool> is_open{false};
+    std::atomic<std::thread::id> consumer;
+    unique_fd event_fd;
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_COMPLETION_QUEUE_HPP
@@ -0,0 +1,31 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_CPU_FEATURES_HPP
+#define LIBMBOXID_CPU_FEATURES_HPP
+
+namespace mboxid {
+
+// SIMD kernels for x86-64 are compiled with function specific target
+// attributes, and selected at runtime according to the features of the CPU.
+// SSE2 is part of the x86-64 baseline.
+#if defined(__x86_64__)
+#define MBOXID_HAVE_X86_SIMD
+
+inline bool cpu_has_ssse3() { return __builtin_cpu_supports("ssse3"); }
+
+inline bool cpu_has_avx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+// Hint to the CPU that the caller is spinning in a wait loop.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_CPU_FEATURES_HPP
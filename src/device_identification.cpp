@@ -0,0 +1,130 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <cstring>
+#include "byteorder.hpp"
+#include "error_private.hpp"
+#include "device_identification.hpp"
+
+namespace mboxid {
+
+// fc, MEI type, read device id code, conformity level, more follows, next
+// object id and number of objects
+constexpr size_t rsp_header_size{7};
+constexpr size_t max_object_size{max_pdu_size - rsp_header_size - 2};
+constexpr unsigned first_extended_id{0x80};
+
+device_identification_objects::device_identification_objects(
+        const device_identification& id) {
+    std::fill(std::begin(offs), std::end(offs), no_object);
+
+    auto add = [&](unsigned oid, const std::string& val) {
+        validate_argument(val.size() <= max_object_size,
+                "device identification object too long");
+        offs[oid] = static_cast<uint16_t>(objects.size());
+        objects.push_back(static_cast<uint8_t>(oid));
+        objects.push_back(static_cast<uint8_t>(val.size()));
+        objects.insert(objects.end(), val.begin(), val.end());
+    };
+
+    add(0x00, id.vendor_name);
+    add(0x01, id.product_code);
+    add(0x02, id.major_minor_revision);
+
+    const std::string* regular[] = {&id.vendor_url, &id.product_name,
+            &id.model_name, &id.user_application_name};
+    for (unsigned i = 0; i < std::size(regular); ++i) {
+        if (!regular[i]->empty()) {
+            add(0x03 + i, *regular[i]);
+            conformity_level = read_device_id_code::regular;
+        }
+    }
+
+    for (const auto& [oid, val] : id.extended) {
+        validate_argument(oid >= first_extended_id,
+                "device identification extended object id");
+        add(oid, val);
+        conformity_level = read_device_id_code::extended;
+    }
+}
+
+size_t device_identification_objects::serialize_response(
+        std::span<uint8_t> dst, read_device_id_code code, unsigned id) const {
+    unsigned last_id;
+    switch (code) {
+    case read_device_id_code::basic:
+        last_id = 0x02;
+        break;
+    case read_device_id_code::regular:
+        last_id = first_extended_id - 1;
+        break;
+    default:
+        last_id = n_ids - 1;
+        break;
+    }
+
+    // The vendor name, object 0, always exists.
+    if ((id > last_id) || (offs[id] == no_object))
+        id = 0;
+
+    expects(dst.size() >= rsp_header_size + 2 + max_object_size,
+            "buffer too small");
+
+    // The objects of the response form a contiguous run, as they are stored
+    // in the order of their ids.
+    auto room = std::min(dst.size(), max_pdu_size) - rsp_header_size;
+    size_t size = 0;
+    unsigned n_objects = 0;
+    unsigned next_id = 0;
+
+    for (unsigned oid = id; oid <= last_id; ++oid) {
+        if (offs[oid] == no_object)
+            continue;
+        auto object_size = 2 + size_t{objects[offs[oid] + 1]};
+        if (size + object_size > room) {
+            next_id = oid;
+            break;
+        }
+        size += object_size;
+        ++n_objects;
+    }
+
+    auto p = dst.data();
+    p += store8(p, function_code::read_device_identification);
+    p += store8(p, mei_type::modbus);
+    p += store8(p, code);
+    p += store8(p, conformity_level);
+    p += store8(p, next_id ? 0xff : 0x00); // more follows
+    p += store8(p, next_id);
+    p += store8(p, n_objects);
+    std::memcpy(p, objects.data() + offs[id], size);
+    p += size;
+
+    return p - dst.data();
+}
+
+std::shared_ptr<const device_identification_objects>
+device_identification_cache::get(backend_connector& backend, errc& res) {
+    auto rev = backend.device_identification_revision();
+    res = errc::none;
+
+    auto snap = current.load(std::memory_order_acquire);
+    if (!snap || (snap->revision != rev)) {
+        // Concurrent requests may refresh the snapshot at the same time,
+        // which is harmless, as it happens only once per revision.
+        device_identification id;
+        res = backend.get_device_identification(id);
+        if (res != errc::none)
+            return nullptr;
+
+        snap = std::make_shared<const snapshot>(rev, id);
+        current.store(snap, std::memory_order_release);
+    }
+
+    // The returned pointer shares the ownership of the snapshot.
+    const auto* objects = &snap->objects;
+    return {std::move(snap), objects};
+}
+
+} // namespace mboxid
@@ -0,0 +1,87 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_DEVICE_IDENTIFICATION_HPP
+#define LIBMBOXID_DEVICE_IDENTIFICATION_HPP
+
+#include <atomic>
+#include <memory>
+#include <span>
+#include <vector>
+#include <mboxid/backend_connector.hpp>
+#include "modbus_protocol_common.hpp"
+
+namespace mboxid {
+
+/**
+ * Serialized device identification objects of a backend.
+ *
+ * The objects are serialized in the order of their ids, each with its id and
+ * length, as they appear in a response. A response to a stream access is
+ * thereby a header followed by a copy of a contiguous run of objects.
+ */
+class device_identification_objects {
+public:
+    /*
+     * Serializes the objects. Empty regular objects are skipped.
+     *
+     * Throws mboxid_error(errc::invalid_argument) if an object is too long to
+     * fit into a response or the id of an extended object is out of range.
+     */
+    explicit device_identification_objects(const device_identification& id);
+
+    /*
+     * Serializes the response to a stream access of the category \a code,
+     * starting at the object \a id, and returns its size. Objects not
+     * fitting into the response are left for a further request, announced
+     * by "more follows". If the object does not exist or is not part of the
+     * category, the response starts at object 0, as required by the Modbus
+     * application protocol.
+     */
+    size_t serialize_response(std::span<uint8_t> dst, read_device_id_code code,
+            unsigned id) const;
+
+private:
+    static constexpr size_t n_ids{256};
+    static constexpr uint16_t no_object{0xffff};
+
+    std::vector<uint8_t> objects;
+    uint16_t offs[n_ids + 1]; // offset of the object, or no_object
+    read_device_id_code conformity_level = read_device_id_code::basic;
+};
+
+/**
+ * Precomputed device identification of a backend, shared by all threads
+ * serving the backend.
+ *
+ * The objects are read from the backend and serialized when they are needed
+ * first, and again whenever the revision reported by the backend changes.
+ *
+ * The objects of a revision form an immutable snapshot, which is published
+ * by an atomic shared pointer. So requests never take a lock, they merely
+ * load the current snapshot and compare its revision.
+ */
+class device_identification_cache {
+public:
+    /*
+     * Returns the objects of \a backend. If the backend reports an error, it
+     * is returned in \a res together with a null pointer.
+     */
+    std::shared_ptr<const device_identification_objects> get(
+            backend_connector& backend, errc& res);
+
+private:
+    struct snapshot {
+        snapshot(uint64_t revision, const device_identification& id)
+                : revision(revision), objects(id) {}
+
+        const uint64_t revision;
+        const device_identification_objects objects;
+    };
+
+    std::atomic<std::shared_ptr<const snapshot>> current;
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_DEVICE_IDENTIFICATION_HPP
@@ -0,0 +1,271 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/socket.h>
+#include "error_private.hpp"
+#include "logger_private.hpp"
+#include "epoll_engine.hpp"
+
+namespace mboxid {
+
+// Maximum number of events retrieved by a single call to epoll_wait().
+constexpr int max_ready_events{64};
+
+// Maximum number of connections accepted per listening socket and loop
+// iteration. The interest list is level-triggered, hence connections left
+// in the queue are reported again in the next iteration. The limit keeps
+// established connections responsive while many clients connect at once.
+constexpr int accept_budget{32};
+
+// The token attached to an epoll event identifies the event source (bits
+// 62..63) and a reference to the object the event refers to (bits 0..61).
+// The reference is either a file descriptor or a client id. The latter fits
+// as the upper two bits of keys handed out by the slot_map are always zero.
+constexpr unsigned event_token_ref_bits = 62;
+constexpr uint64_t event_token_ref_mask =
+        (uint64_t{1} << event_token_ref_bits) - 1;
+
+static uint64_t make_event_token(auto src, uint64_t ref) {
+    return static_cast<uint64_t>(src) << event_token_ref_bits |
+            (ref & event_token_ref_mask);
+}
+
+static auto event_token_source(uint64_t token) {
+    return token >> event_token_ref_bits;
+}
+
+static uint64_t event_token_ref(uint64_t token) {
+    return token & event_token_ref_mask;
+}
+
+epoll_engine::epoll_engine(io_handler& handler)
+        : handler(handler), ready_events(max_ready_events) {
+    if (auto fd = epoll_create1(EPOLL_CLOEXEC); fd == -1)
+        throw system_error(errno, "epoll_create1");
+    else
+        epoll_fd.reset(fd);
+}
+
+void epoll_engine::watch(
+        int fd, event_source src, uint64_t ref, uint32_t events) {
+    struct epoll_event ev = {.events = events, .data = {}};
+    ev.data.u64 = make_event_token(src, ref);
+
+    if (epoll_ctl(epoll_fd.get(), EPOLL_CTL_ADD, fd, &ev) == -1)
+        throw system_error(errno, "epoll_ctl EPOLL_CTL_ADD");
+}
+
+void epoll_engine::add_wakeup_fd(int fd) {
+    watch(fd, event_source::wakeup, fd, EPOLLIN);
+}
+
+void epoll_engine::add_listener(int fd) {
+    watch(fd, event_source::listener, fd, EPOLLIN);
+}
+
+void epoll_engine::add_connection(io_connection& conn) {
+    conn.engine_state = EPOLLIN;
+    watch(conn.fd.get(), event_source::client, conn.id, conn.engine_state);
+}
+
+void epoll_engine::remove_connection(io_connection&) {
+    // Closing the file descriptor removes it from the interest list.
+}
+
+// The engine state holds the events the connection is registered for.
+void epoll_engine::update_interest(io_connection& conn) {
+    uint32_t events = 0;
+    if (!conn.rx_paused)
+        events |= EPOLLIN;
+    if (!conn.tx.empty())
+        events |= EPOLLOUT;
+
+    if (events == conn.engine_state)
+        return;
+
+    struct epoll_event ev = {.events = events, .data = {}};
+    ev.data.u64 = make_event_token(event_source::client, conn.id);
+
+    if (epoll_ctl(epoll_fd.get(), EPOLL_CTL_MOD, conn.fd.get(), &ev) == -1)
+        throw system_error(errno, "epoll_ctl EPOLL_CTL_MOD");
+    conn.engine_state = events;
+}
+
+void epoll_engine::pause_receive(io_connection& conn) {
+    conn.rx_paused = true;
+    update_interest(conn);
+}
+
+void epoll_engine::resume_receive(io_connection& conn) {
+    conn.rx_paused = false;
+    update_interest(conn);
+}
+
+bool epoll_engine::send(io_connection& conn, std::span<const uint8_t> data) {
+    conn.tx = data;
+
+    // Most responses fit into the socket buffer, so we try to send them
+    // right away instead of waiting for EPOLLOUT first. If that fails for
+    // whatever reason, we wait for the socket to become writable and
+    // report the failure from there.
+    auto cnt = TEMP_FAILURE_RETRY(::send(conn.fd.get(), conn.tx.data(),
+            conn.tx.size(), MSG_NOSIGNAL | MSG_DONTWAIT));
+    if (cnt > 0)
+        conn.tx = conn.tx.subspan(cnt);
+
+    update_interest(conn);
+    return conn.tx.empty();
+}
+
+void epoll_engine::wait(int timeout) {
+    auto res = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd.get(),
+            ready_events.data(), static_cast<int>(ready_events.size()),
+            timeout));
+    if (res == -1)
+        throw system_error(errno, "epoll_wait");
+    n_ready_events = res;
+}
+
+void epoll_engine::dispatch() {
+    for (int i = 0; i < n_ready_events; ++i)
+        dispatch_event(ready_events[i]);
+    n_ready_events = 0;
+}
+
+void epoll_engine::dispatch_event(const struct epoll_event& ev) {
+    auto ref = event_token_ref(ev.data.u64);
+
+    switch (static_cast<event_source>(event_token_source(ev.data.u64))) {
+    case event_source::wakeup:
+        handler.on_wakeup();
+        break;
+    case event_source::listener:
+        accept_connections(static_cast<int>(ref));
+        break;
+    case event_source::client: {
+        // The client may have been closed while processing an earlier event
+        // of the same batch. Its id is stale then and the event is dropped.
+        auto conn = handler.find_connection(ref);
+        if (!conn)
+            break;
+        if (ev.events & (EPOLLHUP | EPOLLERR)) {
+            handler.on_closed(*conn);
+            break;
+        }
+        if ((ev.events & EPOLLOUT) && !transmit(*conn))
+            break;
+        if (ev.events & EPOLLIN) {
+            // a callback invoked by transmit() may have closed the client
+            conn = handler.find_connection(ref);
+            if (conn && !conn->rx_paused)
+                receive(*conn);
+        }
+        break;
+    }
+    default:
+        throw mboxid_error(errc::logic_error, "dispatch_event");
+    }
+}
+
+// Accepts pending connections until the queue is empty or the budget is
+// exhausted.
+void epoll_engine::accept_connections(int fd) {
+    for (int i = 0; i < accept_budget; ++i) {
+        struct sockaddr_storage addr; // NOLINT(*-pro-type-member-init)
+        socklen_t addrlen = sizeof(addr);
+        auto sa = reinterpret_cast<struct sockaddr*>(&addr);
+
+        unique_fd conn_fd(TEMP_FAILURE_RETRY(
+                accept4(fd, sa, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC)));
+
+        if (conn_fd.get() == -1) {
+            switch (errno) {
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+                [[falltrough]];
+#endif
+            case EAGAIN:
+                return;
+            case ECONNABORTED:
+                [[fallthrough]];
+            case ETIMEDOUT:
+                log::error("accept aborted prematurely: {}",
+                        std::error_code(errno, std::system_category())
+                                .message());
+                continue;
+            default:
+                throw system_error(errno, "accept4");
+            }
+        }
+
+        handler.on_accept(std::move(conn_fd), sa, addrlen);
+    }
+}
+
+void epoll_engine::receive(io_connection& conn) {
+    auto buf = handler.receive_buffer(conn);
+    if (buf.empty())
+        return;
+
+    auto cnt = TEMP_FAILURE_RETRY(read(conn.fd.get(), buf.data(), buf.size()));
+    if (cnt < 0) {
+        switch (errno) {
+#if EAGAIN != EWOULDBLOCK
+        case EWOULDBLOCK:
+            [[falltrough]];
+#endif
+        case EAGAIN:
+            return;
+        case ECONNRESET:
+            [[fallthrough]];
+        case ETIMEDOUT:
+            handler.on_closed(conn);
+            return;
+        default:
+            throw system_error(errno, "read");
+        }
+    } else if (cnt == 0) {
+        handler.on_closed(conn);
+        return;
+    }
+
+    handler.on_received(conn, cnt);
+}
+
+// Returns true if the connection is still open.
+bool epoll_engine::transmit(io_connection& conn) {
+    if (conn.tx.empty())
+        return true;
+
+    auto cnt = TEMP_FAILURE_RETRY(::send(
+            conn.fd.get(), conn.tx.data(), conn.tx.size(), MSG_NOSIGNAL));
+
+    if (cnt == -1) {
+        switch (errno) {
+#if EAGAIN != EWOULDBLOCK
+        case EWOULDBLOCK:
+            [[falltrough]];
+#endif
+        case EAGAIN:
+            return true;
+        case ECONNRESET:
+            [[fallthrough]];
+        case EPIPE:
+            handler.on_closed(conn);
+            return false;
+        default:
+            throw system_error(errno, "send()");
+        }
+    }
+
+    conn.tx = conn.tx.subspan(cnt);
+    if (!conn.tx.empty())
+        return true;
+
+    auto id = conn.id;
+    update_interest(conn);
+    handler.on_sent(conn);
+    return handler.find_connection(id) != nullptr;
+}
+
+} // namespace mboxid
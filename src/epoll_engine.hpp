@@ -0,0 +1,55 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_EPOLL_ENGINE_HPP
+#define LIBMBOXID_EPOLL_ENGINE_HPP
+
+#include <vector>
+#include <sys/epoll.h>
+#include "io_engine.hpp"
+
+namespace mboxid {
+
+/**
+ * I/O engine based on readiness notification by epoll.
+ *
+ * The interest list is level-triggered. Data is received and sent by
+ * ordinary read() and send() calls once the socket is ready.
+ */
+class epoll_engine : public io_engine {
+public:
+    explicit epoll_engine(io_handler& handler);
+
+    void add_wakeup_fd(int fd) override;
+    void add_listener(int fd) override;
+    void add_connection(io_connection& conn) override;
+    void remove_connection(io_connection& conn) override;
+    void pause_receive(io_connection& conn) override;
+    void resume_receive(io_connection& conn) override;
+    bool send(io_connection& conn, std::span<const uint8_t> data) override;
+    void wait(int timeout) override;
+    void dispatch() override;
+    const char* name() const override { return "epoll"; }
+
+private:
+    // Sources of events reported by epoll. The source is stored together
+    // with the file descriptor, or the client id respectively, in the user
+    // data of the epoll event.
+    enum class event_source : uint64_t { wakeup, listener, client };
+
+    io_handler& handler;
+    unique_fd epoll_fd;
+    std::vector<struct epoll_event> ready_events;
+    int n_ready_events = 0;
+
+    void watch(int fd, event_source src, uint64_t ref, uint32_t events);
+    void update_interest(io_connection& conn);
+    void dispatch_event(const struct epoll_event& ev);
+    void accept_connections(int fd);
+    void receive(io_connection& conn);
+    bool transmit(io_connection& conn);
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_EPOLL_ENGINE_HPP
@@ -0,0 +1,57 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstring>
+#include "error_private.hpp"
+#include "frame_buffer.hpp"
+
+namespace mboxid {
+
+// The buffer must hold at least one complete ADU after compaction, see
+// space().
+static_assert(frame_buffer::capacity >= 2 * max_adu_size);
+
+std::span<uint8_t> frame_buffer::space() {
+    // The data at head starts an ADU. If the remaining space might not
+    // suffice to complete it, the data is moved to the front. If the data
+    // occupies more than capacity - max_adu_size bytes, it contains a
+    // complete ADU, and the caller has to consume it first.
+    if ((capacity - tail < max_adu_size) && head) {
+        std::memmove(buf, buf + head, size());
+        tail -= head;
+        head = 0;
+    }
+    return {buf + tail, capacity - tail};
+}
+
+void frame_buffer::commit(size_t cnt) {
+    expects(cnt <= capacity - tail, "commit exceeds buffer");
+    tail += cnt;
+}
+
+std::span<const uint8_t> frame_buffer::next_frame(mbap_header& header) {
+    std::span data(buf + head, size());
+
+    if (!header_parsed) {
+        if (data.size() < mbap_header_size)
+            return {};
+        err = parse_mbap_header(data, frame_header, err_msg);
+        if (err != errc::none)
+            return {};
+        header_parsed = true;
+    }
+
+    auto adu_size = get_adu_size(frame_header);
+    if (data.size() < adu_size)
+        return {};
+
+    header = frame_header;
+    header_parsed = false;
+    head += adu_size;
+    if (head == tail)
+        head = tail = 0;
+
+    return data.subspan(0, adu_size);
+}
+
+} // namespace mboxid
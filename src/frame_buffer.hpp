@@ -0,0 +1,83 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_FRAME_BUFFER_HPP
+#define LIBMBOXID_FRAME_BUFFER_HPP
+
+#include <cstdint>
+#include <span>
+#include <mboxid/error.hpp>
+#include "modbus_protocol_common.hpp"
+
+namespace mboxid {
+
+/**
+ * Receive buffer of a connection, which splits the byte stream into ADUs.
+ *
+ * Received data is stored in the space returned by space() and committed with
+ * commit(). As much data as fits may be received at once, so a single read
+ * can fetch several ADUs. next_frame() then extracts one complete ADU after
+ * the other. The ADUs are not copied, they are returned in place.
+ *
+ * Framing is resumable: the MBAP header of an incomplete ADU is parsed once,
+ * no matter in how many pieces the ADU arrives.
+ *
+ * The buffer is used linearly. Consumed data is reclaimed when the buffer
+ * runs empty, which is the common case, or when the free space at the end
+ * becomes too small for an ADU. Then the unconsumed data is moved to the
+ * front. Thereby, every ADU is stored contiguously.
+ */
+class frame_buffer {
+public:
+    static constexpr size_t capacity = 4 * max_adu_size;
+
+    frame_buffer() = default;
+    frame_buffer(const frame_buffer&) = delete;
+    frame_buffer& operator=(const frame_buffer&) = delete;
+
+    //! Free space for received data. Empty if the buffer is full.
+    std::span<uint8_t> space();
+
+    //! Marks \a cnt bytes stored in the space returned by space() as valid.
+    void commit(size_t cnt);
+
+    /**
+     * Returns the next complete ADU, or an empty span if there is none.
+     *
+     * The header of the ADU is stored in \a header. The ADU is consumed, but
+     * its data remains valid until space() is called.
+     *
+     * An empty span is also returned if the MBAP header is invalid. Then,
+     * error() returns errc::parse_error, and the buffer must not be used any
+     * further.
+     */
+    std::span<const uint8_t> next_frame(mbap_header& header);
+
+    //! Error which made next_frame() fail, errc::none if there is none.
+    [[nodiscard]] errc error() const { return err; }
+
+    //! Description of the error returned by error().
+    [[nodiscard]] const char* error_message() const { return err_msg; }
+
+    //! Number of bytes received but not consumed yet.
+    [[nodiscard]] size_t size() const { return tail - head; }
+
+    [[nodiscard]] bool empty() const { return head == tail; }
+    [[nodiscard]] bool full() const { return size() == capacity; }
+
+private:
+    uint8_t buf[capacity]; // NOLINT(*-pro-type-member-init)
+    size_t head = 0;       // start of unconsumed data
+    size_t tail = 0;       // end of unconsumed data
+
+    // Framing state of the ADU at head.
+    bool header_parsed = false;
+    mbap_header frame_header = {};
+
+    errc err = errc::none;
+    const char* err_msg = "";
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_FRAME_BUFFER_HPP
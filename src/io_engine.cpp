@@ -0,0 +1,32 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "logger_private.hpp"
+#include "epoll_engine.hpp"
+#ifdef MBOXID_HAVE_IO_URING
+#include "uring_engine.hpp"
+#endif
+#include "io_engine.hpp"
+
+namespace mboxid {
+
+std::unique_ptr<io_engine> make_io_engine(
+        modbus_tcp_server::transport type, io_handler& handler) {
+    if (type == modbus_tcp_server::transport::io_uring) {
+#ifdef MBOXID_HAVE_IO_URING
+        try {
+            return std::make_unique<uring_engine>(handler);
+        } catch (const system_error& e) {
+            log::warning("io_uring not available, falling back to epoll: {}",
+                    e.what());
+        }
+#else
+        log::warning("io_uring not supported by this build, falling back to "
+                     "epoll");
+#endif
+    }
+
+    return std::make_unique<epoll_engine>(handler);
+}
+
+} // namespace mboxid
@@ -0,0 +1,119 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_IO_ENGINE_HPP
+#define LIBMBOXID_IO_ENGINE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include <sys/socket.h>
+#include <mboxid/modbus_tcp_server.hpp>
+#include "unique_fd.hpp"
+
+namespace mboxid {
+
+/**
+ * Connection state shared by a reactor and its I/O engine.
+ *
+ * The reactor embeds the structure in its client control block. Apart from
+ * the id and the file descriptor, the members are maintained by the engine.
+ */
+struct io_connection {
+    backend_connector::client_id id = 0;
+    unique_fd fd;
+
+    std::vector<uint8_t> tx_sending; // data passed to io_engine::send()
+    std::span<const uint8_t> tx;     // data not yet passed to the kernel
+    bool rx_paused = false;          // reactor does not accept data
+    uint32_t engine_state = 0;       // private to the engine
+    std::vector<uint8_t> rx_backlog; // data received while paused
+};
+
+/**
+ * Receiver of the events reported by an I/O engine.
+ *
+ * A callback may close any connection, including the one it is invoked for.
+ * Therefore, the engine never refers to a connection after a callback
+ * without looking it up by its id again.
+ */
+class io_handler {
+public:
+    using client_id = backend_connector::client_id;
+
+    // The wakeup file descriptor became readable.
+    virtual void on_wakeup() = 0;
+
+    // A connection has been accepted.
+    virtual void on_accept(
+            unique_fd fd, const sockaddr* addr, socklen_t addrlen) = 0;
+
+    // Returns the connection with the given id, or nullptr if it is gone.
+    virtual io_connection* find_connection(client_id id) = 0;
+
+    // Returns the space where the next received data shall be stored.
+    virtual std::span<uint8_t> receive_buffer(io_connection& conn) = 0;
+
+    // cnt bytes have been stored in the space returned by receive_buffer().
+    virtual void on_received(io_connection& conn, size_t cnt) = 0;
+
+    // All data passed with io_engine::send() has been sent.
+    virtual void on_sent(io_connection& conn) = 0;
+
+    // The peer closed the connection or the connection failed.
+    virtual void on_closed(io_connection& conn) = 0;
+
+protected:
+    ~io_handler() = default;
+};
+
+/**
+ * Interface of the mechanisms performing the network I/O of a reactor.
+ *
+ * The methods called by the reactor never invoke a callback of the handler.
+ * Callbacks are only invoked from within dispatch().
+ */
+class io_engine {
+public:
+    virtual ~io_engine() = default;
+
+    // Monitors a file descriptor used to wake up the reactor.
+    virtual void add_wakeup_fd(int fd) = 0;
+
+    virtual void add_listener(int fd) = 0;
+
+    // Starts monitoring the connection. Receiving is enabled.
+    virtual void add_connection(io_connection& conn) = 0;
+
+    // Stops monitoring the connection. Must be called before the connection
+    // is closed. An engine which may still access the data being sent after
+    // the call takes over tx_sending.
+    virtual void remove_connection(io_connection& conn) = 0;
+
+    virtual void pause_receive(io_connection& conn) = 0;
+    virtual void resume_receive(io_connection& conn) = 0;
+
+    // Sends data, which must be stored in conn.tx_sending and remain valid
+    // until the transfer has completed. Returns true if all data has been
+    // sent immediately, otherwise completion is reported by
+    // io_handler::on_sent().
+    virtual bool send(io_connection& conn, std::span<const uint8_t> data) = 0;
+
+    // Waits up to timeout milliseconds (-1 for infinity) for events.
+    virtual void wait(int timeout) = 0;
+
+    // Dispatches the events collected by wait() to the handler.
+    virtual void dispatch() = 0;
+
+    virtual const char* name() const = 0;
+};
+
+// Creates an engine of the requested type. If io_uring is requested but not
+// supported by the system, the function falls back to epoll.
+std::unique_ptr<io_engine> make_io_engine(
+        modbus_tcp_server::transport type, io_handler& handler);
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_IO_ENGINE_HPP
@@ -0,0 +1,57 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <bit>
+#include <exception>
+#include "log_ring.hpp"
+
+namespace mboxid::log {
+
+log_ring::log_ring(size_t capacity)
+        : mask(std::bit_ceil(std::max(capacity, size_t{2})) - 1),
+          records(std::make_unique<record[]>(mask + 1)) {
+    for (size_t i = 0; i <= mask; ++i)
+        records[i].seq.store(i, std::memory_order_relaxed);
+}
+
+log_ring::~log_ring() = default;
+
+bool log_ring::pop(level& lvl, std::string& msg) {
+    auto pos = head.load(std::memory_order_relaxed);
+    auto& r = records[pos & mask];
+    if (r.seq.load(std::memory_order_acquire) != pos + 1)
+        return false;
+
+    lvl = r.lvl;
+    msg.clear();
+    try {
+        r.format(r, msg);
+    } catch (const std::exception& e) {
+        msg = "invalid log message: ";
+        msg += e.what();
+    }
+
+    r.seq.store(pos + mask + 1, std::memory_order_release);
+    head.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void log_ring::wait() {
+    auto n = wakeups.load(std::memory_order_relaxed);
+    sleeping.store(true, std::memory_order_relaxed);
+
+    // Pairs with the fence in push().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto pos = head.load(std::memory_order_relaxed);
+    if (records[pos & mask].seq.load(std::memory_order_relaxed) != pos + 1)
+        wakeups.wait(n, std::memory_order_relaxed);
+
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void log_ring::wake() {
+    wakeups.fetch_add(1, std::memory_order_relaxed);
+    wakeups.notify_one();
+}
+
+} // namespace mboxid::log
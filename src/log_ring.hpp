@@ -0,0 +1,179 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_LOG_RING_HPP
+#define LIBMBOXID_LOG_RING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <fmt/core.h>
+#include <mboxid/logger.hpp>
+
+namespace mboxid::log {
+
+/**
+ * Bounded queue of log messages, with many producers and a single consumer.
+ *
+ * A producer does not format its message. It captures the format string and
+ * the arguments by value in a record of the ring, and the consumer formats
+ * the message later on. Strings are copied into the record, truncated to the
+ * space left. All other arguments must be trivially copyable. The format
+ * string itself is referenced, so it must be a string literal.
+ *
+ * Producers claim records with a compare-and-swap on the tail and publish
+ * them through the sequence number of the record, as in Dmitry Vyukov's
+ * bounded queue. If the ring is full, the message is dropped and counted,
+ * so producers never block.
+ *
+ * The consumer sleeps while the ring is empty. A producer wakes it up only
+ * if it sleeps, so logging normally costs no system call.
+ */
+class log_ring {
+public:
+    explicit log_ring(size_t capacity);
+    log_ring(const log_ring&) = delete;
+    log_ring& operator=(const log_ring&) = delete;
+    ~log_ring();
+
+    // Queues a message. Returns false if the ring is full.
+    template <typename... Args>
+    bool push(level lvl, std::string_view fmt, const Args&... args);
+
+    // Consumer: Formats the oldest message into \a msg. Returns false if the
+    // ring is empty.
+    bool pop(level& lvl, std::string& msg);
+
+    // Consumer: Waits until the ring is not empty or wake() is invoked.
+    void wait();
+
+    // Wakes up the consumer.
+    void wake();
+
+    // Number of messages queued so far.
+    uint64_t pushed() const { return tail.load(std::memory_order_acquire); }
+
+    // Number of messages consumed so far.
+    uint64_t popped() const { return head.load(std::memory_order_acquire); }
+
+    // Number of messages dropped as the ring was full.
+    uint64_t dropped() const { return drops.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t record_size{384};
+    static constexpr size_t args_size{96};
+
+    struct alignas(64) record {
+        std::atomic<uint64_t> seq;
+        level lvl = level::debug;
+        std::string_view fmt;
+        void (*format)(const record& r, std::string& msg) = nullptr;
+        alignas(std::max_align_t) unsigned char args[args_size];
+        char text[record_size - args_size - 48];
+    };
+    static_assert(sizeof(record) == record_size);
+
+    // Space for the strings of a message.
+    class text_space {
+    public:
+        explicit text_space(record& r) : p(r.text), room(sizeof(r.text)) {}
+
+        std::string_view copy(std::string_view s) {
+            auto n = std::min(s.size(), room);
+            std::memcpy(p, s.data(), n);
+            std::string_view res(p, n);
+            p += n;
+            room -= n;
+            return res;
+        }
+
+    private:
+        char* p;
+        size_t room;
+    };
+
+    template <typename T> static auto capture(const T& val, text_space& text) {
+        if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            return text.copy(std::string_view(val));
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>,
+                    "log argument must be a string or trivially copyable");
+            return val;
+        }
+    }
+
+    template <typename Tuple>
+    static void format_args(const record& r, std::string& msg) {
+        const auto& args =
+                *std::launder(reinterpret_cast<const Tuple*>(r.args));
+        std::apply(
+                [&](const auto&... a) {
+                    fmt::vformat_to(std::back_inserter(msg), r.fmt,
+                            fmt::make_format_args(a...));
+                },
+                args);
+    }
+
+    const size_t mask;
+    std::unique_ptr<record[]> records;
+
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> drops{0};
+    alignas(64) std::atomic<uint64_t> head{0};
+
+    std::atomic<bool> sleeping{false};
+    std::atomic<uint32_t> wakeups{0};
+};
+
+template <typename... Args>
+bool log_ring::push(level lvl, std::string_view fmt, const Args&... args) {
+    using tuple = std::tuple<decltype(capture(
+            std::declval<const Args&>(), std::declval<text_space&>()))...>;
+    static_assert(sizeof(tuple) <= args_size, "too many log arguments");
+    static_assert(std::is_trivially_destructible_v<tuple>);
+
+    auto pos = tail.load(std::memory_order_relaxed);
+    record* r;
+    for (;;) {
+        r = &records[pos & mask];
+        auto seq = r->seq.load(std::memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            drops.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    text_space text(*r);
+    r->lvl = lvl;
+    r->fmt = fmt;
+    r->format = format_args<tuple>;
+    new (r->args) tuple{capture(args, text)...};
+    r->seq.store(pos + 1, std::memory_order_release);
+
+    // Pairs with the fence in wait(): either the consumer sees the record,
+    // or we see that it sleeps.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+        wake();
+    return true;
+}
+
+} // namespace mboxid::log
+
+#endif // LIBMBOXID_LOG_RING_HPP
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
 #include <iostream>
+#include <thread>
 #include "error_private.hpp"
 #include "logger_private.hpp"
 
@@ -35,13 +36,142 @@ public:
 };
 
 logger_unique_ptr logger = std::make_unique<standard_logger>();
+std::atomic<level> threshold{level::debug};
+log_ring* ring = nullptr;
 
 logger_unique_ptr make_standard_logger() {
     return std::make_unique<standard_logger>();
 }
 
+void set_level(level lvl) { threshold.store(lvl, std::memory_order_relaxed); }
+
+level get_level() { return threshold.load(std::memory_order_relaxed); }
+
+class async_logger::impl {
+public:
+    impl(logger_unique_ptr sink_, size_t capacity)
+            : sink(std::move(sink_)), messages(capacity) {
+        validate_argument(sink.get(), "async_logger");
+        consumer = std::thread(&impl::run, this);
+    }
+
+    impl(const impl&) = delete;
+    impl& operator=(const impl&) = delete;
+
+    ~impl() {
+        stopped.store(true, std::memory_order_release);
+        messages.wake();
+        consumer.join();
+    }
+
+    void flush() {
+        auto cnt = messages.pushed();
+        messages.wake();
+        for (auto n = popped.load(std::memory_order_acquire); n < cnt;
+                n = popped.load(std::memory_order_acquire))
+            popped.wait(n, std::memory_order_acquire);
+    }
+
+    logger_unique_ptr sink;
+    log_ring messages;
+
+private:
+    std::thread consumer;
+    std::atomic<bool> stopped{false};
+    std::atomic<uint64_t> popped{0};
+
+    void run() {
+        std::string msg;
+        uint64_t reported_drops = 0;
+
+        for (;;) {
+            // The stop request is read first, so that the messages queued
+            // before it are written.
+            auto stop = stopped.load(std::memory_order_acquire);
+
+            level lvl;
+            while (messages.pop(lvl, msg))
+                write(lvl, msg);
+
+            if (auto drops = messages.dropped(); drops != reported_drops) {
+                write(level::warning,
+                        fmt::format("{} log message(s) dropped",
+                                drops - reported_drops));
+                reported_drops = drops;
+            }
+
+            popped.store(messages.popped(), std::memory_order_release);
+            popped.notify_all();
+
+            if (stop)
+                break;
+            messages.wait();
+        }
+    }
+
+    void write(level lvl, std::string_view msg) {
+        // A failing sink must not terminate the thread.
+        try {
+            switch (lvl) {
+            case level::debug:
+                sink->debug(msg);
+                break;
+            case level::info:
+                sink->info(msg);
+                break;
+            case level::auth:
+                sink->auth(msg);
+                break;
+            case level::warning:
+                sink->warning(msg);
+                break;
+            default:
+                sink->error(msg);
+                break;
+            }
+        } catch (...) {
+            // nothing we can do about it
+        }
+    }
+};
+
+async_logger::async_logger(logger_unique_ptr sink, std::size_t capacity)
+        : pimpl(std::make_unique<impl>(std::move(sink), capacity)) {}
+
+async_logger::~async_logger() = default;
+
+void async_logger::debug(std::string_view msg) const {
+    pimpl->messages.push(level::debug, "{}", msg);
+}
+
+void async_logger::info(std::string_view msg) const {
+    pimpl->messages.push(level::info, "{}", msg);
+}
+
+void async_logger::warning(std::string_view msg) const {
+    pimpl->messages.push(level::warning, "{}", msg);
+}
+
+void async_logger::error(std::string_view msg) const {
+    pimpl->messages.push(level::error, "{}", msg);
+}
+
+void async_logger::auth(std::string_view msg) const {
+    pimpl->messages.push(level::auth, "{}", msg);
+}
+
+void async_logger::flush() const { pimpl->flush(); }
+
+std::uint64_t async_logger::dropped() const noexcept {
+    return pimpl->messages.dropped();
+}
+
 void install_logger(logger_unique_ptr new_logger) {
     validate_argument(new_logger.get(), "install_logger");
+
+    // The ring is detached before the previous logger is destroyed.
+    auto async = dynamic_cast<const async_logger*>(new_logger.get());
+    ring = async ? &async->pimpl->messages : nullptr;
     logger = std::move(new_logger);
 }
 
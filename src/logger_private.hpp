@@ -4,32 +4,76 @@
 #ifndef LIBMBOXID_LOGGER_PRIVATE_HPP
 #define LIBMBOXID_LOGGER_PRIVATE_HPP
 
+#include <atomic>
 #include <memory>
 #include <fmt/core.h>
 #include <mboxid/logger.hpp>
+#include "log_ring.hpp"
 
 namespace mboxid::log {
 
 extern logger_unique_ptr logger;
 
+// Minimum level of the messages to be logged.
+extern std::atomic<level> threshold;
+
+// Ring buffer of the installed logger, if it is an async_logger.
+extern log_ring* ring;
+
+static inline bool enabled(level lvl) {
+    return lvl >= threshold.load(std::memory_order_relaxed);
+}
+
+// The format string must be a string literal, as the async_logger formats
+// the message after the function has returned.
+template <typename... Args>
+void write_message(level lvl, std::string_view fmt, const Args&... args) {
+    if (!enabled(lvl))
+        return;
+
+    if (ring) {
+        ring->push(lvl, fmt, args...);
+        return;
+    }
+
+    auto msg = fmt::vformat(fmt, fmt::make_format_args(args...));
+    switch (lvl) {
+    case level::debug:
+        logger->debug(msg);
+        break;
+    case level::info:
+        logger->info(msg);
+        break;
+    case level::auth:
+        logger->auth(msg);
+        break;
+    case level::warning:
+        logger->warning(msg);
+        break;
+    default:
+        logger->error(msg);
+        break;
+    }
+}
+
 template <typename... Args> void debug(std::string_view fmt, Args&&... args) {
-    logger->debug(fmt::vformat(fmt, fmt::make_format_args(args...)));
+    write_message(level::debug, fmt, args...);
 }
 
 template <typename... Args> void info(std::string_view fmt, Args&&... args) {
-    logger->info(fmt::vformat(fmt, fmt::make_format_args(args...)));
+    write_message(level::info, fmt, args...);
 }
 
 template <typename... Args> void warning(std::string_view fmt, Args&&... args) {
-    logger->warning(fmt::vformat(fmt, fmt::make_format_args(args...)));
+    write_message(level::warning, fmt, args...);
 }
 
 template <typename... Args> void error(std::string_view fmt, Args&&... args) {
-    logger->error(fmt::vformat(fmt, fmt::make_format_args(args...)));
+    write_message(level::error, fmt, args...);
 }
 
 template <typename... Args> void auth(std::string_view fmt, Args&&... args) {
-    logger->auth(fmt::vformat(fmt, fmt::make_format_args(args...)));
+    write_message(level::auth, fmt, args...);
 }
 
 } // namespace mboxid::log
@@ -0,0 +1,89 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_METRICS_RECORDER_HPP
+#define LIBMBOXID_METRICS_RECORDER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mboxid/server_metrics.hpp>
+
+namespace mboxid {
+
+/*
+ * Counter written by a single thread and read by any thread.
+ *
+ * As there is a single writer, the counter is incremented by a load and a
+ * store instead of an atomic read-modify-write, which costs as much as a
+ * plain increment. Readers may see a slightly stale value.
+ */
+class metrics_counter {
+public:
+    void add(uint64_t n) {
+        val.store(val.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    void increment() { add(1); }
+
+    uint64_t get() const { return val.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> val{0};
+};
+
+/*
+ * Metrics of a reactor, written by its thread only and read by any thread.
+ *
+ * Each reactor has its own recorder, aligned to a cache line, so recording
+ * never contends with other threads. Readers sum the recorders of all
+ * reactors. They do not block the reactors, but a snapshot is not
+ * consistent across counters.
+ */
+class alignas(64) metrics_recorder {
+public:
+    using duration = std::chrono::nanoseconds;
+
+    void request(uint8_t fc) { requests[fc].increment(); }
+    void exception(uint8_t fc) { exceptions[fc].increment(); }
+    void received(size_t cnt) { bytes_received.add(cnt); }
+    void sent(size_t cnt) { bytes_sent.add(cnt); }
+    void accepted() { connections_accepted.increment(); }
+    void denied() { connections_denied.increment(); }
+    void closed() { connections_closed.increment(); }
+    void idle_timeout() { idle_timeouts.increment(); }
+    void request_complete_timeout() { request_complete_timeouts.increment(); }
+
+    void processing(duration d) { record(processing_time, d); }
+    void backend(duration d) { record(backend_time, d); }
+
+    // Adds the metrics recorded so far to \a m.
+    void read(server_metrics& m) const;
+
+private:
+    using histogram =
+            std::array<metrics_counter, latency_histogram::n_buckets>;
+
+    static void record(histogram& h, duration d) {
+        auto ns = d.count() > 0 ? static_cast<uint64_t>(d.count()) : 0;
+        h[latency_histogram::bucket(ns)].increment();
+    }
+
+    std::array<metrics_counter, 256> requests;
+    std::array<metrics_counter, 256> exceptions;
+    metrics_counter bytes_received;
+    metrics_counter bytes_sent;
+    metrics_counter connections_accepted;
+    metrics_counter connections_denied;
+    metrics_counter connections_closed;
+    metrics_counter idle_timeouts;
+    metrics_counter request_complete_timeouts;
+    histogram processing_time;
+    histogram backend_time;
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_METRICS_RECORDER_HPP
@@ -1,13 +1,17 @@
 // Copyright (c) 2024, Franz Hollerer.
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <algorithm>
+#include <mboxid/bit_span.hpp>
 #include "byteorder.hpp"
 #include "error_private.hpp"
 #include "modbus_protocol_common.hpp"
+#include "reg_codec.hpp"
 
 namespace mboxid {
 
-void parse_mbap_header(std::span<const uint8_t> src, mbap_header& header) {
+errc parse_mbap_header(std::span<const uint8_t> src, mbap_header& header,
+        const char*& what) {
     expects(src.size() >= mbap_header_size, "incomplete mbap header");
 
     const uint8_t* p = src.data();
@@ -17,14 +21,24 @@ void parse_mbap_header(std::span<const uint8_t> src, mbap_header& header) {
     p += fetch16_be(header.length, p);
     fetch8(header.unit_id, p);
 
-    if (header.protocol_id != 0)
-        throw mboxid_error(
-                errc::parse_error, "mbap header: protocol identifier invalid");
+    if (header.protocol_id != 0) {
+        what = "mbap header: protocol identifier invalid";
+        return errc::parse_error;
+    }
 
     if ((header.length < (min_pdu_size + sizeof(header.unit_id))) ||
-            header.length > (max_pdu_size + sizeof(header.unit_id)))
-        throw mboxid_error(
-                errc::parse_error, "mbap header: length field invalid");
+            header.length > (max_pdu_size + sizeof(header.unit_id))) {
+        what = "mbap header: length field invalid";
+        return errc::parse_error;
+    }
+
+    return errc::none;
+}
+
+void parse_mbap_header(std::span<const uint8_t> src, mbap_header& header) {
+    const char* what = nullptr;
+    if (auto res = parse_mbap_header(src, header, what); res != errc::none)
+        throw mboxid_error(res, what);
 }
 
 size_t serialize_mbap_header(
@@ -39,41 +53,42 @@ size_t serialize_mbap_header(
     return p - dst.data();
 }
 
+// std::vector<bool> offers no access to its packed storage. Therefore, the
+// bits are converted in chunks through an array of bools by the SIMD kernels.
+// The chunk size is a multiple of 8, so each chunk covers whole bytes.
+constexpr size_t bit_chunk_size{256};
+
 std::size_t parse_bits(std::span<const uint8_t> src, std::vector<bool>& bits,
         std::size_t cnt) {
     auto byte_count = bit_to_byte_count(cnt);
 
     expects(src.size() >= byte_count, "too few bytes");
 
-    bits.resize(cnt);
+    bits.clear();
+    bits.reserve(cnt);
 
-    for (size_t i = 0; i < byte_count; ++i) {
-        unsigned val = src[i];
-        for (size_t j = 0; j < bits_per_byte; ++j) {
-            size_t ix = bits_per_byte * i + j;
-            if (ix >= cnt)
-                break;
-            bits[ix] = val & (1U << j);
-        }
+    bool chunk[bit_chunk_size];
+    for (size_t i = 0; i < cnt; i += bit_chunk_size) {
+        auto n = std::min(cnt - i, bit_chunk_size);
+        unpack_bits(const_bit_span(&src[i / bits_per_byte], n),
+                std::span(chunk, n));
+        bits.insert(bits.end(), chunk, chunk + n);
     }
 
     return byte_count;
 }
 
 size_t serialize_bits(std::span<uint8_t> dst, const std::vector<bool>& bits) {
-    auto byte_count = bit_to_byte_count(bits.size());
+    auto cnt = bits.size();
+    auto byte_count = bit_to_byte_count(cnt);
 
     expects(dst.size() >= byte_count, "buffer too small");
 
-    for (size_t i = 0; i < byte_count; ++i) {
-        uint8_t val = 0;
-        for (size_t j = 0; j < bits_per_byte; ++j) {
-            size_t ix = bits_per_byte * i + j;
-            if (ix >= bits.size())
-                break;
-            val |= (bits[ix] << j);
-        }
-        dst[i] = val;
+    bool chunk[bit_chunk_size];
+    for (size_t i = 0; i < cnt; i += bit_chunk_size) {
+        auto n = std::min(cnt - i, bit_chunk_size);
+        std::copy_n(bits.begin() + static_cast<ptrdiff_t>(i), n, chunk);
+        pack_bits(std::span(chunk, n), bit_span(&dst[i / bits_per_byte], n));
     }
 
     return byte_count;
@@ -81,26 +96,30 @@ size_t serialize_bits(std::span<uint8_t> dst, const std::vector<bool>& bits) {
 
 std::size_t parse_regs(std::span<const uint8_t> src,
         std::vector<uint16_t>& regs, std::size_t cnt) {
-    auto byte_count = cnt * sizeof(uint16_t);
+    regs.resize(cnt);
+    return parse_regs(src, std::span(regs));
+}
+
+std::size_t parse_regs(
+        std::span<const uint8_t> src, std::span<uint16_t> regs) {
+    auto byte_count = regs.size() * sizeof(uint16_t);
 
     expects(src.size() >= byte_count, "too few bytes");
 
-    regs.resize(cnt);
-    for (size_t i = 0; i < cnt; ++i)
-        fetch16_be(regs[i], &src[i * sizeof(uint16_t)]);
+    decode_regs_be(src.data(), regs.size(), regs.data());
 
     return (byte_count);
 }
 
 std::size_t serialize_regs(
-        std::span<uint8_t> dst, const std::vector<uint16_t>& regs) {
-    expects(dst.size() >= (regs.size() * sizeof(uint16_t)), "buffer too small");
+        std::span<uint8_t> dst, std::span<const uint16_t> regs) {
+    auto byte_count = regs.size() * sizeof(uint16_t);
 
-    uint8_t* p = dst.data();
-    for (auto v : regs)
-        p += store16_be(p, v);
+    expects(dst.size() >= byte_count, "buffer too small");
 
-    return p - dst.data();
+    encode_regs_be(regs.data(), regs.size(), dst.data());
+
+    return byte_count;
 }
 
 } // namespace mboxid
@@ -8,6 +8,7 @@
 #include <vector>
 #include <limits>
 #include <mboxid/common.hpp>
+#include <mboxid/error.hpp>
 
 namespace mboxid {
 
@@ -103,10 +104,18 @@ enum class object_id {
     vendor_name = 0x00,
     product_code = 0x01,
     major_minor_revision = 0x02,
+    vendor_url = 0x03,
+    product_name = 0x04,
+    model_name = 0x05,
+    user_application_name = 0x06,
 };
 
+// Read device id codes for stream access, which are the categories of
+// objects, and conformity levels as well.
 enum class read_device_id_code {
     basic = 0x01,
+    regular = 0x02,
+    extended = 0x03,
 };
 
 enum class mei_type {
@@ -134,6 +143,12 @@ static inline size_t bit_to_byte_count(size_t n_bits) {
     return (n_bits + bits_per_byte - 1) / bits_per_byte;
 }
 
+// Returns errc::parse_error if the header is invalid, with a description of
+// the error stored in \a what.
+errc parse_mbap_header(std::span<const uint8_t> src, mbap_header& header,
+        const char*& what);
+
+// Throws mboxid_error(errc::parse_error) if the header is invalid.
 void parse_mbap_header(std::span<const uint8_t> src, mbap_header& header);
 
 size_t serialize_mbap_header(std::span<uint8_t> dst, const mbap_header& header);
@@ -146,8 +161,9 @@ size_t serialize_bits(std::span<uint8_t> dst, const std::vector<bool>& bits);
 size_t parse_regs(
         std::span<const uint8_t> src, std::vector<uint16_t>& regs, size_t cnt);
 
-size_t serialize_regs(
-        std::span<uint8_t> dst, const std::vector<uint16_t>& regs);
+size_t parse_regs(std::span<const uint8_t> src, std::span<uint16_t> regs);
+
+size_t serialize_regs(std::span<uint8_t> dst, std::span<const uint16_t> regs);
 
 } // namespace mboxid
 
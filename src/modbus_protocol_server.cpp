@@ -1,30 +1,21 @@
 // Copyright (c) 2024, Franz Hollerer.
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <algorithm>
 #include <cstring>
 #include "byteorder.hpp"
 #include "error_private.hpp"
+#include "logger_private.hpp"
 #include "modbus_protocol_common.hpp"
 #include "modbus_protocol_server.hpp"
 
 namespace mboxid {
 
-static void validate_min_req_length(std::span<const uint8_t> req, size_t len) {
-    if (req.size() < len)
-        throw mboxid_error(errc::parse_error, "request too short");
-}
-
-static void validate_exact_req_length(
-        std::span<const uint8_t> req, size_t len) {
-    if (req.size() != len)
-        throw mboxid_error(errc::parse_error, "request wrong length");
-}
-
 template <typename T> bool is_in_range(T val, T min, T max) {
     return (val >= min) && (val <= max);
 }
 
-static size_t serialize_exception_response(
+size_t serialize_exception_response(
         std::span<uint8_t> dst, function_code fc, errc e) {
     expects(dst.size() >= 2, "buffer too small");
 
@@ -35,10 +26,18 @@ static size_t serialize_exception_response(
     return p - dst.data();
 }
 
-static size_t process_read_bits(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc exception_response(
+        std::span<uint8_t> rsp, function_code fc, errc e, size_t& rsp_size) {
+    rsp_size = serialize_exception_response(rsp, fc, e);
+    return errc::none;
+}
+
+static errc process_read_bits(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_exact_req_length(req, read_bits_req_size);
+    if (req.size() != read_bits_req_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -50,44 +49,48 @@ static size_t process_read_bits(backend_connector& backend,
     fetch16_be(cnt, p_req);
 
     if (!is_in_range(cnt, min_read_bits, max_read_bits))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
 
-    // invoke backend
-    std::vector<bool> bits;
-    bits.reserve(cnt);
+    // invoke backend, which packs the bits right into the response
+    auto byte_cnt = bit_to_byte_count(cnt);
+    expects(rsp.size() >= (read_bits_rsp_min_size + byte_cnt - 1),
+            "buffer too small");
+
+    auto bits = bit_span(rsp.data() + read_bits_rsp_min_size - 1, cnt);
+    std::fill_n(bits.data(), byte_cnt, 0);
 
     mboxid::errc res;
 
     if (fc == function_code::read_coils)
-        res = backend.read_coils(addr, cnt, bits);
+        res = backend.read_coils_span(addr, bits);
     else
-        res = backend.read_discrete_inputs(addr, cnt, bits);
+        res = backend.read_discrete_inputs_span(addr, bits);
 
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend read coils _or_ discrete inputs");
+        return res;
 
-    expects(bits.size() == cnt, "backend returned wrong number of bits");
-
-    // serialize response
-    auto byte_cnt = bit_to_byte_count(cnt);
-    expects(rsp.size() >= (read_bits_rsp_min_size + byte_cnt - 1),
-            "buffer too small");
+    // serialize response, with the unused bits of the last byte cleared
+    if (auto n = cnt % bits_per_byte)
+        bits.data()[byte_cnt - 1] &= (1U << n) - 1;
 
     auto p_rsp = rsp.data();
     p_rsp += store8(p_rsp, fc);
     p_rsp += store8(p_rsp, byte_cnt);
-    p_rsp += serialize_bits(rsp.subspan(p_rsp - rsp.data()), bits);
+    p_rsp += byte_cnt;
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_read_registers(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_read_registers(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_exact_req_length(req, read_registers_req_size);
+    if (req.size() != read_registers_req_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -99,26 +102,24 @@ static size_t process_read_registers(backend_connector& backend,
     fetch16_be(cnt, p_req);
 
     if (!is_in_range(cnt, min_read_registers, max_read_registers))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
 
     // invoke backend
-    std::vector<uint16_t> regs;
-    regs.reserve(cnt);
+    uint16_t regs_buf[max_read_registers];
+    auto regs = std::span(regs_buf, cnt);
 
     mboxid::errc res;
 
     if (fc == function_code::read_holding_registers)
-        res = backend.read_holding_registers(addr, cnt, regs);
+        res = backend.read_holding_registers_span(addr, regs);
     else
-        res = backend.read_input_registers(addr, cnt, regs);
+        res = backend.read_input_registers_span(addr, regs);
 
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend read holding _or_ input registers");
-
-    expects(regs.size() == cnt, "backend returned wrong number of registers");
+        return res;
 
     // serialize response
     auto byte_cnt = cnt * sizeof(uint16_t);
@@ -131,13 +132,16 @@ static size_t process_read_registers(backend_connector& backend,
     p_rsp += store8(p_rsp, byte_cnt);
     p_rsp += serialize_regs(rsp.subspan(p_rsp - rsp.data()), regs);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_write_single_coil(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_write_single_coil(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_exact_req_length(req, write_coil_req_size);
+    if (req.size() != write_coil_req_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -149,17 +153,17 @@ static size_t process_write_single_coil(backend_connector& backend,
     fetch16_be(val, p_req);
 
     if ((val != single_coil_off) && (val != single_coil_on))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
 
     // invoke backend connector
-    std::vector<bool> bits{val == single_coil_on};
+    uint8_t bit = (val == single_coil_on) ? 1 : 0;
 
-    auto res = backend.write_coils(addr, bits);
+    auto res = backend.write_coils_span(addr, const_bit_span(&bit, 1));
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend write coils");
+        return res;
 
     // serialize response
     expects(rsp.size() >= write_coil_rsp_size, "buffer too small");
@@ -169,13 +173,16 @@ static size_t process_write_single_coil(backend_connector& backend,
     p_rsp += store16_be(p_rsp, addr);
     p_rsp += store16_be(p_rsp, val);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_write_single_register(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_write_single_register(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_exact_req_length(req, write_register_req_size);
+    if (req.size() != write_register_req_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -187,13 +194,11 @@ static size_t process_write_single_register(backend_connector& backend,
     fetch16_be(val, p_req);
 
     // invoke backend connector
-    std::vector<uint16_t> regs{val};
-
-    auto res = backend.write_holding_registers(addr, regs);
+    auto res = backend.write_holding_registers_span(addr, std::span(&val, 1));
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend write holding registers");
+        return res;
 
     // serialize response
     expects(rsp.size() >= write_register_rsp_size, "buffer too small");
@@ -203,13 +208,16 @@ static size_t process_write_single_register(backend_connector& backend,
     p_rsp += store16_be(p_rsp, addr);
     p_rsp += store16_be(p_rsp, val);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_write_multiple_coils(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_write_multiple_coils(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_min_req_length(req, write_multiple_coils_req_min_size);
+    if (req.size() < write_multiple_coils_req_min_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -224,18 +232,19 @@ static size_t process_write_multiple_coils(backend_connector& backend,
 
     if (!is_in_range(cnt, min_write_coils, max_write_coils) ||
             (byte_cnt != bit_to_byte_count(cnt)))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
 
-    std::vector<bool> bits;
-    parse_bits(req.subspan(p_req - req.data()), bits, cnt);
+    if (req.size() < (p_req - req.data()) + byte_cnt)
+        return errc::parse_error;
 
-    // invoke backend connector
-    auto res = backend.write_coils(addr, bits);
+    // invoke backend connector with the packed bits of the request
+
+    auto res = backend.write_coils_span(addr, const_bit_span(p_req, cnt));
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend write coils");
+        return res;
 
     // serialize response
     expects(rsp.size() >= write_multiple_coils_rsp_size, "buffer too small");
@@ -245,13 +254,16 @@ static size_t process_write_multiple_coils(backend_connector& backend,
     p_rsp += store16_be(p_rsp, addr);
     p_rsp += store16_be(p_rsp, cnt);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_write_multiple_registers(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_write_multiple_registers(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_min_req_length(req, write_multiple_registers_req_min_size);
+    if (req.size() < write_multiple_registers_req_min_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -266,18 +278,22 @@ static size_t process_write_multiple_registers(backend_connector& backend,
 
     if (!is_in_range(cnt, min_write_registers, max_write_registers) ||
             (byte_cnt != (cnt * sizeof(uint16_t))))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
+
+    if (req.size() < (p_req - req.data()) + byte_cnt)
+        return errc::parse_error;
 
-    std::vector<uint16_t> regs;
-    parse_regs(req.subspan(p_req - req.data()), regs, cnt);
+    uint16_t regs_buf[max_write_registers];
+    auto regs = std::span(regs_buf, cnt);
+    parse_regs(req.subspan(p_req - req.data()), regs);
 
     // invoke backend connector
-    auto res = backend.write_holding_registers(addr, regs);
+    auto res = backend.write_holding_registers_span(addr, regs);
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend write coils");
+        return res;
 
     // serialize response
     expects(rsp.size() >= write_multiple_registers_rsp_size,
@@ -288,13 +304,16 @@ static size_t process_write_multiple_registers(backend_connector& backend,
     p_rsp += store16_be(p_rsp, addr);
     p_rsp += store16_be(p_rsp, cnt);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_mask_write_registers(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_mask_write_registers(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_exact_req_length(req, mask_write_register_req_size);
+    if (req.size() != mask_write_register_req_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr;
@@ -308,19 +327,18 @@ static size_t process_mask_write_registers(backend_connector& backend,
     fetch16_be(or_mask, p_req);
 
     // invoke backend
-    std::vector<uint16_t> regs;
-    auto res = backend.read_holding_registers(addr, 1, regs);
+    uint16_t reg;
+    auto res = backend.read_holding_registers_span(addr, std::span(&reg, 1));
 
     if (res == errc::none) {
-        expects(regs.size() == 1, "backend returned wrong number of registers");
-        regs[0] = (regs[0] & and_mask) | (or_mask & ~and_mask);
-        res = backend.write_holding_registers(addr, regs);
+        reg = (reg & and_mask) | (or_mask & ~and_mask);
+        res = backend.write_holding_registers_span(addr, std::span(&reg, 1));
     }
 
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend read _or_ write holding registers");
+        return res;
 
     // serialize response
     expects(rsp.size() >= mask_write_register_rsp_size, "buffer too small");
@@ -331,13 +349,16 @@ static size_t process_mask_write_registers(backend_connector& backend,
     p_rsp += store16_be(p_rsp, and_mask);
     p_rsp += store16_be(p_rsp, or_mask);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_read_write_multiple_registers(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_read_write_multiple_registers(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
     // parse request
-    validate_min_req_length(req, read_write_multiple_registers_req_min_size);
+    if (req.size() < read_write_multiple_registers_req_min_size)
+        return errc::parse_error;
 
     function_code fc;
     unsigned addr_rd;
@@ -359,24 +380,25 @@ static size_t process_read_write_multiple_registers(backend_connector& backend,
             !is_in_range(cnt_wr, min_rdwr_write_registers,
                     max_rdwr_write_registers) ||
             (byte_cnt_wr != (cnt_wr * sizeof(uint16_t))))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
 
-    std::vector<uint16_t> regs_wr;
-    parse_regs(req.subspan(p_req - req.data()), regs_wr, cnt_wr);
+    if (req.size() < (p_req - req.data()) + byte_cnt_wr)
+        return errc::parse_error;
+
+    uint16_t regs_wr_buf[max_rdwr_write_registers];
+    auto regs_wr = std::span(regs_wr_buf, cnt_wr);
+    parse_regs(req.subspan(p_req - req.data()), regs_wr);
 
     // invoke backend connector
-    std::vector<uint16_t> regs_rd;
-    regs_rd.reserve(cnt_rd);
-    auto res = backend.write_read_holding_registers(
-            addr_wr, regs_wr, addr_rd, cnt_rd, regs_rd);
+    uint16_t regs_rd_buf[max_rdwr_read_registers];
+    auto regs_rd = std::span(regs_rd_buf, cnt_rd);
+    auto res = backend.write_read_holding_registers_span(
+            addr_wr, regs_wr, addr_rd, regs_rd);
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend write/read coils");
-
-    expects(regs_rd.size() == cnt_rd,
-            "backend returned wrong number of registers");
+        return res;
 
     // serialize response
     auto byte_cnt_rd = cnt_rd * sizeof(uint16_t);
@@ -389,18 +411,21 @@ static size_t process_read_write_multiple_registers(backend_connector& backend,
     p_rsp += store8(p_rsp, byte_cnt_rd);
     p_rsp += serialize_regs(rsp.subspan(p_rsp - rsp.data()), regs_rd);
 
-    return p_rsp - rsp.data();
+    rsp_size = p_rsp - rsp.data();
+    return errc::none;
 }
 
-static size_t process_read_device_information(backend_connector& backend,
-        std::span<const uint8_t> req, std::span<uint8_t> rsp) {
+static errc process_read_device_information(backend_connector& backend,
+        device_identification_cache* cache, std::span<const uint8_t> req,
+        std::span<uint8_t> rsp, size_t& rsp_size) {
     // parse request
-    validate_exact_req_length(req, read_device_identification_req_size);
+    if (req.size() != read_device_identification_req_size)
+        return errc::parse_error;
 
     function_code fc;
     mei_type mei;
     read_device_id_code code;
-    object_id id;
+    unsigned id;
 
     auto* p_req = req.data();
     p_req += fetch8(fc, p_req);
@@ -408,85 +433,198 @@ static size_t process_read_device_information(backend_connector& backend,
     p_req += fetch8(code, p_req);
     fetch8(id, p_req);
 
-    if ((mei != mei_type::modbus) || (code != read_device_id_code::basic))
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_value);
-    if (id != object_id::vendor_name)
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_data_address);
-
-    // invoke backend
-    std::string vendor, product, version;
-    auto res =
-            backend.get_basic_device_identification(vendor, product, version);
+    if ((mei != mei_type::modbus) ||
+            !is_in_range(code, read_device_id_code::basic,
+                    read_device_id_code::extended))
+        return exception_response(
+                rsp, fc, errc::modbus_exception_illegal_data_value, rsp_size);
+
+    // The serialized objects are taken from the cache, which reads them from
+    // the backend only if they have changed. Without a cache, they are read
+    // for each request.
+    auto res = errc::none;
+    std::shared_ptr<const device_identification_objects> objects;
+    if (cache) {
+        objects = cache->get(backend, res);
+    } else {
+        device_identification ident;
+        res = backend.get_device_identification(ident);
+        if (res == errc::none)
+            objects = std::make_shared<device_identification_objects>(ident);
+    }
 
     if (is_modbus_exception(res))
-        return serialize_exception_response(rsp, fc, res);
+        return exception_response(rsp, fc, res, rsp_size);
     else if (res != errc::none)
-        throw mboxid_error(res, "backend device identification");
+        return res;
 
     // serialize response
-    expects(rsp.size() >= (read_device_identification_rsp_min_size +
-                                  (vendor.length() - 1) + 2 + product.length() +
-                                  2 + version.length()),
-            "buffer too small");
+    rsp_size = objects->serialize_response(rsp, code, id);
+    return errc::none;
+}
 
-    auto p_rsp = rsp.data();
-    p_rsp += store8(p_rsp, fc);
-    p_rsp += store8(p_rsp, mei_type::modbus);
-    p_rsp += store8(p_rsp, code);
-    p_rsp += store8(p_rsp, read_device_id_code::basic); // conformity level
-    p_rsp += store8(p_rsp, 0x00);                       // more follows: no
-    p_rsp += store8(p_rsp, 0x00);                       // next object id
-    p_rsp += store8(p_rsp, 0x03);                       // number of objects
-    p_rsp += store8(p_rsp, object_id::vendor_name);
-    p_rsp += store8(p_rsp, vendor.length());
-    std::memcpy(p_rsp, vendor.c_str(), vendor.length());
-    p_rsp += vendor.length();
-    p_rsp += store8(p_rsp, object_id::product_code);
-    p_rsp += store8(p_rsp, product.length());
-    std::memcpy(p_rsp, product.c_str(), product.length());
-    p_rsp += product.length();
-    p_rsp += store8(p_rsp, object_id::major_minor_revision);
-    p_rsp += store8(p_rsp, version.length());
-    std::memcpy(p_rsp, version.c_str(), version.length());
-    p_rsp += version.length();
-
-    return p_rsp - rsp.data();
+// Adapts the processing of a standard function code, which does not depend on
+// the state of the backend, to a request handler.
+template <errc (*process)(backend_connector&, std::span<const uint8_t>,
+        std::span<uint8_t>, size_t&)>
+static errc stateless(backend_connector& backend, backend_state*,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
+    return process(backend, req, rsp, rsp_size);
+}
+
+static errc process_read_device_identification_request(
+        backend_connector& backend, backend_state* state,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
+    return process_read_device_information(backend,
+            state ? &state->device_id : nullptr, req, rsp, rsp_size);
+}
+
+static errc process_illegal_function(backend_connector&, backend_state*,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
+    return exception_response(rsp, static_cast<function_code>(req[0]),
+            errc::modbus_exception_illegal_function, rsp_size);
+}
+
+static errc process_user_function(backend_connector& backend,
+        backend_state* state, std::span<const uint8_t> req,
+        std::span<uint8_t> rsp, size_t& rsp_size) {
+    auto fc = static_cast<function_code>(req[0]);
+    rsp = rsp.first(std::min(rsp.size(), max_pdu_size));
+
+    size_t cnt = 0;
+    auto res = state->functions->user_handler(req[0])(backend, req, rsp, cnt);
+    if (is_modbus_exception(res))
+        return exception_response(rsp, fc, res, rsp_size);
+    else if (res != errc::none)
+        return res;
+
+    // A broken handler must not take down the server, so the client is told
+    // that the request failed.
+    if (!cnt || (cnt > rsp.size())) {
+        log::error("handler of function code {} returned an invalid "
+                   "response size: {}",
+                static_cast<unsigned>(req[0]), cnt);
+        return exception_response(rsp, fc,
+                errc::modbus_exception_server_device_failure, rsp_size);
+    }
+    rsp_size = cnt;
+    return errc::none;
+}
+
+static constexpr size_t index(function_code fc) {
+    return static_cast<size_t>(fc);
+}
+
+// The handlers of the standard function codes. All other function codes,
+// including the ones with the exception bit set, are illegal.
+static constexpr auto standard_handlers = [] {
+    std::array<request_handler, 0x100> tbl{};
+    tbl.fill(process_illegal_function);
+
+    tbl[index(function_code::read_coils)] = stateless<process_read_bits>;
+    tbl[index(function_code::read_discrete_inputs)] =
+            stateless<process_read_bits>;
+    tbl[index(function_code::read_holding_registers)] =
+            stateless<process_read_registers>;
+    tbl[index(function_code::read_input_registers)] =
+            stateless<process_read_registers>;
+    tbl[index(function_code::write_single_coil)] =
+            stateless<process_write_single_coil>;
+    tbl[index(function_code::write_single_register)] =
+            stateless<process_write_single_register>;
+    tbl[index(function_code::write_multiple_coils)] =
+            stateless<process_write_multiple_coils>;
+    tbl[index(function_code::write_multiple_registers)] =
+            stateless<process_write_multiple_registers>;
+    tbl[index(function_code::mask_write_register)] =
+            stateless<process_mask_write_registers>;
+    tbl[index(function_code::read_write_multiple_registers)] =
+            stateless<process_read_write_multiple_registers>;
+    tbl[index(function_code::read_device_identification)] =
+            process_read_device_identification_request;
+    return tbl;
+}();
+
+function_table::function_table() : handlers(standard_handlers) {}
+
+void function_table::set_handler(unsigned fc, function_handler handler) {
+    validate_argument(is_in_range(fc, 0x01U, 0x7fU) &&
+                    (standard_handlers[fc] == process_illegal_function),
+            "function code");
+
+    handlers[fc] = handler ? process_user_function : process_illegal_function;
+    user_handlers[fc] = std::move(handler);
+}
+
+static errc dispatch(backend_connector& backend, backend_state* state,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        size_t& rsp_size) {
+    if (req.size() < min_pdu_size)
+        return errc::parse_error;
+
+    auto functions = state ? state->functions : nullptr;
+    auto handler =
+            functions ? functions->find(req[0]) : standard_handlers[req[0]];
+    return handler(backend, state, req, rsp, rsp_size);
 }
 
 size_t server_engine(backend_connector& backend, std::span<const uint8_t> req,
         std::span<uint8_t> rsp) {
-    validate_min_req_length(req, min_pdu_size);
+    size_t cnt = 0;
+    if (auto res = dispatch(backend, nullptr, req, rsp, cnt); res != errc::none)
+        throw mboxid_error(res, "server engine");
+    return cnt;
+}
 
-    auto fc = static_cast<function_code>(req[0]);
+uint64_t read_request_key(unsigned unit_id, std::span<const uint8_t> req) {
+    if (req.size() != read_registers_req_size)
+        return 0;
+
+    function_code fc;
+    unsigned addr;
+    size_t cnt;
+
+    auto* p_req = req.data();
+    p_req += fetch8(fc, p_req);
+    p_req += fetch16_be(addr, p_req);
+    fetch16_be(cnt, p_req);
+
+    size_t max_cnt;
     switch (fc) {
     case function_code::read_coils:
         [[fallthrough]];
     case function_code::read_discrete_inputs:
-        return process_read_bits(backend, req, rsp);
+        max_cnt = max_read_bits;
+        break;
     case function_code::read_holding_registers:
         [[fallthrough]];
     case function_code::read_input_registers:
-        return process_read_registers(backend, req, rsp);
-    case function_code::write_single_coil:
-        return process_write_single_coil(backend, req, rsp);
-    case function_code::write_single_register:
-        return process_write_single_register(backend, req, rsp);
-    case function_code::write_multiple_coils:
-        return process_write_multiple_coils(backend, req, rsp);
-    case function_code::write_multiple_registers:
-        return process_write_multiple_registers(backend, req, rsp);
-    case function_code::mask_write_register:
-        return process_mask_write_registers(backend, req, rsp);
-    case function_code::read_write_multiple_registers:
-        return process_read_write_multiple_registers(backend, req, rsp);
-    case function_code::read_device_identification:
-        return process_read_device_information(backend, req, rsp);
+        max_cnt = max_read_registers;
+        break;
     default:
-        return serialize_exception_response(
-                rsp, fc, errc::modbus_exception_illegal_function);
+        return 0;
     }
+
+    if (!cnt || (cnt > max_cnt) || (addr + cnt > 0x10000))
+        return 0;
+
+    return (uint64_t{unit_id & 0xffU} << 40) | (uint64_t{req[0]} << 32) |
+            (uint64_t{addr} << 16) | cnt;
+}
+
+errc server_engine(backend_connector& backend, backend_state* state,
+        unsigned unit_id, std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        std::size_t& rsp_size) {
+    if (!state || !state->responses)
+        return dispatch(backend, state, req, rsp, rsp_size);
+
+    return state->responses->execute(unit_id, req, rsp, rsp_size,
+            [&](auto req, auto rsp, size_t& rsp_size) {
+                return dispatch(backend, state, req, rsp, rsp_size);
+            });
 }
 
 } // namespace mboxid
@@ -4,15 +4,88 @@
 #ifndef LIBMBOXID_MODBUS_PROTOCOL_SERVER_HPP
 #define LIBMBOXID_MODBUS_PROTOCOL_SERVER_HPP
 
+#include <array>
+#include <functional>
+#include <memory>
 #include <span>
 #include <mboxid/common.hpp>
 #include <mboxid/backend_connector.hpp>
+#include "modbus_protocol_common.hpp"
+#include "device_identification.hpp"
+#include "response_cache.hpp"
 
 namespace mboxid {
 
+std::size_t serialize_exception_response(
+        std::span<uint8_t> dst, function_code fc, errc e);
+
+// Executes the request PDU \a req and returns the size of the response PDU
+// stored in \a rsp. Throws mboxid_error if the request is malformed or the
+// backend fails.
 std::size_t server_engine(backend_connector& backend,
         std::span<const uint8_t> req, std::span<uint8_t> rsp);
 
+// Returns a key identifying a valid read request (function codes 1 to 4) by
+// unit id, function code, address and count, or 0 for any other request.
+uint64_t read_request_key(unsigned unit_id, std::span<const uint8_t> req);
+
+struct backend_state;
+
+// Executes the request PDU \a req and stores the response PDU in \a rsp and
+// its size in \a rsp_size, see server_engine().
+using request_handler = errc (*)(backend_connector& backend,
+        backend_state* state, std::span<const uint8_t> req,
+        std::span<uint8_t> rsp, std::size_t& rsp_size);
+
+// Handler of a function code registered by the application, see
+// modbus_tcp_server::set_function_handler().
+using function_handler = std::function<errc(backend_connector& backend,
+        std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        std::size_t& rsp_size)>;
+
+// Request handlers indexed by the function code. The table starts out with
+// the handlers of the standard function codes, which are built at compile
+// time. Handlers registered by the application for other function codes
+// are invoked through a common request handler.
+class function_table {
+public:
+    function_table();
+
+    // Registers \a handler for \a fc, or removes the handler of \a fc if
+    // \a handler is empty.
+    void set_handler(unsigned fc, function_handler handler);
+
+    request_handler find(uint8_t fc) const { return handlers[fc]; }
+
+    const function_handler& user_handler(uint8_t fc) const {
+        return user_handlers[fc & 0x7fU];
+    }
+
+private:
+    std::array<request_handler, 0x100> handlers;
+    std::array<function_handler, 0x80> user_handlers;
+};
+
+// State the server keeps for a backend, shared by all threads serving it.
+struct backend_state {
+    std::unique_ptr<response_cache> responses; // optional
+    device_identification_cache device_id;
+    const function_table* functions = nullptr; // standard handlers if null
+};
+
+// Executes the request PDU \a req with the state of the backend, if \a
+// state is not a null pointer. The response PDU is stored in \a rsp and its
+// size in \a rsp_size.
+//
+// Modbus exceptions are responses like any other. Otherwise, the function
+// returns errc::parse_error if the request is malformed, or the error
+// reported by the backend, without storing a response. Errors are reported
+// this way instead of thrown, as a client sending garbage would otherwise
+// make the server unwind the stack for every request.
+errc server_engine(backend_connector& backend, backend_state* state,
+        unsigned unit_id, std::span<const uint8_t> req, std::span<uint8_t> rsp,
+        std::size_t& rsp_size);
+
 } // namespace mboxid
 
 #endif // LIBMBOXID_MODBUS_PROTOCOL_SERVER_HPP
\ No newline at end of file
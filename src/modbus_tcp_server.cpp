@@ -20,10 +20,18 @@ void modbus_tcp_server::set_backend(
     pimpl->set_backend(std::move(backend));
 }
 
+void modbus_tcp_server::set_backend_factory(backend_factory factory) {
+    pimpl->set_backend_factory(std::move(factory));
+}
+
 backend_connector* modbus_tcp_server::borrow_backend() {
     return pimpl->borrow_backend();
 }
 
+void modbus_tcp_server::set_thread_count(unsigned cnt) {
+    pimpl->set_thread_count(cnt);
+}
+
 void modbus_tcp_server::run() { pimpl->run(); }
 
 void modbus_tcp_server::shutdown() { pimpl->shutdown(); }
@@ -40,4 +48,50 @@ void modbus_tcp_server::set_request_complete_timeout(milliseconds to) {
     pimpl->set_request_complete_timeout(to);
 }
 
+void modbus_tcp_server::set_transport(transport t) { pimpl->set_transport(t); }
+
+void modbus_tcp_server::set_pipeline_depth(unsigned depth) {
+    pimpl->set_pipeline_depth(depth);
+}
+
+void modbus_tcp_server::set_listen_backlog(int backlog) {
+    pimpl->set_listen_backlog(backlog);
+}
+
+uint64_t modbus_tcp_server::accept_queue_overflows() const {
+    return pimpl->accept_queue_overflows();
+}
+
+void modbus_tcp_server::set_worker_threads(unsigned cnt) {
+    pimpl->set_worker_threads(cnt);
+}
+
+void modbus_tcp_server::set_offload_policy(offload_policy policy) {
+    pimpl->set_offload_policy(std::move(policy));
+}
+
+void modbus_tcp_server::set_response_cache(milliseconds max_staleness) {
+    pimpl->set_response_cache(max_staleness);
+}
+
+void modbus_tcp_server::set_read_coalescing(bool enable) {
+    pimpl->set_read_coalescing(enable);
+}
+
+void modbus_tcp_server::set_function_handler(
+        uint8_t function_code, function_handler handler) {
+    pimpl->set_function_handler(function_code, std::move(handler));
+}
+
+void modbus_tcp_server::set_latency_histograms(bool enable) {
+    pimpl->set_latency_histograms(enable);
+}
+
+server_metrics modbus_tcp_server::metrics() const { return pimpl->metrics(); }
+
+void modbus_tcp_server::set_request_tracer(
+        request_tracer tracer, unsigned sample_interval) {
+    pimpl->set_request_tracer(std::move(tracer), sample_interval);
+}
+
 } // namespace mboxid
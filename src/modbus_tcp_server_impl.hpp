@@ -4,18 +4,10 @@
 #ifndef LIBMBOXID_MODBUS_TCP_SERVER_IMPL_HPP
 #define LIBMBOXID_MODBUS_TCP_SERVER_IMPL_HPP
 
-#include <thread>
 #include <vector>
-#include <deque>
-#include <list>
-#include <variant>
-#include <functional>
-#include <chrono>
-#include <poll.h>
-#include <sys/eventfd.h>
 #include <mboxid/modbus_tcp_server.hpp>
-#include "unique_fd.hpp"
-#include "network_private.hpp"
+#include "server_reactor.hpp"
+#include "worker_pool.hpp"
 
 namespace mboxid {
 
@@ -33,66 +25,38 @@ public:
             net::ip_protocol_version ip_version);
 
     void set_backend(std::unique_ptr<backend_connector> backend_);
+    void set_backend_factory(backend_factory factory);
     backend_connector* borrow_backend(); // provided for unit tests
 
+    void set_thread_count(unsigned cnt);
+
     void run();
     void shutdown();
     void close_client_connection(client_id id);
     void set_idle_timeout(milliseconds to);
     void set_request_complete_timeout(milliseconds to);
+    void set_transport(transport t);
+    void set_pipeline_depth(unsigned depth);
+    void set_listen_backlog(int backlog);
+    uint64_t accept_queue_overflows() const;
+    void set_worker_threads(unsigned cnt);
+    void set_offload_policy(offload_policy policy);
+    void set_response_cache(milliseconds max_staleness);
+    void set_read_coalescing(bool enable);
+    void set_function_handler(uint8_t fc, function_handler handler);
+    void set_latency_histograms(bool enable);
+    server_metrics metrics() const;
+    void set_request_tracer(request_tracer tracer, unsigned sample_interval);
 
 private:
-    using timestamp = std::chrono::time_point<std::chrono::steady_clock>;
-    static constexpr auto never = timestamp::max();
-
-    struct cmd_stop {};
-
-    struct cmd_close_connection {
-        client_id id;
-    };
-
-    using cmd_queue_entry = std::variant<cmd_stop, cmd_close_connection>;
-
-    // set of file descriptors to monitor
-    struct monitor_set {
-        std::vector<struct pollfd> fds;
-        std::vector<std::function<void(int fd, unsigned events)>> on_ready;
-    };
-
-    struct client_control_block;
-
-    bool stop_fl = false;
-    bool use_tls = false;
-
-    unique_fd cmd_event_fd;
-    std::vector<unique_fd> listen_fds;
-
-    std::mutex cmd_queue_mutex;
-    std::deque<cmd_queue_entry> cmd_queue;
-    net::endpoint_addr own_addr;
-    std::list<std::unique_ptr<client_control_block>> clients;
+    server_config config;
     std::unique_ptr<backend_connector> backend;
-    timestamp ts_next_backend_ticker;
-
-    milliseconds idle_timeout = no_timeout;
-    milliseconds request_complete_timeout = no_timeout;
-
-    void trigger_command_processing();
-    int calc_poll_timeout();
-    monitor_set build_monitor_set();
-    void process_commands(int fd, unsigned events);
-    void passive_open();
-    void establish_connection(int fd, unsigned events);
-    client_control_block* find_client_by_fd(int fd);
-    void close_client_by_id(client_id id);
-    static void reset_client_state(client_control_block* client);
-    static timestamp determine_deadline(milliseconds to);
-    bool receive_request(client_control_block* client);
-    void execute_request(client_control_block* client);
-    void handle_request(int fd, unsigned events);
-    void send_response(int fd, unsigned events);
-
-    void execute_pending_tasks();
+    backend_factory make_backend;
+    unsigned n_workers = 0;
+    offload_policy offload;
+    milliseconds max_staleness{0}; // response cache disabled if 0
+    function_table functions;
+    std::vector<std::unique_ptr<server_reactor>> reactors;
 };
 
 } // namespace mboxid
@@ -0,0 +1,89 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <bit>
+#include <cstring>
+#include "reg_codec.hpp"
+
+#if defined(MBOXID_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace mboxid {
+
+// A plain loop over byte-swapped values, which the compiler vectorizes
+// according to the baseline instruction set.
+void swap16_scalar(const uint8_t* src, size_t n, uint8_t* dst) {
+    for (size_t i = 0; i < n; ++i) {
+        uint16_t v;
+        std::memcpy(&v, src + 2 * i, sizeof(v));
+        v = __builtin_bswap16(v);
+        std::memcpy(dst + 2 * i, &v, sizeof(v));
+    }
+}
+
+#if defined(MBOXID_HAVE_X86_SIMD)
+
+// Swaps the bytes of 8 (SSSE3) or 16 (AVX2) registers per shuffle. The
+// remainder is handled by the narrower kernels.
+
+__attribute__((target("ssse3"))) void swap16_ssse3(
+        const uint8_t* src, size_t n, uint8_t* dst) {
+    const auto order = _mm_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i),
+                _mm_shuffle_epi8(v, order));
+    }
+    swap16_scalar(src + 2 * i, n - i, dst + 2 * i);
+}
+
+__attribute__((target("avx2"))) void swap16_avx2(
+        const uint8_t* src, size_t n, uint8_t* dst) {
+    const auto order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10,
+            13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15,
+            14);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        auto v = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(src + 2 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i),
+                _mm256_shuffle_epi8(v, order));
+    }
+    swap16_ssse3(src + 2 * i, n - i, dst + 2 * i);
+}
+
+#endif
+
+static swap16_fn select_swap16_kernel() {
+#if defined(MBOXID_HAVE_X86_SIMD)
+    if (cpu_has_avx2())
+        return swap16_avx2;
+    if (cpu_has_ssse3())
+        return swap16_ssse3;
+#endif
+    return swap16_scalar;
+}
+
+static void convert_regs(const uint8_t* src, size_t n, uint8_t* dst) {
+    static const auto kernel = select_swap16_kernel();
+
+    if constexpr (std::endian::native == std::endian::big)
+        std::memcpy(dst, src, n * sizeof(uint16_t));
+    else
+        kernel(src, n, dst);
+}
+
+void decode_regs_be(const uint8_t* src, size_t n, uint16_t* dst) {
+    convert_regs(src, n, reinterpret_cast<uint8_t*>(dst));
+}
+
+void encode_regs_be(const uint16_t* src, size_t n, uint8_t* dst) {
+    convert_regs(reinterpret_cast<const uint8_t*>(src), n, dst);
+}
+
+} // namespace mboxid
@@ -0,0 +1,34 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_REG_CODEC_HPP
+#define LIBMBOXID_REG_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "cpu_features.hpp"
+
+namespace mboxid {
+
+// Conversion of blocks of registers between the big-endian byte order of
+// Modbus frames and the host byte order. Neither side needs to be aligned.
+void decode_regs_be(const std::uint8_t* src, std::size_t n, std::uint16_t* dst);
+void encode_regs_be(const std::uint16_t* src, std::size_t n, std::uint8_t* dst);
+
+// Kernels swapping the bytes of n 16-bit values, which is the conversion
+// on little-endian hosts. decode_regs_be() and encode_regs_be() dispatch to
+// the best kernel supported by the CPU. The individual kernels are exposed
+// for tests and benchmarks.
+using swap16_fn = void (*)(
+        const std::uint8_t* src, std::size_t n, std::uint8_t* dst);
+
+void swap16_scalar(const std::uint8_t* src, std::size_t n, std::uint8_t* dst);
+
+#if defined(MBOXID_HAVE_X86_SIMD)
+void swap16_ssse3(const std::uint8_t* src, std::size_t n, std::uint8_t* dst);
+void swap16_avx2(const std::uint8_t* src, std::size_t n, std::uint8_t* dst);
+#endif
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_REG_CODEC_HPP
@@ -0,0 +1,457 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <mboxid/register_map_backend.hpp>
+#include "error_private.hpp"
+#include "cpu_features.hpp"
+
+namespace mboxid {
+
+constexpr size_t cache_line_size{64};
+constexpr size_t max_table_size{0x10000};
+
+// Array of atomics aligned to, and padded to a multiple of cache lines.
+template <typename T> class atomic_array {
+public:
+    explicit atomic_array(size_t n)
+            : cnt(round_up(n)),
+              p(static_cast<std::atomic<T>*>(::operator new(
+                      cnt * sizeof(std::atomic<T>),
+                      std::align_val_t(cache_line_size)))) {
+        std::uninitialized_value_construct_n(p.get(), cnt);
+    }
+
+    std::atomic<T>& operator[](size_t i) noexcept { return p[i]; }
+    const std::atomic<T>& operator[](size_t i) const noexcept { return p[i]; }
+
+private:
+    static_assert(std::atomic<T>::is_always_lock_free);
+    static_assert(std::is_trivially_destructible_v<std::atomic<T>>);
+
+    struct deleter {
+        void operator()(std::atomic<T>* p) const noexcept {
+            ::operator delete(p, std::align_val_t(cache_line_size));
+        }
+    };
+
+    static size_t round_up(size_t n) {
+        constexpr size_t per_line = cache_line_size / sizeof(std::atomic<T>);
+        return std::max((n + per_line - 1) / per_line, size_t{1}) * per_line;
+    }
+
+    size_t cnt;
+    std::unique_ptr<std::atomic<T>[], deleter> p;
+};
+
+static bool in_range(size_t addr, size_t cnt, size_t size) {
+    return (addr <= size) && (cnt <= size - addr);
+}
+
+// Coils or discrete inputs, packed into 64-bit words.
+class bit_table {
+public:
+    // A spare word lets get() always read two adjacent words.
+    explicit bit_table(size_t n) : n(n), words(n / bits_per_word + 2) {}
+
+    size_t size() const { return n; }
+
+    bool get(size_t i) const {
+        auto w = words[i / bits_per_word].load(std::memory_order_acquire);
+        return (w >> (i % bits_per_word)) & 1U;
+    }
+
+    void set(size_t i, bool val) {
+        auto mask = uint64_t{1} << (i % bits_per_word);
+        auto& w = words[i / bits_per_word];
+        if (val)
+            w.fetch_or(mask, std::memory_order_release);
+        else
+            w.fetch_and(~mask, std::memory_order_release);
+    }
+
+    // Copies 64 bits at a time, shifted into place from two words.
+    void get(size_t addr, bit_span bits) const {
+        auto dst = bits.data();
+
+        for (size_t i = 0; i < bits.size(); i += bits_per_word) {
+            auto pos = addr + i;
+            auto w = pos / bits_per_word;
+            auto s = pos % bits_per_word;
+
+            auto v = words[w].load(std::memory_order_acquire) >> s;
+            if (s)
+                v |= words[w + 1].load(std::memory_order_acquire)
+                        << (bits_per_word - s);
+
+            auto cnt = std::min(bits.size() - i, bits_per_word);
+            if (cnt < bits_per_word)
+                v &= (uint64_t{1} << cnt) - 1;
+            for (size_t k = 0; k < (cnt + 7) / 8; ++k)
+                *dst++ = static_cast<uint8_t>(v >> (8 * k));
+        }
+    }
+
+    // Merges the bits into one word at a time with compare-and-swap, so that
+    // concurrent updates of other bits in the same word are not lost.
+    void set(size_t addr, const_bit_span bits) {
+        for (size_t i = 0; i < bits.size();) {
+            auto pos = addr + i;
+            auto s = pos % bits_per_word;
+            auto cnt = std::min(bits.size() - i, bits_per_word - s);
+
+            auto mask = ((cnt < bits_per_word) ? (uint64_t{1} << cnt) - 1
+                                               : ~uint64_t{0})
+                    << s;
+            auto v = extract(bits, i, cnt) << s;
+
+            auto& w = words[pos / bits_per_word];
+            auto old = w.load(std::memory_order_relaxed);
+            while (!w.compare_exchange_weak(old, (old & ~mask) | v,
+                    std::memory_order_release, std::memory_order_relaxed))
+                ;
+
+            i += cnt;
+        }
+    }
+
+private:
+    static constexpr size_t bits_per_word{64};
+
+    // Returns cnt (<= 64) bits of src, starting at bit i.
+    static uint64_t extract(const_bit_span src, size_t i, size_t cnt) {
+        auto p = src.data() + i / 8;
+        auto r = i % 8;
+        auto n_bytes = std::min((r + cnt + 7) / 8, src.size_bytes() - i / 8);
+
+        uint64_t v = 0;
+        for (size_t k = 0; k < std::min(n_bytes, size_t{8}); ++k)
+            v |= uint64_t{p[k]} << (8 * k);
+        v >>= r;
+        if (n_bytes > 8)
+            v |= uint64_t{p[8]} << (bits_per_word - r);
+
+        return (cnt < bits_per_word) ? v & ((uint64_t{1} << cnt) - 1) : v;
+    }
+
+    size_t n;
+    atomic_array<uint64_t> words;
+};
+
+// Input or holding registers.
+//
+// The registers are grouped into blocks, each protected by a seqlock, so that
+// blocks of registers are read and written consistently. A value spanning
+// several registers is therefore never torn. A writer locks the blocks
+// covered by the write in ascending order, which makes the counters odd. A
+// reader never locks. It copies the registers, and repeats the copy if a
+// covered block was locked or its counter has changed meanwhile. As the
+// counters only grow, an unchanged sum of the counters proves that none of
+// them has changed.
+//
+// Writers only wait for other writers, for the duration of a copy. Readers
+// retry while a writer is copying, but never wait for a lock.
+class reg_table {
+public:
+    explicit reg_table(size_t n)
+            : n(n), regs(n), seqs(n / regs_per_block + 1) {}
+
+    size_t size() const { return n; }
+
+    uint16_t get(size_t i) const {
+        return regs[i].load(std::memory_order_acquire);
+    }
+
+    void set(size_t i, uint16_t val) {
+        lock(i, 1);
+        regs[i].store(val, std::memory_order_relaxed);
+        unlock(i, 1);
+    }
+
+    void get(size_t addr, std::span<uint16_t> dst) const {
+        if (dst.empty())
+            return;
+
+        for (unsigned spins = 0;; backoff(spins)) {
+            uint64_t sum;
+            if (!read_seqs(addr, dst.size(), sum))
+                continue;
+
+            for (size_t i = 0; i < dst.size(); ++i)
+                dst[i] = regs[addr + i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            uint64_t sum_after;
+            if (read_seqs(addr, dst.size(), sum_after) && (sum_after == sum))
+                return;
+        }
+    }
+
+    void set(size_t addr, std::span<const uint16_t> src) {
+        if (src.empty())
+            return;
+
+        lock(addr, src.size());
+        for (size_t i = 0; i < src.size(); ++i)
+            regs[addr + i].store(src[i], std::memory_order_relaxed);
+        unlock(addr, src.size());
+    }
+
+private:
+    static constexpr size_t regs_per_block{64};
+    static constexpr unsigned max_spins{64};
+
+    // Sums the counters of the blocks covered by the range. Returns false if
+    // a block is locked.
+    bool read_seqs(size_t addr, size_t cnt, uint64_t& sum) const {
+        sum = 0;
+        for (auto b = first_block(addr); b <= last_block(addr, cnt); ++b) {
+            auto seq = seqs[b].load(std::memory_order_acquire);
+            if (seq & 1)
+                return false;
+            sum += seq;
+        }
+        return true;
+    }
+
+    void lock(size_t addr, size_t cnt) {
+        for (auto b = first_block(addr); b <= last_block(addr, cnt); ++b) {
+            auto& seq = seqs[b];
+            auto s = seq.load(std::memory_order_relaxed);
+            for (unsigned spins = 0; (s & 1) ||
+                    !seq.compare_exchange_weak(s, s + 1,
+                            std::memory_order_acquire,
+                            std::memory_order_relaxed);
+                    backoff(spins))
+                s = seq.load(std::memory_order_relaxed);
+        }
+        // The odd counters must be visible before any register is modified.
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void unlock(size_t addr, size_t cnt) {
+        for (auto b = first_block(addr); b <= last_block(addr, cnt); ++b)
+            seqs[b].fetch_add(1, std::memory_order_release);
+    }
+
+    // Spins for a while, then yields, in case the writer has been preempted.
+    static void backoff(unsigned& spins) {
+        if (++spins < max_spins) {
+            cpu_relax();
+        } else {
+            spins = 0;
+            std::this_thread::yield();
+        }
+    }
+
+    static size_t first_block(size_t addr) { return addr / regs_per_block; }
+
+    static size_t last_block(size_t addr, size_t cnt) {
+        return (addr + cnt - 1) / regs_per_block;
+    }
+
+    size_t n;
+    atomic_array<uint16_t> regs;
+    atomic_array<uint64_t> seqs;
+};
+
+class register_map_backend::impl {
+public:
+    impl(size_t n_coils, size_t n_discrete_inputs, size_t n_input_registers,
+            size_t n_holding_registers)
+            : coils(n_coils), discrete_inputs(n_discrete_inputs),
+              input_registers(n_input_registers),
+              holding_registers(n_holding_registers) {}
+
+    bit_table coils;
+    bit_table discrete_inputs;
+    reg_table input_registers;
+    reg_table holding_registers;
+};
+
+register_map_backend::register_map_backend(size_t n_coils,
+        size_t n_discrete_inputs, size_t n_input_registers,
+        size_t n_holding_registers) {
+    validate_argument(n_coils <= max_table_size, "n_coils");
+    validate_argument(n_discrete_inputs <= max_table_size, "n_discrete_inputs");
+    validate_argument(n_input_registers <= max_table_size, "n_input_registers");
+    validate_argument(
+            n_holding_registers <= max_table_size, "n_holding_registers");
+
+    pimpl = std::make_unique<impl>(n_coils, n_discrete_inputs,
+            n_input_registers, n_holding_registers);
+}
+
+register_map_backend::~register_map_backend() = default;
+
+size_t register_map_backend::coil_count() const noexcept {
+    return pimpl->coils.size();
+}
+
+size_t register_map_backend::discrete_input_count() const noexcept {
+    return pimpl->discrete_inputs.size();
+}
+
+size_t register_map_backend::input_register_count() const noexcept {
+    return pimpl->input_registers.size();
+}
+
+size_t register_map_backend::holding_register_count() const noexcept {
+    return pimpl->holding_registers.size();
+}
+
+static void validate_range(size_t addr, size_t cnt, size_t size) {
+    validate_argument(in_range(addr, cnt, size),
+            "register_map_backend: address out of range");
+}
+
+bool register_map_backend::get_coil(unsigned addr) const {
+    validate_range(addr, 1, pimpl->coils.size());
+    return pimpl->coils.get(addr);
+}
+
+void register_map_backend::set_coil(unsigned addr, bool val) {
+    validate_range(addr, 1, pimpl->coils.size());
+    pimpl->coils.set(addr, val);
+}
+
+void register_map_backend::get_coils(unsigned addr, bit_span bits) const {
+    validate_range(addr, bits.size(), pimpl->coils.size());
+    pimpl->coils.get(addr, bits);
+}
+
+void register_map_backend::set_coils(unsigned addr, const_bit_span bits) {
+    validate_range(addr, bits.size(), pimpl->coils.size());
+    pimpl->coils.set(addr, bits);
+}
+
+bool register_map_backend::get_discrete_input(unsigned addr) const {
+    validate_range(addr, 1, pimpl->discrete_inputs.size());
+    return pimpl->discrete_inputs.get(addr);
+}
+
+void register_map_backend::set_discrete_input(unsigned addr, bool val) {
+    validate_range(addr, 1, pimpl->discrete_inputs.size());
+    pimpl->discrete_inputs.set(addr, val);
+}
+
+void register_map_backend::get_discrete_inputs(
+        unsigned addr, bit_span bits) const {
+    validate_range(addr, bits.size(), pimpl->discrete_inputs.size());
+    pimpl->discrete_inputs.get(addr, bits);
+}
+
+void register_map_backend::set_discrete_inputs(
+        unsigned addr, const_bit_span bits) {
+    validate_range(addr, bits.size(), pimpl->discrete_inputs.size());
+    pimpl->discrete_inputs.set(addr, bits);
+}
+
+uint16_t register_map_backend::get_input_register(unsigned addr) const {
+    validate_range(addr, 1, pimpl->input_registers.size());
+    return pimpl->input_registers.get(addr);
+}
+
+void register_map_backend::set_input_register(unsigned addr, uint16_t val) {
+    validate_range(addr, 1, pimpl->input_registers.size());
+    pimpl->input_registers.set(addr, val);
+}
+
+void register_map_backend::get_input_registers(
+        unsigned addr, std::span<uint16_t> regs) const {
+    validate_range(addr, regs.size(), pimpl->input_registers.size());
+    pimpl->input_registers.get(addr, regs);
+}
+
+void register_map_backend::set_input_registers(
+        unsigned addr, std::span<const uint16_t> regs) {
+    validate_range(addr, regs.size(), pimpl->input_registers.size());
+    pimpl->input_registers.set(addr, regs);
+}
+
+uint16_t register_map_backend::get_holding_register(unsigned addr) const {
+    validate_range(addr, 1, pimpl->holding_registers.size());
+    return pimpl->holding_registers.get(addr);
+}
+
+void register_map_backend::set_holding_register(unsigned addr, uint16_t val) {
+    validate_range(addr, 1, pimpl->holding_registers.size());
+    pimpl->holding_registers.set(addr, val);
+}
+
+void register_map_backend::get_holding_registers(
+        unsigned addr, std::span<uint16_t> regs) const {
+    validate_range(addr, regs.size(), pimpl->holding_registers.size());
+    pimpl->holding_registers.get(addr, regs);
+}
+
+void register_map_backend::set_holding_registers(
+        unsigned addr, std::span<const uint16_t> regs) {
+    validate_range(addr, regs.size(), pimpl->holding_registers.size());
+    pimpl->holding_registers.set(addr, regs);
+}
+
+errc register_map_backend::read_coils_span(unsigned addr, bit_span bits) {
+    if (!in_range(addr, bits.size(), pimpl->coils.size()))
+        return errc::modbus_exception_illegal_data_address;
+    pimpl->coils.get(addr, bits);
+    return errc::none;
+}
+
+errc register_map_backend::read_discrete_inputs_span(
+        unsigned addr, bit_span bits) {
+    if (!in_range(addr, bits.size(), pimpl->discrete_inputs.size()))
+        return errc::modbus_exception_illegal_data_address;
+    pimpl->discrete_inputs.get(addr, bits);
+    return errc::none;
+}
+
+errc register_map_backend::read_holding_registers_span(
+        unsigned addr, std::span<uint16_t> regs) {
+    if (!in_range(addr, regs.size(), pimpl->holding_registers.size()))
+        return errc::modbus_exception_illegal_data_address;
+    pimpl->holding_registers.get(addr, regs);
+    return errc::none;
+}
+
+errc register_map_backend::read_input_registers_span(
+        unsigned addr, std::span<uint16_t> regs) {
+    if (!in_range(addr, regs.size(), pimpl->input_registers.size()))
+        return errc::modbus_exception_illegal_data_address;
+    pimpl->input_registers.get(addr, regs);
+    return errc::none;
+}
+
+errc register_map_backend::write_coils_span(
+        unsigned addr, const_bit_span bits) {
+    if (!in_range(addr, bits.size(), pimpl->coils.size()))
+        return errc::modbus_exception_illegal_data_address;
+    pimpl->coils.set(addr, bits);
+    return errc::none;
+}
+
+errc register_map_backend::write_holding_registers_span(
+        unsigned addr, std::span<const uint16_t> regs) {
+    if (!in_range(addr, regs.size(), pimpl->holding_registers.size()))
+        return errc::modbus_exception_illegal_data_address;
+    pimpl->holding_registers.set(addr, regs);
+    return errc::none;
+}
+
+errc register_map_backend::write_read_holding_registers_span(unsigned addr_wr,
+        std::span<const uint16_t> regs_wr, unsigned addr_rd,
+        std::span<uint16_t> regs_rd) {
+    auto& regs = pimpl->holding_registers;
+    if (!in_range(addr_wr, regs_wr.size(), regs.size()) ||
+            !in_range(addr_rd, regs_rd.size(), regs.size()))
+        return errc::modbus_exception_illegal_data_address;
+    regs.set(addr_wr, regs_wr);
+    regs.get(addr_rd, regs_rd);
+    return errc::none;
+}
+
+} // namespace mboxid
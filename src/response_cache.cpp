@@ -0,0 +1,180 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstring>
+#include <utility>
+#include "byteorder.hpp"
+#include "modbus_protocol_server.hpp"
+#include "response_cache.hpp"
+
+namespace mboxid {
+
+struct alignas(64) response_cache::slot {
+    std::mutex mtx;
+    uint64_t key = 0; // 0 if empty, as there is no function code 0
+    uint64_t gen = 0;
+    clock::time_point ts;
+    size_t size = 0;
+    uint8_t rsp[max_pdu_size]; // NOLINT(*-pro-type-member-init)
+};
+
+// A maximum staleness of no_timeout would overflow the clock's duration.
+static response_cache::clock::duration to_clock_duration(milliseconds to) {
+    if (to == no_timeout)
+        return response_cache::clock::duration::max();
+    return std::chrono::duration_cast<response_cache::clock::duration>(to);
+}
+
+response_cache::response_cache(milliseconds max_staleness)
+        : max_staleness(to_clock_duration(max_staleness)),
+          slots(std::make_unique<slot[]>(n_slots)),
+          coil_gens(std::make_unique<std::atomic<uint64_t>[]>(n_coil_blocks)),
+          register_gens(std::make_unique<std::atomic<uint64_t>[]>(
+                  n_register_blocks)) {}
+
+response_cache::~response_cache() = default;
+
+void response_cache::clear() {
+    for (size_t i = 0; i < n_slots; ++i) {
+        std::lock_guard lk(slots[i].mtx);
+        slots[i].key = 0;
+    }
+}
+
+auto response_cache::parse_read(unsigned unit_id, std::span<const uint8_t> req)
+        -> read_request {
+    read_request read;
+
+    // Invalid requests are left to the server engine.
+    read.key = read_request_key(unit_id, req);
+    if (!read.key)
+        return read;
+
+    read.cacheable = true;
+    read.addr = (read.key >> 16) & 0xffffU;
+    read.cnt = read.key & 0xffffU;
+
+    auto fc = static_cast<function_code>((read.key >> 32) & 0xffU);
+    if (fc == function_code::read_coils)
+        read.tbl = table::coils;
+    else if (fc == function_code::read_holding_registers)
+        read.tbl = table::holding_registers;
+    return read;
+}
+
+auto response_cache::parse_write(std::span<const uint8_t> req)
+        -> write_request {
+    write_request write;
+
+    if (req.size() < write_coil_req_size)
+        return write;
+
+    function_code fc;
+    auto* p = req.data();
+    p += fetch8(fc, p);
+    p += fetch16_be(write.addr, p);
+
+    size_t max_cnt = 1;
+    switch (fc) {
+    case function_code::write_single_coil:
+        write.tbl = table::coils;
+        write.cnt = 1;
+        break;
+    case function_code::write_single_register:
+        [[fallthrough]];
+    case function_code::mask_write_register:
+        write.tbl = table::holding_registers;
+        write.cnt = 1;
+        break;
+    case function_code::write_multiple_coils:
+        write.tbl = table::coils;
+        fetch16_be(write.cnt, p);
+        max_cnt = max_write_coils;
+        break;
+    case function_code::write_multiple_registers:
+        write.tbl = table::holding_registers;
+        fetch16_be(write.cnt, p);
+        max_cnt = max_write_registers;
+        break;
+    case function_code::read_write_multiple_registers:
+        if (req.size() < read_write_multiple_registers_req_min_size)
+            return {};
+        p += sizeof(uint16_t); // read count, after the read address
+        p += fetch16_be(write.addr, p);
+        fetch16_be(write.cnt, p);
+        write.tbl = table::holding_registers;
+        max_cnt = max_rdwr_write_registers;
+        break;
+    default:
+        return {};
+    }
+
+    // Invalid requests don't reach the backend.
+    if ((write.cnt > max_cnt) || (write.addr + write.cnt > 0x10000))
+        return {};
+    return write;
+}
+
+size_t response_cache::lookup(read_request& read, std::span<uint8_t> rsp) {
+    read.gen = generation(read.tbl, read.addr, read.cnt);
+    read.ts = clock::now();
+
+    auto& s = slots[(read.key * 0x9e3779b97f4a7c15ULL) >> 56];
+    std::lock_guard lk(s.mtx);
+
+    if ((s.key != read.key) || (s.gen != read.gen) ||
+            (read.ts - s.ts > max_staleness) || (rsp.size() < s.size))
+        return 0;
+
+    std::memcpy(rsp.data(), s.rsp, s.size);
+    return s.size;
+}
+
+void response_cache::store(
+        const read_request& read, std::span<const uint8_t> rsp) {
+    auto exception = static_cast<uint8_t>(function_code::exception);
+    if (rsp.empty() || (rsp[0] & exception))
+        return;
+
+    auto& s = slots[(read.key * 0x9e3779b97f4a7c15ULL) >> 56];
+    std::lock_guard lk(s.mtx);
+
+    s.key = read.key;
+    s.gen = read.gen;
+    s.ts = read.ts;
+    s.size = rsp.size();
+    std::memcpy(s.rsp, rsp.data(), rsp.size());
+}
+
+void response_cache::invalidate(const write_request& write) {
+    auto [gens, shift] = (write.tbl == table::coils)
+            ? std::pair(coil_gens.get(), coil_block_shift)
+            : std::pair(register_gens.get(), register_block_shift);
+
+    auto first = write.addr >> shift;
+    auto last = (write.addr + write.cnt - 1) >> shift;
+    for (auto b = first; b <= last; ++b)
+        gens[b].fetch_add(1, std::memory_order_release);
+}
+
+// Sums the generation counters of the blocks covered by the range. Discrete
+// inputs and input registers are not written by clients, so their
+// generation is always zero.
+uint64_t response_cache::generation(
+        table tbl, unsigned addr, size_t cnt) const {
+    if (tbl == table::none)
+        return 0;
+
+    auto [gens, shift] = (tbl == table::coils)
+            ? std::pair(coil_gens.get(), coil_block_shift)
+            : std::pair(register_gens.get(), register_block_shift);
+
+    uint64_t sum = 0;
+    auto first = addr >> shift;
+    auto last = (addr + cnt - 1) >> shift;
+    for (auto b = first; b <= last; ++b)
+        sum += gens[b].load(std::memory_order_acquire);
+    return sum;
+}
+
+} // namespace mboxid
@@ -0,0 +1,142 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_RESPONSE_CACHE_HPP
+#define LIBMBOXID_RESPONSE_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <mboxid/common.hpp>
+#include <mboxid/error.hpp>
+#include "modbus_protocol_common.hpp"
+
+namespace mboxid {
+
+/**
+ * Cache of the responses to read requests of a backend.
+ *
+ * Clients such as HMIs and historians poll the same ranges over and over.
+ * The cache keeps the response PDUs to the read requests (function codes 1
+ * to 4) keyed by unit id, function code, address and count, so that a
+ * repeated poll is answered with a copy of the previous response. Exception
+ * responses are not cached.
+ *
+ * An entry expires once it is older than the maximum staleness. Write
+ * requests executed through the cache invalidate the entries of overlapping
+ * ranges of coils or holding registers, regardless of the unit id, as the
+ * backend does not distinguish units. Updates the application makes to the
+ * backend directly are only seen once the entries have expired.
+ *
+ * To this end, the address space of coils and holding registers is divided
+ * into blocks with a generation counter each, incremented by the writes to
+ * the block. An entry records the sum of the counters of its range, read
+ * before the backend is invoked, and is valid only as long as the sum has
+ * not changed. As the counters only grow, a write to the range, even a
+ * concurrent one, thereby invalidates the entry.
+ *
+ * The entries are held in a fixed number of slots, each guarded by its own
+ * mutex. A range is always cached in the same slot, replacing the entry of
+ * another range mapped to the slot.
+ *
+ * The cache is used by the threads serving the connections, by the worker
+ * threads and by the threads of asynchronous backends executing deferred
+ * requests. All methods are thread-safe.
+ */
+class response_cache {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit response_cache(milliseconds max_staleness);
+    response_cache(const response_cache&) = delete;
+    response_cache& operator=(const response_cache&) = delete;
+    ~response_cache();
+
+    /*
+     * Executes the request PDU \a req addressed to \a unit_id, storing the
+     * response PDU in \a rsp and its size in \a rsp_size. Cached responses
+     * are copied, all other requests are passed to \a execute(req, rsp,
+     * rsp_size), whose result is returned.
+     */
+    template <typename F>
+    errc execute(unsigned unit_id, std::span<const uint8_t> req,
+            std::span<uint8_t> rsp, size_t& rsp_size, F&& execute) {
+        auto read = parse_read(unit_id, req);
+        if (read.cacheable) {
+            if ((rsp_size = lookup(read, rsp)))
+                return errc::none;
+            auto res = execute(req, rsp, rsp_size);
+            if (res == errc::none)
+                store(read, rsp.first(rsp_size));
+            return res;
+        }
+
+        auto write = parse_write(req);
+        if (!write.cnt)
+            return execute(req, rsp, rsp_size);
+
+        // The entries are invalidated after the backend has been modified,
+        // so that none of them can be refilled with the old data. Requests
+        // which failed may have modified the backend as well.
+        errc res;
+        try {
+            res = execute(req, rsp, rsp_size);
+        } catch (...) {
+            invalidate(write);
+            throw;
+        }
+        invalidate(write);
+        return res;
+    }
+
+    // Removes all entries.
+    void clear();
+
+private:
+    struct slot;
+
+    // Address space of the objects written by clients.
+    enum class table { coils, holding_registers, none };
+
+    struct read_request {
+        bool cacheable = false;
+        uint64_t key = 0;
+        table tbl = table::none;
+        unsigned addr = 0;
+        size_t cnt = 0;
+        uint64_t gen = 0;
+        clock::time_point ts;
+    };
+
+    struct write_request {
+        table tbl = table::none;
+        unsigned addr = 0;
+        size_t cnt = 0;
+    };
+
+    static constexpr size_t n_slots{256};
+    static constexpr unsigned coil_block_shift{8};
+    static constexpr unsigned register_block_shift{4};
+    static constexpr size_t n_coil_blocks{0x10000 >> coil_block_shift};
+    static constexpr size_t n_register_blocks{0x10000 >> register_block_shift};
+
+    const clock::duration max_staleness;
+    std::unique_ptr<slot[]> slots;
+    std::unique_ptr<std::atomic<uint64_t>[]> coil_gens;
+    std::unique_ptr<std::atomic<uint64_t>[]> register_gens;
+
+    static read_request parse_read(
+            unsigned unit_id, std::span<const uint8_t> req);
+    static write_request parse_write(std::span<const uint8_t> req);
+
+    size_t lookup(read_request& read, std::span<uint8_t> rsp);
+    void store(const read_request& read, std::span<const uint8_t> rsp);
+    void invalidate(const write_request& write);
+    uint64_t generation(table tbl, unsigned addr, size_t cnt) const;
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_RESPONSE_CACHE_HPP
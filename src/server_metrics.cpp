@@ -0,0 +1,97 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <mboxid/server_metrics.hpp>
+#include "metrics_recorder.hpp"
+
+namespace mboxid {
+
+uint64_t latency_histogram::lower_bound(unsigned index) {
+    if (index < sub_buckets)
+        return index;
+    unsigned e = index / sub_buckets + 3;
+    uint64_t sub = index % sub_buckets;
+    return (sub_buckets + sub) << (e - 4);
+}
+
+uint64_t latency_histogram::upper_bound(unsigned index) {
+    return lower_bound(index + 1) - 1;
+}
+
+uint64_t latency_histogram::count() const {
+    return std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+}
+
+std::chrono::nanoseconds latency_histogram::quantile(double q) const {
+    auto total = count();
+    if (!total)
+        return std::chrono::nanoseconds::zero();
+
+    auto rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) *
+            static_cast<double>(total)));
+    rank = std::max(rank, uint64_t{1});
+
+    uint64_t cnt = 0;
+    unsigned i = 0;
+    for (; i < n_buckets - 1; ++i) {
+        cnt += counts[i];
+        if (cnt >= rank)
+            break;
+    }
+    return std::chrono::nanoseconds(upper_bound(i));
+}
+
+latency_histogram& latency_histogram::operator+=(
+        const latency_histogram& other) {
+    for (unsigned i = 0; i < n_buckets; ++i)
+        counts[i] += other.counts[i];
+    return *this;
+}
+
+uint64_t server_metrics::total_requests() const {
+    return std::accumulate(requests.begin(), requests.end(), uint64_t{0});
+}
+
+uint64_t server_metrics::total_exceptions() const {
+    return std::accumulate(exceptions.begin(), exceptions.end(), uint64_t{0});
+}
+
+server_metrics& server_metrics::operator+=(const server_metrics& other) {
+    for (size_t i = 0; i < requests.size(); ++i) {
+        requests[i] += other.requests[i];
+        exceptions[i] += other.exceptions[i];
+    }
+    bytes_received += other.bytes_received;
+    bytes_sent += other.bytes_sent;
+    connections_accepted += other.connections_accepted;
+    connections_denied += other.connections_denied;
+    connections_closed += other.connections_closed;
+    idle_timeouts += other.idle_timeouts;
+    request_complete_timeouts += other.request_complete_timeouts;
+    processing_time += other.processing_time;
+    backend_time += other.backend_time;
+    return *this;
+}
+
+void metrics_recorder::read(server_metrics& m) const {
+    for (size_t i = 0; i < requests.size(); ++i) {
+        m.requests[i] += requests[i].get();
+        m.exceptions[i] += exceptions[i].get();
+    }
+    m.bytes_received += bytes_received.get();
+    m.bytes_sent += bytes_sent.get();
+    m.connections_accepted += connections_accepted.get();
+    m.connections_denied += connections_denied.get();
+    m.connections_closed += connections_closed.get();
+    m.idle_timeouts += idle_timeouts.get();
+    m.request_complete_timeouts += request_complete_timeouts.get();
+    for (unsigned i = 0; i < latency_histogram::n_buckets; ++i) {
+        m.processing_time.counts[i] += processing_time[i].get();
+        m.backend_time.counts[i] += backend_time[i].get();
+    }
+}
+
+} // namespace mboxid
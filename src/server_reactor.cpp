@@ -0,0 +1,806 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <span>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <linux/sock_diag.h>
+#include "error_private.hpp"
+#include "logger_private.hpp"
+#include "modbus_protocol_common.hpp"
+#include "modbus_protocol_server.hpp"
+#include "frame_buffer.hpp"
+#include "server_reactor.hpp"
+
+namespace mboxid {
+
+constexpr std::chrono::milliseconds backend_ticker_period{1000};
+constexpr std::chrono::milliseconds listen_monitor_period{1000};
+
+// The id of a client is the key of its slot in the connection table. The
+// index of the reactor serving the client is stored in bits 24..31 of the
+// slot index, which leaves room for 2^24 connections per reactor. Thereby,
+// requests concerning a client can be routed to its reactor without lookup.
+constexpr unsigned reactor_index_shift{24};
+constexpr uint64_t reactor_index_mask{uint64_t{0xff} << reactor_index_shift};
+
+static_assert(server_reactor::max_reactors <=
+        (reactor_index_mask >> reactor_index_shift) + 1);
+
+// Without the tracing hooks, the code recording traces is discarded.
+#ifdef MBOXID_ENABLE_TRACING
+constexpr bool tracing_enabled{true};
+#else
+constexpr bool tracing_enabled{false};
+#endif
+
+using trace_ptr = std::unique_ptr<modbus_tcp_server::request_trace>;
+
+// Read requests may be coalesced, all other requests may modify the data.
+static bool is_read_function(uint8_t fc) {
+    return (fc >= 0x01) && (fc <= 0x04);
+}
+
+// NOLINTNEXTLINE(*-pro-type-member-init)
+struct server_reactor::client_control_block : io_connection {
+    net::endpoint_addr addr;
+
+    frame_buffer rx;
+    mbap_header req_header;
+    std::span<const uint8_t> req;
+
+    // Requests submitted to an asynchronous backend, in the order of their
+    // arrival. Their responses are moved to tx_queued in the same order.
+    struct transaction {
+        uint64_t seq;
+        mbap_header header;
+        uint8_t function_code;
+        timestamp received;
+        completion_queue::entry result; // set when completed
+        trace_ptr trace;
+    };
+    std::deque<transaction> pending;
+    uint64_t next_seq = 0;
+
+    // Responses are collected in tx_queued while the engine sends the ones
+    // in tx_sending, see io_connection. Both buffers keep their capacity
+    // when cleared.
+    std::vector<uint8_t> tx_queued;
+    unsigned n_sending = 0;
+    unsigned n_queued = 0;
+
+    // The trace of a sampled request follows the request through the
+    // pending transactions to the queued and the sending responses.
+    trace_ptr trace;
+    std::vector<trace_ptr> traces_queued;
+    std::vector<trace_ptr> traces_sending;
+    timestamp rx_first; // reception of the first byte in rx
+    timestamp rx_last;  // last reception
+
+    timer_wheel::timer idle_timer;
+    timer_wheel::timer request_complete_timer;
+};
+
+/// Returns timestamp representing the current point in time.
+static auto now() { return std::chrono::steady_clock::now(); }
+
+server_reactor::server_reactor(unsigned index, const server_config& config)
+        : index(index), config(config), ts_now(now()), timers(ts_now) {
+    if (auto fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK); fd == -1)
+        throw system_error(errno, "eventfd");
+    else
+        cmd_event_fd.reset(fd);
+
+    // Completions share the eventfd with commands.
+    completions = std::make_shared<completion_queue>(cmd_event_fd.get());
+
+    backend_ticker.set_callback([this]() {
+        backend->ticker();
+        timers.arm(backend_ticker, ts_now + backend_ticker_period);
+    });
+
+    listen_monitor.set_callback([this]() {
+        sample_listen_drops();
+        timers.arm(listen_monitor, ts_now + listen_monitor_period);
+    });
+}
+
+server_reactor::~server_reactor() { completions->close(); }
+
+void server_reactor::set_backend(backend_connector* backend_, bool ticker) {
+    backend = backend_;
+    async_backend = dynamic_cast<async_backend_connector*>(backend_);
+    ticker_enabled = ticker;
+}
+
+void server_reactor::set_workers(
+        worker_pool* pool, const offload_table& offloaded_) {
+    workers = pool;
+    offloaded = offloaded_;
+}
+
+void server_reactor::set_backend_state(std::shared_ptr<backend_state> state) {
+    backend_st = std::move(state);
+}
+
+unsigned server_reactor::reactor_index(client_id id) {
+    return (id & reactor_index_mask) >> reactor_index_shift;
+}
+
+void server_reactor::run(bool reuse_port) {
+    engine = make_io_engine(config.transport, *this);
+    completions->open();
+
+    // The engine may be bound to the thread executing run(), so it is
+    // released before run() returns. Requests completed afterwards are
+    // dropped.
+    try {
+        serve(reuse_port);
+    } catch (...) {
+        completions->close();
+        engine.reset();
+        throw;
+    }
+    completions->close();
+    engine.reset();
+}
+
+void server_reactor::serve(bool reuse_port) {
+    engine->add_wakeup_fd(cmd_event_fd.get());
+    passive_open(reuse_port);
+
+    ts_now = now();
+    if (ticker_enabled)
+        timers.arm(backend_ticker, ts_now + backend_ticker_period);
+    timers.arm(listen_monitor, ts_now + listen_monitor_period);
+
+    while (!stop_fl) {
+        engine->wait(timers.poll_timeout(ts_now));
+        ts_now = now();
+        engine->dispatch();
+        process_completions();
+        timers.advance(ts_now);
+        close_expired_clients();
+    }
+}
+
+void server_reactor::shutdown() {
+    {
+        std::lock_guard m(cmd_queue_mutex);
+        cmd_queue.emplace_back(cmd_stop());
+    }
+    trigger_command_processing();
+}
+
+void server_reactor::close_client_connection(client_id id) {
+    {
+        std::lock_guard m(cmd_queue_mutex);
+        cmd_queue.emplace_back(cmd_close_connection{id});
+    }
+    trigger_command_processing();
+}
+
+void server_reactor::trigger_command_processing() {
+    if (eventfd_write(cmd_event_fd.get(), 1) == -1)
+        throw system_error(errno, "eventfd_write");
+}
+
+void server_reactor::on_wakeup() { process_commands(); }
+
+void server_reactor::process_commands() {
+    // consume trigger event(s)
+    eventfd_t cnt;
+    if ((eventfd_read(cmd_event_fd.get(), &cnt) == -1) && (errno != EAGAIN))
+        throw system_error(errno, "eventfd_read");
+
+    // take ownership of queued commands
+    std::deque<cmd_queue_entry> cmds;
+    {
+        std::lock_guard m(cmd_queue_mutex);
+        std::swap(cmd_queue, cmds);
+    }
+
+    // process all queued commands
+    for (const auto& cmd : cmds) {
+        if (std::holds_alternative<cmd_stop>(cmd))
+            stop_fl = true;
+        else if (std::holds_alternative<cmd_close_connection>(cmd)) {
+            close_client_by_id(std::get<cmd_close_connection>(cmd).id);
+        } else
+            throw mboxid_error(errc::logic_error, "process_commands");
+    }
+}
+
+void server_reactor::passive_open(bool reuse_port) {
+    const auto& own_addr = config.own_addr;
+    const char* host = own_addr.host.empty() ? nullptr : own_addr.host.c_str();
+    const char* service;
+
+    if (own_addr.service.empty())
+        service = config.use_tls ? secure_server_default_port
+                                 : server_default_port;
+    else
+        service = own_addr.service.c_str();
+
+    auto endpoints = resolve_endpoint(host, service, own_addr.ip_version,
+            net::endpoint_usage::passive_open);
+
+    for (const auto& ep : endpoints) {
+        unique_fd fd(socket(ep.family,
+                ep.socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ep.protocol));
+        auto fd_ = fd.get();
+
+        if (fd_ == -1)
+            throw system_error(errno, "socket");
+
+        int on = 1;
+        if (setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1)
+            throw system_error(errno, "setsockopt SO_REUSEADDR");
+
+        if (reuse_port &&
+                (setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) ==
+                        -1))
+            throw system_error(errno, "setsockopt SO_REUSEPORT");
+
+        if (bind(fd_, ep.addr.get(), ep.addrlen) == -1) {
+            auto msg = std::error_code(errno, std::system_category()).message();
+            auto ep_addr = net::to_endpoint_addr(ep.addr.get(), ep.addrlen);
+            log::error("bind to [{}]:{} failed: {}", ep_addr.host,
+                    ep_addr.service, msg);
+            continue;
+        }
+
+        if (listen(fd_, config.listen_backlog) == -1) {
+            auto msg = std::error_code(errno, std::system_category()).message();
+            auto ep_addr = net::to_endpoint_addr(ep.addr.get(), ep.addrlen);
+            log::error("listen on [{}]:{} failed: {}", ep_addr.host,
+                    ep_addr.service, msg);
+            continue;
+        }
+
+        engine->add_listener(fd_);
+        listen_fds.push_back(std::move(fd));
+    }
+
+    if (listen_fds.empty())
+        throw mboxid_error(
+                errc::passive_open_error, "failed to bind to any interface");
+
+    listen_drops.assign(listen_fds.size(), 0);
+}
+
+// The kernel counts the connection attempts a listening socket drops,
+// mainly because its accept queue is full, in the socket's drop counter.
+void server_reactor::sample_listen_drops() {
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < listen_fds.size(); ++i) {
+        uint32_t meminfo[SK_MEMINFO_VARS] = {};
+        socklen_t len = sizeof(meminfo);
+        if (getsockopt(listen_fds[i].get(), SOL_SOCKET, SO_MEMINFO, meminfo,
+                    &len) == -1)
+            throw system_error(errno, "getsockopt SO_MEMINFO");
+
+        auto drops = meminfo[SK_MEMINFO_DROPS];
+        total += drops - listen_drops[i];
+        listen_drops[i] = drops;
+    }
+
+    if (total) {
+        accept_overflows.fetch_add(total, std::memory_order_relaxed);
+        log::warning("accept queue overflow, {} connection attempt(s) dropped",
+                total);
+    }
+}
+
+uint64_t server_reactor::accept_queue_overflows() const {
+    return accept_overflows.load(std::memory_order_relaxed);
+}
+
+void server_reactor::read_metrics(server_metrics& m) const { stats.read(m); }
+
+void server_reactor::on_accept(
+        unique_fd fd, const sockaddr* addr, socklen_t addrlen) {
+    auto client = std::make_unique<client_control_block>();
+    client->fd = std::move(fd);
+    client->addr = net::to_endpoint_addr(addr, addrlen);
+
+    int on = 1;
+    if (setsockopt(client->fd.get(), IPPROTO_TCP, TCP_NODELAY, &on,
+                sizeof(on)) == -1)
+        throw system_error(errno, "setsockopt TCP_NODELAY");
+
+    // The client id is derived from the key of the slot the client control
+    // block is stored in. We reserve the slot upfront, and release it if the
+    // client is not authorized.
+    auto client_ = client.get();
+    auto key = clients.insert(std::move(client));
+    expects(!(key & reactor_index_mask), "connection table overflow");
+    client_->id = key | (static_cast<uint64_t>(index) << reactor_index_shift);
+
+    auto authorized =
+            backend->authorize(client_->id, client_->addr, addr, addrlen);
+
+    log::auth("client(id={:#x}) connecting from [{}]:{} {}", client_->id,
+            client_->addr.host, client_->addr.service,
+            authorized ? "accepted" : "denied");
+
+    if (authorized) {
+        stats.accepted();
+        engine->add_connection(*client_);
+
+        // Expired clients are closed after all timers have been processed,
+        // as closing a client destroys its timers.
+        client_->idle_timer.set_callback([this, client_]() {
+            log::info("client(id={:#x}) idle timeout expired", client_->id);
+            stats.idle_timeout();
+            expired_clients.push_back(client_->id);
+        });
+        client_->request_complete_timer.set_callback([this, client_]() {
+            log::info("client(id={:#x}) response complete timeout expired",
+                    client_->id);
+            stats.request_complete_timeout();
+            expired_clients.push_back(client_->id);
+        });
+        arm_timer(client_->idle_timer, config.idle_timeout);
+    } else {
+        stats.denied();
+        clients.erase(key);
+    }
+}
+
+auto server_reactor::find_client(client_id id) -> client_control_block* {
+    auto client = clients.find(id & ~reactor_index_mask);
+    return client ? client->get() : nullptr;
+}
+
+io_connection* server_reactor::find_connection(client_id id) {
+    return find_client(id);
+}
+
+void server_reactor::close_client_by_id(client_id id) {
+    auto client = find_client(id);
+
+    if (client) {
+        engine->remove_connection(*client);
+        clients.erase(id & ~reactor_index_mask);
+        backend->disconnect(id);
+        stats.closed();
+        log::auth("client(id={:#x}) disconnected", id);
+    } else
+        log::warning("close_client_by_id(): client(id={:#x}) not found", id);
+}
+
+void server_reactor::on_closed(io_connection& conn) {
+    close_client_by_id(conn.id);
+}
+
+void server_reactor::arm_timer(timer_wheel::timer& t, milliseconds to) {
+    if (to == no_timeout)
+        timers.cancel(t);
+    else
+        timers.arm(t, ts_now + to);
+}
+
+std::span<uint8_t> server_reactor::receive_buffer(io_connection& conn) {
+    return static_cast<client_control_block*>(&conn)->rx.space();
+}
+
+void server_reactor::on_received(io_connection& conn, size_t cnt) {
+    auto client = static_cast<client_control_block*>(&conn);
+    if constexpr (tracing_enabled) {
+        if (client->rx.empty())
+            client->rx_first = ts_now;
+        client->rx_last = ts_now;
+    }
+    client->rx.commit(cnt);
+    stats.received(cnt);
+    process_requests(client);
+}
+
+// Executes the requests received completely, as long as the number of
+// outstanding responses is below the pipeline depth, and passes their
+// responses to the engine.
+void server_reactor::process_requests(client_control_block* client) {
+    for (;;) {
+        while (client->n_sending + client->n_queued + client->pending.size() <
+                config.pipeline_depth) {
+            client->req = client->rx.next_frame(client->req_header);
+            if (client->req.empty()) {
+                if (client->rx.error() == errc::none)
+                    break;
+                reject_malformed_request(client, client->rx.error_message());
+                return;
+            }
+
+            stats.request(client->req[mbap_header_size]);
+            if constexpr (tracing_enabled) {
+                if (config.tracer)
+                    start_trace(client);
+            }
+            backend->alive(client->id);
+            arm_timer(client->idle_timer, config.idle_timeout);
+            if (config.coalesce_reads &&
+                    !is_read_function(client->req[mbap_header_size]))
+                ++write_epoch;
+            if (async_backend)
+                submit_request(client);
+            else if (workers &&
+                    (!client->pending.empty() ||
+                            offloaded[client->req[mbap_header_size]]))
+                offload_request(client);
+            else if (!execute_request(client))
+                return;
+        }
+
+        if (!collect_responses(client))
+            return;
+        if (client->n_sending || !client->n_queued)
+            break;
+
+        std::swap(client->tx_sending, client->tx_queued);
+        std::swap(client->traces_sending, client->traces_queued);
+        client->n_sending = client->n_queued;
+        client->n_queued = 0;
+        if (!engine->send(*client, client->tx_sending))
+            break;
+        complete_responses(client);
+    }
+
+    update_client_state(client);
+}
+
+// Starts the trace of the current request if it is sampled.
+void server_reactor::start_trace(client_control_block* client) {
+    // The bytes left in the receive buffer have arrived by the last
+    // reception at the latest.
+    auto first_byte = client->rx_first;
+    client->rx_first = client->rx_last;
+
+    if (--trace_countdown)
+        return;
+    trace_countdown = config.trace_interval;
+
+    auto t = std::make_unique<modbus_tcp_server::request_trace>();
+    t->client = client->id;
+    t->transaction_id = client->req_header.transaction_id;
+    t->unit_id = client->req_header.unit_id;
+    t->function_code = client->req[mbap_header_size];
+    t->first_byte_received = first_byte;
+    t->frame_complete = now();
+    client->trace = std::move(t);
+}
+
+// Passes the traces of the responses sent to the tracer.
+void server_reactor::finish_traces(client_control_block* client) {
+    auto ts = now();
+    for (auto& t : client->traces_sending) {
+        t->response_sent = ts;
+        config.tracer(*t);
+    }
+    client->traces_sending.clear();
+}
+
+// As TCP provides a reliable point to point connection we consider every
+// parse error as serious failure. We close the connection to discard possible
+// corrupted data in-flight and force the client to reconnect.
+void server_reactor::reject_malformed_request(
+        client_control_block* client, const char* what) {
+    log::error("client(id={:#x}) request: {}", client->id, what);
+    close_client_by_id(client->id);
+}
+
+void server_reactor::update_client_state(client_control_block* client) {
+    // The request complete timer runs from the first byte of a request until
+    // its response has been sent.
+    if (!client->n_sending && !client->n_queued && client->pending.empty() &&
+            client->rx.empty())
+        timers.cancel(client->request_complete_timer);
+    else if (!client->request_complete_timer.armed())
+        arm_timer(client->request_complete_timer,
+                config.request_complete_timeout);
+
+    // Receiving stops while the receive buffer is full, i.e. while requests
+    // are waiting for the pipeline to drain. Otherwise, requests and
+    // responses are transferred concurrently.
+    if (client->rx.full() != client->rx_paused) {
+        if (client->rx_paused)
+            engine->resume_receive(*client);
+        else
+            engine->pause_receive(*client);
+    }
+}
+
+// Appends a response to the buffer \a tx. The PDU is stored by \a make_pdu,
+// which returns its size.
+static void append_response(
+        std::vector<uint8_t>& tx, mbap_header header, auto make_pdu) {
+    auto offs = tx.size();
+    tx.resize(offs + max_adu_size);
+
+    auto rsp = std::span(tx).subspan(offs);
+    size_t cnt = make_pdu(rsp.subspan(mbap_header_size));
+    header.length = cnt + sizeof(header.unit_id);
+    cnt += serialize_mbap_header(rsp.subspan(0, mbap_header_size), header);
+
+    tx.resize(offs + cnt);
+}
+
+// Executes the current request and appends its response to the queued
+// responses. Returns false if the connection has been closed due to a
+// malformed request.
+bool server_reactor::execute_request(client_control_block* client) {
+    auto res = errc::none;
+    auto offs = client->tx_queued.size();
+    bool timed = config.latency_histograms || client->trace;
+    timestamp start, end;
+    append_response(client->tx_queued, client->req_header, [&](auto pdu) {
+        size_t cnt = 0;
+        if (timed)
+            start = now();
+        res = server_engine(*backend, backend_st.get(),
+                client->req_header.unit_id,
+                client->req.subspan(mbap_header_size), pdu, cnt);
+        if (timed)
+            end = now();
+        return cnt;
+    });
+
+    if (res != errc::none) {
+        client->tx_queued.resize(offs);
+        if (res != errc::parse_error)
+            throw mboxid_error(res, "backend failed request");
+        reject_malformed_request(client, "malformed request");
+        return false;
+    }
+
+    if (client->tx_queued[offs + mbap_header_size] & 0x80)
+        stats.exception(client->req[mbap_header_size]);
+    if (config.latency_histograms) {
+        // The request has been received in the current iteration of the run
+        // loop, or is executed as soon as the pipeline has room for it.
+        stats.processing(end - ts_now);
+        stats.backend(end - start);
+    }
+    if (client->trace) {
+        client->trace->backend_entered = start;
+        client->trace->backend_returned = end;
+        client->traces_queued.push_back(std::move(client->trace));
+    }
+
+    ++client->n_queued;
+    return true;
+}
+
+// Creates a deferred request for the current request and adds it to the
+// pending requests of the client.
+auto server_reactor::make_deferred_request(client_control_block* client)
+        -> completion_queue::entry {
+    auto pdu = client->req.subspan(mbap_header_size);
+    auto st = std::make_unique<deferred_request::state>();
+    st->queue = completions;
+    st->client = client->id;
+    st->seq = client->next_seq++;
+    st->backend_st = backend_st;
+    st->unit_id = client->req_header.unit_id;
+    std::memcpy(st->req, pdu.data(), pdu.size());
+    st->req_size = pdu.size();
+    st->timed = config.latency_histograms || client->trace;
+
+    client->pending.push_back({st->seq, client->req_header, pdu[0], ts_now,
+            nullptr, std::move(client->trace)});
+    return st;
+}
+
+// Hands the current request over to the asynchronous backend.
+void server_reactor::submit_request(client_control_block* client) {
+    if (join_outstanding_read(client))
+        return;
+    async_backend->submit(deferred_request(make_deferred_request(client)));
+}
+
+// Hands the current request over to a worker. All requests of a client are
+// assigned to the same worker, which executes them in order.
+void server_reactor::offload_request(client_control_block* client) {
+    if (join_outstanding_read(client))
+        return;
+    workers->submit(client->id, {make_deferred_request(client), backend});
+}
+
+// If read coalescing is enabled and an identical read request is already
+// outstanding, the current request waits for its response, and true is
+// returned. Otherwise, the current request is registered as outstanding if
+// it is a read request, and false is returned.
+//
+// The response of the outstanding request may have been read from the
+// backend before the current request arrived, which is why coalescing is
+// optional. However, a client must never see data older than its own
+// writes. Therefore, a read is not coalesced while the client has a write
+// pending, which may be executed after the outstanding read, and it does
+// not join a read which was outstanding before a write has been received or
+// completed. Such a read is replaced by the current request, so that later
+// requests coalesce again.
+bool server_reactor::join_outstanding_read(client_control_block* client) {
+    if (!config.coalesce_reads)
+        return false;
+
+    auto key = read_request_key(client->req_header.unit_id,
+            client->req.subspan(mbap_header_size));
+    if (!key)
+        return false;
+
+    for (const auto& t : client->pending) {
+        if (!is_read_function(t.function_code))
+            return false;
+    }
+
+    outstanding_read leader{client->id, client->next_seq, write_epoch, {}};
+    auto [it, inserted] = outstanding_reads.try_emplace(key, leader);
+    if (inserted)
+        return false;
+    if (it->second.epoch != write_epoch) {
+        if (!it->second.followers.empty())
+            superseded_reads.push_back(std::move(it->second));
+        it->second = std::move(leader);
+        return false;
+    }
+
+    auto seq = client->next_seq++;
+    client->pending.push_back({seq, client->req_header,
+            client->req[mbap_header_size], ts_now, nullptr,
+            std::move(client->trace)});
+    it->second.followers.emplace_back(client->id, seq);
+    return true;
+}
+
+// Passes copies of the response to an outstanding read request to the
+// requests waiting for it.
+void server_reactor::fan_out_read(const deferred_request::state& leader) {
+    auto key = read_request_key(
+            leader.unit_id, std::span(leader.req, leader.req_size));
+    if (!key)
+        return;
+
+    auto is_leader = [&](const outstanding_read& r) {
+        return (r.leader == leader.client) && (r.seq == leader.seq);
+    };
+
+    // The entry is removed first, as requests processed below may become
+    // outstanding reads with the same key.
+    std::vector<std::pair<client_id, uint64_t>> followers;
+    auto it = outstanding_reads.find(key);
+    if ((it != outstanding_reads.end()) && is_leader(it->second)) {
+        followers = std::move(it->second.followers);
+        outstanding_reads.erase(it);
+    } else {
+        auto sup = std::find_if(
+                superseded_reads.begin(), superseded_reads.end(), is_leader);
+        if (sup == superseded_reads.end())
+            return;
+        followers = std::move(sup->followers);
+        superseded_reads.erase(sup);
+    }
+
+    for (auto [id, seq] : followers) {
+        auto client = find_client(id);
+        if (!client)
+            continue; // connection closed in the meantime
+
+        auto e = std::make_unique<deferred_request::state>();
+        e->client = id;
+        e->seq = seq;
+        std::memcpy(e->rsp, leader.rsp, leader.rsp_size);
+        e->rsp_size = leader.rsp_size;
+        e->error = leader.error;
+        e->error_msg = leader.error_msg;
+        complete_transaction(client, std::move(e));
+    }
+}
+
+// Moves the responses of completed requests at the front of the pending
+// requests to the queued responses. Returns false if the connection has been
+// closed due to a failed request.
+bool server_reactor::collect_responses(client_control_block* client) {
+    auto& pending = client->pending;
+    timestamp ts;
+    if (config.latency_histograms && !pending.empty() &&
+            pending.front().result)
+        ts = now();
+
+    while (!pending.empty() && pending.front().result) {
+        auto& t = pending.front();
+        const auto& res = *t.result;
+
+        if (res.error) {
+            log::error("client(id={:#x}) request: {}", client->id,
+                    res.error_msg);
+            close_client_by_id(client->id);
+            return false;
+        }
+
+        append_response(client->tx_queued, t.header, [&](auto pdu) {
+            std::memcpy(pdu.data(), res.rsp, res.rsp_size);
+            return res.rsp_size;
+        });
+        if (res.rsp_size && (res.rsp[0] & 0x80))
+            stats.exception(t.function_code);
+        if (config.latency_histograms) {
+            stats.processing(ts - t.received);
+            if (res.timed)
+                stats.backend(res.exec_end - res.exec_begin);
+        }
+        if (t.trace) {
+            if (res.timed) {
+                t.trace->backend_entered = res.exec_begin;
+                t.trace->backend_returned = res.exec_end;
+            }
+            client->traces_queued.push_back(std::move(t.trace));
+        }
+        ++client->n_queued;
+        pending.pop_front();
+    }
+    return true;
+}
+
+// Assigns requests completed by the asynchronous backend to their clients.
+void server_reactor::process_completions() {
+    // Requests completed while processing completions, e.g. by a backend
+    // executing requests right away, are processed in the same iteration.
+    for (completions->take(completed); !completed.empty();
+            completions->take(completed)) {
+        for (auto& e : completed) {
+            if (!outstanding_reads.empty() || !superseded_reads.empty())
+                fan_out_read(*e);
+            if (config.coalesce_reads && !is_read_function(e->req[0]))
+                ++write_epoch;
+
+            auto client = find_client(e->client);
+            if (!client)
+                continue; // connection closed in the meantime
+
+            complete_transaction(client, std::move(e));
+        }
+        completed.clear();
+    }
+}
+
+// Stores the result of a pending request of the client, and processes the
+// requests of the client.
+void server_reactor::complete_transaction(
+        client_control_block* client, completion_queue::entry e) {
+    auto& pending = client->pending;
+    auto i = e->seq - (pending.empty() ? 0 : pending.front().seq);
+    expects(i < pending.size(), "unexpected request completion");
+    pending[i].result = std::move(e);
+
+    process_requests(client);
+}
+
+void server_reactor::on_sent(io_connection& conn) {
+    auto client = static_cast<client_control_block*>(&conn);
+    complete_responses(client);
+    process_requests(client);
+}
+
+void server_reactor::complete_responses(client_control_block* client) {
+    stats.sent(client->tx_sending.size());
+    if constexpr (tracing_enabled) {
+        if (!client->traces_sending.empty())
+            finish_traces(client);
+    }
+    client->tx_sending.clear();
+    client->n_sending = 0;
+}
+
+void server_reactor::close_expired_clients() {
+    // both timers of a client may have expired at once
+    for (auto id : expired_clients) {
+        if (find_client(id))
+            close_client_by_id(id);
+    }
+    expired_clients.clear();
+}
+
+} // namespace mboxid
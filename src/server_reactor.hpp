@@ -0,0 +1,216 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_SERVER_REACTOR_HPP
+#define LIBMBOXID_SERVER_REACTOR_HPP
+
+#include <atomic>
+#include <vector>
+#include <bitset>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <variant>
+#include <chrono>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <mboxid/common.hpp>
+#include <mboxid/backend_connector.hpp>
+#include <mboxid/async_backend_connector.hpp>
+#include <mboxid/modbus_tcp_server.hpp>
+#include "unique_fd.hpp"
+#include "slot_map.hpp"
+#include "timer_wheel.hpp"
+#include "io_engine.hpp"
+#include "completion_queue.hpp"
+#include "worker_pool.hpp"
+#include "modbus_protocol_server.hpp"
+#include "metrics_recorder.hpp"
+#include "network_private.hpp"
+
+namespace mboxid {
+
+// Server configuration shared by all reactors of a server.
+struct server_config {
+    net::endpoint_addr own_addr;
+    bool use_tls = false;
+    milliseconds idle_timeout = no_timeout;
+    milliseconds request_complete_timeout = no_timeout;
+    modbus_tcp_server::transport transport =
+            modbus_tcp_server::transport::epoll;
+
+    static constexpr unsigned max_pipeline_depth = 64;
+    unsigned pipeline_depth = 8; // outstanding requests per connection
+    bool coalesce_reads = false;
+    bool latency_histograms = false;
+    modbus_tcp_server::request_tracer tracer;
+    unsigned trace_interval = 1; // one out of trace_interval requests traced
+    int listen_backlog = SOMAXCONN;
+};
+
+/**
+ * Event loop of the Modbus TCP server.
+ *
+ * A reactor owns its listening sockets, connections and timers, and is driven
+ * by a single thread executing run(). The network I/O is performed by an
+ * io_engine, which is created by run() according to the configuration.
+ *
+ * A server consists of one or more reactors. If there are several of them,
+ * each reactor binds its own listening sockets with SO_REUSEPORT and the
+ * kernel distributes incoming connections among them.
+ *
+ * The methods shutdown(), close_client_connection(), accept_queue_overflows()
+ * and read_metrics() are thread-safe. All other methods must be called
+ * before run() is executed.
+ */
+class server_reactor : private io_handler {
+public:
+    using client_id = backend_connector::client_id;
+
+    static constexpr unsigned max_reactors = 256;
+
+    // Function codes of the requests executed by workers.
+    using offload_table = std::bitset<256>;
+
+    server_reactor(unsigned index, const server_config& config);
+    server_reactor(const server_reactor&) = delete;
+    server_reactor& operator=(const server_reactor&) = delete;
+    server_reactor(server_reactor&&) = delete;
+    server_reactor& operator=(server_reactor&&) = delete;
+
+    ~server_reactor();
+
+    /*
+     * Sets the backend used by the reactor. The backend is not owned by the
+     * reactor. The backend ticker is only invoked if \a ticker is true. This
+     * allows reactors to share a backend, while only one of them invokes its
+     * ticker. Requests are submitted to the backend if it is derived from
+     * async_backend_connector, otherwise they are executed right away.
+     */
+    void set_backend(backend_connector* backend_, bool ticker);
+
+    /*
+     * Sets the worker pool used to execute requests with the function codes
+     * in \a offloaded, or none if \a pool is a null pointer. The pool is not
+     * owned by the reactor.
+     */
+    void set_workers(worker_pool* pool, const offload_table& offloaded);
+
+    /*
+     * Sets the state kept for the backend, e.g. its response cache, used for
+     * all requests of the reactor, whether executed by the reactor, its
+     * workers or an asynchronous backend. The state is shared with the
+     * requests, which may outlive the reactor.
+     */
+    void set_backend_state(std::shared_ptr<backend_state> state);
+
+    void run(bool reuse_port);
+    void shutdown();
+    void close_client_connection(client_id id);
+
+    //! Connection attempts dropped by the listening sockets of the reactor.
+    uint64_t accept_queue_overflows() const;
+
+    //! Adds the metrics of the reactor to \a m.
+    void read_metrics(server_metrics& m) const;
+
+    //! Index of the reactor serving the client \a id.
+    static unsigned reactor_index(client_id id);
+
+private:
+    using timestamp = timer_wheel::time_point;
+
+    struct cmd_stop {};
+
+    struct cmd_close_connection {
+        client_id id;
+    };
+
+    using cmd_queue_entry = std::variant<cmd_stop, cmd_close_connection>;
+
+    // A deferred read request, and the identical requests of other clients
+    // waiting for its response.
+    struct outstanding_read {
+        client_id leader;
+        uint64_t seq;
+        uint64_t epoch; // write_epoch when the request was deferred
+        std::vector<std::pair<client_id, uint64_t>> followers;
+    };
+
+    struct client_control_block;
+
+    const unsigned index;
+    const server_config& config;
+    bool stop_fl = false;
+
+    std::unique_ptr<io_engine> engine;
+    unique_fd cmd_event_fd;
+    std::vector<unique_fd> listen_fds;
+    std::vector<uint32_t> listen_drops; // last sample per listening socket
+    std::atomic<uint64_t> accept_overflows{0};
+    metrics_recorder stats;
+
+    std::mutex cmd_queue_mutex;
+    std::deque<cmd_queue_entry> cmd_queue;
+    timestamp ts_now; // time read once per iteration of the run loop
+    timer_wheel timers;
+    timer_wheel::timer backend_ticker;
+    timer_wheel::timer listen_monitor;
+    slot_map<std::unique_ptr<client_control_block>> clients;
+    std::vector<client_id> expired_clients;
+    backend_connector* backend = nullptr;
+    async_backend_connector* async_backend = nullptr;
+    worker_pool* workers = nullptr;
+    offload_table offloaded;
+    std::shared_ptr<backend_state> backend_st;
+    bool ticker_enabled = false;
+    std::shared_ptr<completion_queue> completions;
+    std::vector<completion_queue::entry> completed;
+    std::unordered_map<uint64_t, outstanding_read> outstanding_reads;
+    // outstanding reads replaced by a new leader after a write, whose
+    // followers still wait for their response
+    std::vector<outstanding_read> superseded_reads;
+    uint64_t write_epoch = 0; // writes received or completed
+    unsigned trace_countdown = 1; // requests until the next one is traced
+
+    // io_handler interface
+    void on_wakeup() override;
+    void on_accept(
+            unique_fd fd, const sockaddr* addr, socklen_t addrlen) override;
+    io_connection* find_connection(client_id id) override;
+    std::span<uint8_t> receive_buffer(io_connection& conn) override;
+    void on_received(io_connection& conn, size_t cnt) override;
+    void on_sent(io_connection& conn) override;
+    void on_closed(io_connection& conn) override;
+
+    void serve(bool reuse_port);
+    void trigger_command_processing();
+    void process_commands();
+    void passive_open(bool reuse_port);
+    void sample_listen_drops();
+    client_control_block* find_client(client_id id);
+    void close_client_by_id(client_id id);
+    void arm_timer(timer_wheel::timer& t, milliseconds to);
+    void process_requests(client_control_block* client);
+    void start_trace(client_control_block* client);
+    void finish_traces(client_control_block* client);
+    void reject_malformed_request(
+            client_control_block* client, const char* what);
+    void update_client_state(client_control_block* client);
+    bool execute_request(client_control_block* client);
+    void submit_request(client_control_block* client);
+    void offload_request(client_control_block* client);
+    completion_queue::entry make_deferred_request(client_control_block* client);
+    bool join_outstanding_read(client_control_block* client);
+    void fan_out_read(const deferred_request::state& leader);
+    bool collect_responses(client_control_block* client);
+    void process_completions();
+    void complete_transaction(
+            client_control_block* client, completion_queue::entry e);
+    void complete_responses(client_control_block* client);
+    void close_expired_clients();
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_SERVER_REACTOR_HPP
@@ -0,0 +1,150 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_SLOT_MAP_HPP
+#define LIBMBOXID_SLOT_MAP_HPP
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <limits>
+
+namespace mboxid {
+
+/**
+ * Container which hands out stable keys for its elements.
+ *
+ * Lookup, insertion and removal take constant time. The elements are kept in
+ * a dense array, so iterating over them takes time proportional to the number
+ * of elements and not to the number of keys ever handed out. The order of the
+ * elements is not preserved when an element is removed.
+ *
+ * A key consists of a slot index (bits 0..31) and the generation of the slot
+ * (bits 32..61). The generation is incremented every time the slot is
+ * vacated. Hence, keys of removed elements become stale and are rejected
+ * even if the slot has been reused in the meantime. The two most significant
+ * bits of a key are always zero and may be used by the caller to tag keys.
+ * Zero is never a valid key.
+ */
+template <typename T> class slot_map {
+public:
+    using key_type = std::uint64_t;
+    using iterator = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    static constexpr unsigned generation_bits = 30;
+
+    key_type insert(T value) {
+        std::uint32_t ix;
+
+        if (free_head != npos) {
+            ix = free_head;
+            free_head = slots[ix].pos;
+        } else {
+            ix = static_cast<std::uint32_t>(slots.size());
+            slots.push_back({.generation = 1, .pos = npos});
+        }
+
+        slots[ix].pos = static_cast<std::uint32_t>(values.size());
+        values.push_back(std::move(value));
+        owners.push_back(ix);
+        return make_key(slots[ix].generation, ix);
+    }
+
+    [[nodiscard]] T* find(key_type key) {
+        auto pos = position(key);
+        return (pos == npos) ? nullptr : &values[pos];
+    }
+
+    [[nodiscard]] const T* find(key_type key) const {
+        auto pos = position(key);
+        return (pos == npos) ? nullptr : &values[pos];
+    }
+
+    bool erase(key_type key) {
+        auto pos = position(key);
+        if (pos == npos)
+            return false;
+
+        auto ix = key_index(key);
+
+        // move last element into the gap
+        auto last = static_cast<std::uint32_t>(values.size() - 1);
+        if (pos != last) {
+            values[pos] = std::move(values[last]);
+            owners[pos] = owners[last];
+            slots[owners[pos]].pos = pos;
+        }
+        values.pop_back();
+        owners.pop_back();
+
+        // retire slot
+        auto& s = slots[ix];
+        s.generation = next_generation(s.generation);
+        s.pos = free_head;
+        free_head = ix;
+        return true;
+    }
+
+    void clear() {
+        while (!values.empty())
+            erase(make_key(slots[owners.back()].generation, owners.back()));
+    }
+
+    [[nodiscard]] std::size_t size() const { return values.size(); }
+    [[nodiscard]] bool empty() const { return values.empty(); }
+
+    iterator begin() { return values.begin(); }
+    iterator end() { return values.end(); }
+    const_iterator begin() const { return values.begin(); }
+    const_iterator end() const { return values.end(); }
+
+private:
+    static constexpr auto npos = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint32_t generation_mask =
+            (std::uint32_t{1} << generation_bits) - 1;
+
+    struct slot {
+        std::uint32_t generation;
+        std::uint32_t pos; // position in values if used, next free otherwise
+    };
+
+    std::vector<slot> slots;
+    std::vector<T> values;
+    std::vector<std::uint32_t> owners; // slot index of each value
+    std::uint32_t free_head = npos;
+
+    static key_type make_key(std::uint32_t generation, std::uint32_t ix) {
+        return static_cast<key_type>(generation) << 32 | ix;
+    }
+
+    static std::uint32_t key_index(key_type key) {
+        return static_cast<std::uint32_t>(key);
+    }
+
+    static std::uint32_t key_generation(key_type key) {
+        return static_cast<std::uint32_t>(key >> 32);
+    }
+
+    static std::uint32_t next_generation(std::uint32_t generation) {
+        generation = (generation + 1) & generation_mask;
+        return generation ? generation : 1;
+    }
+
+    [[nodiscard]] std::uint32_t position(key_type key) const {
+        auto ix = key_index(key);
+        if ((ix >= slots.size()) ||
+                (slots[ix].generation != key_generation(key)))
+            return npos;
+
+        // reject keys forged for a vacated slot
+        auto pos = slots[ix].pos;
+        if ((pos >= owners.size()) || (owners[pos] != ix))
+            return npos;
+        return pos;
+    }
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_SLOT_MAP_HPP
@@ -0,0 +1,234 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include "timer_wheel.hpp"
+
+namespace mboxid {
+
+using link = timer_wheel::link;
+
+static bool list_empty(const link& head) { return head.next == &head; }
+
+static void list_push_back(link& head, link& node) {
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+static void list_remove(link& node) {
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = node.next = &node;
+}
+
+// Moves all nodes from list src to the end of list dst.
+static void list_splice(link& dst, link& src) {
+    if (list_empty(src))
+        return;
+    src.next->prev = dst.prev;
+    dst.prev->next = src.next;
+    src.prev->next = &dst;
+    dst.prev = src.prev;
+    src.prev = src.next = &src;
+}
+
+void timer_wheel::timer::cancel() {
+    if (wheel)
+        wheel->cancel(*this);
+}
+
+timer_wheel::timer_wheel(time_point now) : origin(now) {}
+
+timer_wheel::~timer_wheel() {
+    // Disarm the remaining timers, so that they do not refer to the wheel
+    // any longer.
+    auto disarm_all = [](link& head) {
+        while (!list_empty(head)) {
+            auto& t = static_cast<timer&>(*head.next);
+            list_remove(t);
+            t.wheel = nullptr;
+        }
+    };
+
+    for (auto& level : slots)
+        for (auto& slot : level)
+            disarm_all(slot);
+    disarm_all(due);
+    disarm_all(expiring);
+}
+
+std::uint64_t timer_wheel::deadline_to_tick(time_point deadline) const {
+    using namespace std::chrono;
+
+    if (deadline <= origin)
+        return 0;
+    // round up, a timer must not expire before its deadline
+    return ceil<milliseconds>(deadline - origin).count();
+}
+
+void timer_wheel::arm(timer& t, time_point deadline) {
+    cancel(t);
+    t.wheel = this;
+    t.expiry = deadline_to_tick(deadline);
+    ++n_timers;
+    insert(t);
+}
+
+void timer_wheel::cancel(timer& t) {
+    if (t.wheel != this)
+        return;
+    unlink(t);
+    t.wheel = nullptr;
+    --n_timers;
+}
+
+void timer_wheel::insert(timer& t) {
+    if (t.expiry <= now_tick) {
+        t.level = level_due;
+        list_push_back(due, t);
+        return;
+    }
+
+    // Select the lowest level on which the timer is less than one revolution
+    // ahead. Timers beyond the range of the top level are parked in its last
+    // slot ahead.
+    for (unsigned level = 0; level < n_levels; ++level) {
+        auto shift = level * slot_bits;
+        auto ix = t.expiry >> shift;
+        auto now_ix = now_tick >> shift;
+
+        if ((ix - now_ix) >= n_slots) {
+            if (level < (n_levels - 1))
+                continue;
+            ix = now_ix + n_slots - 1;
+        }
+
+        t.level = level;
+        t.slot = ix & (n_slots - 1);
+        list_push_back(slots[level][t.slot], t);
+        occupied[level] |= std::uint64_t{1} << t.slot;
+        return;
+    }
+}
+
+void timer_wheel::unlink(timer& t) {
+    list_remove(t);
+    if ((t.level < n_levels) && list_empty(slots[t.level][t.slot]))
+        occupied[t.level] &= ~(std::uint64_t{1} << t.slot);
+}
+
+// Moves the timers of the given slot to the list of expiring timers.
+void timer_wheel::collect(unsigned level, unsigned slot) {
+    auto& head = slots[level][slot];
+    for (auto p = head.next; p != &head; p = p->next)
+        static_cast<timer*>(p)->level = level_expiring;
+    list_splice(expiring, head);
+    occupied[level] &= ~(std::uint64_t{1} << slot);
+}
+
+// Re-distributes the timers from the slots of the higher levels which have
+// been reached with the current tick.
+void timer_wheel::cascade() {
+    unsigned top = 0;
+    for (unsigned level = 1; level < n_levels; ++level) {
+        auto mask = (std::uint64_t{1} << (level * slot_bits)) - 1;
+        if (now_tick & mask)
+            break;
+        top = level;
+    }
+
+    for (unsigned level = top; level > 0; --level) {
+        auto slot = (now_tick >> (level * slot_bits)) & (n_slots - 1);
+        auto bit = std::uint64_t{1} << slot;
+        if (!(occupied[level] & bit))
+            continue;
+
+        link pending;
+        list_splice(pending, slots[level][slot]);
+        occupied[level] &= ~bit;
+
+        while (!list_empty(pending)) {
+            auto& t = static_cast<timer&>(*pending.next);
+            list_remove(t);
+            insert(t);
+        }
+    }
+}
+
+void timer_wheel::advance(time_point now) {
+    using namespace std::chrono;
+
+    auto target = static_cast<std::uint64_t>(
+            std::max(floor<milliseconds>(now - origin).count(), 0L));
+
+    if (!n_timers)
+        now_tick = std::max(now_tick, target);
+
+    while (now_tick < target) {
+        // Skip ticks without work. Work is due at the next occupied slot of
+        // level 0, or at the next wrap-around of level 0, when the higher
+        // levels are cascaded.
+        auto pos = now_tick & (n_slots - 1);
+        auto next = (now_tick | (n_slots - 1)) + 1;
+        auto ahead = (pos < (n_slots - 1)) ? (occupied[0] >> (pos + 1)) : 0;
+        if (ahead)
+            next = std::min(next, now_tick + 1 + std::countr_zero(ahead));
+
+        now_tick = std::min(next, target);
+
+        if (!(now_tick & (n_slots - 1)))
+            cascade();
+
+        auto slot = now_tick & (n_slots - 1);
+        if (occupied[0] & (std::uint64_t{1} << slot))
+            collect(0, slot);
+    }
+
+    for (auto p = due.next; p != &due; p = p->next)
+        static_cast<timer*>(p)->level = level_expiring;
+    list_splice(expiring, due);
+
+    // A callback may cancel timers still on the expiring list, therefore we
+    // take them one by one.
+    while (!list_empty(expiring)) {
+        auto& t = static_cast<timer&>(*expiring.next);
+        list_remove(t);
+        t.wheel = nullptr;
+        --n_timers;
+        if (t.on_expiry)
+            t.on_expiry();
+    }
+}
+
+int timer_wheel::poll_timeout(time_point now) const {
+    using namespace std::chrono;
+
+    if (!n_timers)
+        return -1;
+    if (!list_empty(due))
+        return 0;
+
+    auto next = std::numeric_limits<std::uint64_t>::max();
+
+    for (unsigned level = 0; level < n_levels; ++level) {
+        if (!occupied[level])
+            continue;
+        // Timers on level 0 expire when their slot is reached, timers on
+        // higher levels are cascaded down then.
+        auto shift = level * slot_bits;
+        auto pos = (now_tick >> shift) & (n_slots - 1);
+        auto ahead = std::rotr(occupied[level], static_cast<int>(pos + 1));
+        auto ix = (now_tick >> shift) + 1 + std::countr_zero(ahead);
+        next = std::min(next, ix << shift);
+    }
+
+    auto to = ceil<milliseconds>(origin + milliseconds(next) - now).count();
+    to = std::clamp(to, 0L, static_cast<long>(std::numeric_limits<int>::max()));
+    return static_cast<int>(to);
+}
+
+} // namespace mboxid
@@ -0,0 +1,123 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_TIMER_WHEEL_HPP
+#define LIBMBOXID_TIMER_WHEEL_HPP
+
+#include <cstdint>
+#include <chrono>
+#include <functional>
+
+namespace mboxid {
+
+/**
+ * Hierarchical timer wheel with a resolution of one millisecond.
+ *
+ * Arming, re-arming and cancelling a timer take constant time. Expiring
+ * timers takes constant time per timer amortised over its lifetime. The
+ * wheel does not read the clock itself. The caller passes the current point
+ * in time to advance() and poll_timeout(), so that a single clock reading can
+ * be shared by all timers.
+ *
+ * The wheel consists of four levels with 64 slots each. Level 0 holds timers
+ * expiring within the next 64 ms, level n timers expiring within the next
+ * 64^(n+1) ms. Timers on higher levels are cascaded down when their slot is
+ * reached. Timers exceeding the range of the wheel (about 4.6 hours) are
+ * parked in the top level and re-inserted when their slot comes around.
+ */
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+
+    struct link {
+        link* prev = this;
+        link* next = this;
+    };
+
+    /**
+     * Timer managed by a timer_wheel.
+     *
+     * A timer is disarmed automatically when it expires or is destroyed. The
+     * callback is invoked from within timer_wheel::advance(). It may arm or
+     * cancel any timer, but must not destroy the timer it is invoked for.
+     */
+    class timer : private link {
+    public:
+        timer() = default;
+        explicit timer(std::function<void()> on_expiry)
+                : on_expiry(std::move(on_expiry)) {}
+        timer(const timer&) = delete;
+        timer& operator=(const timer&) = delete;
+        timer(timer&&) = delete;
+        timer& operator=(timer&&) = delete;
+        ~timer() { cancel(); }
+
+        void set_callback(std::function<void()> f) { on_expiry = std::move(f); }
+        [[nodiscard]] bool armed() const { return wheel != nullptr; }
+        void cancel();
+
+    private:
+        friend class timer_wheel;
+
+        timer_wheel* wheel = nullptr;
+        std::uint64_t expiry = 0; // in ticks
+        std::uint8_t level = 0;
+        std::uint8_t slot = 0;
+        std::function<void()> on_expiry;
+    };
+
+    explicit timer_wheel(time_point now);
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+    timer_wheel(timer_wheel&&) = delete;
+    timer_wheel& operator=(timer_wheel&&) = delete;
+    ~timer_wheel();
+
+    //! Arms timer \a t to expire at \a deadline. An armed timer is re-armed.
+    void arm(timer& t, time_point deadline);
+
+    //! Disarms timer \a t. Nothing happens if the timer is not armed.
+    void cancel(timer& t);
+
+    //! Invokes the callbacks of all timers expired until \a now.
+    void advance(time_point now);
+
+    /**
+     * Returns the time in [ms] until advance() needs to be called next, or
+     * -1 if no timer is armed. The result is suitable as timeout for poll()
+     * and friends.
+     */
+    [[nodiscard]] int poll_timeout(time_point now) const;
+
+    //! Number of armed timers.
+    [[nodiscard]] std::size_t size() const { return n_timers; }
+
+private:
+    static constexpr unsigned slot_bits = 6;
+    static constexpr unsigned n_slots = 1U << slot_bits;
+    static constexpr unsigned n_levels = 4;
+
+    // pseudo levels of timers not held in a wheel slot
+    static constexpr std::uint8_t level_due = n_levels;
+    static constexpr std::uint8_t level_expiring = n_levels + 1;
+
+    time_point origin;
+    std::uint64_t now_tick = 0;
+    std::size_t n_timers = 0;
+
+    link slots[n_levels][n_slots];
+    std::uint64_t occupied[n_levels] = {};
+    link due;      // expired timers not yet collected by advance()
+    link expiring; // timers collected by advance() to invoke their callback
+
+    [[nodiscard]] std::uint64_t deadline_to_tick(time_point deadline) const;
+    void insert(timer& t);
+    void unlink(timer& t);
+    void collect(unsigned level, unsigned slot);
+    void cascade();
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_TIMER_WHEEL_HPP
@@ -0,0 +1,601 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "error_private.hpp"
+#include "logger_private.hpp"
+#include "uring_engine.hpp"
+
+namespace mboxid {
+
+constexpr unsigned sq_size{256};
+constexpr unsigned cq_size{4096};
+
+// Provided buffers used by multishot receive requests.
+constexpr unsigned n_bufs{128}; // must be a power of 2
+constexpr unsigned buf_size{2048};
+constexpr uint16_t buf_group{0};
+
+// If more data is queued for a paused connection, the receive request of the
+// connection is cancelled until the reactor catches up. Then TCP flow
+// control slows down the peer.
+constexpr size_t max_backlog{16 * 1024};
+
+// Bits of io_connection::engine_state
+constexpr uint32_t recv_armed{1U << 0};
+constexpr uint32_t recv_throttled{1U << 1};
+constexpr uint32_t peer_closed{1U << 2};
+constexpr uint32_t send_armed{1U << 3};
+
+// The user data of a request identifies the operation (bits 62..63) and a
+// reference to the object the request refers to (bits 0..61), see
+// epoll_engine.cpp. Requests whose completions are of no interest, carry
+// the reference no_ref.
+constexpr unsigned token_ref_bits = 62;
+constexpr uint64_t token_ref_mask = (uint64_t{1} << token_ref_bits) - 1;
+constexpr uint64_t no_ref = token_ref_mask;
+
+static uint64_t make_token(auto op, uint64_t ref) {
+    return static_cast<uint64_t>(op) << token_ref_bits | (ref & token_ref_mask);
+}
+
+// Returns true for the last completion of a request counted in n_inflight.
+// Requests of no interest are control operations with reference no_ref,
+// and as the control operation is encoded as 0 their token equals no_ref.
+static bool is_final(uint64_t user_data, unsigned flags) {
+    return (user_data != no_ref) && !(flags & IORING_CQE_F_MORE);
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int io_uring_register(
+        int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(
+            syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+template <typename T> static T load_acquire(T* p) {
+    return std::atomic_ref<T>(*p).load(std::memory_order_acquire);
+}
+
+template <typename T> static void store_release(T* p, T v) {
+    std::atomic_ref<T>(*p).store(v, std::memory_order_release);
+}
+
+uring_engine::mapping::~mapping() {
+    if (addr)
+        munmap(addr, len);
+}
+
+void uring_engine::mapping::map(
+        size_t len_, int prot, int flags, int fd, off_t offset) {
+    auto p = mmap(nullptr, len_, prot, flags, fd, offset);
+    if (p == MAP_FAILED)
+        throw system_error(errno, "mmap");
+    addr = static_cast<uint8_t*>(p);
+    len = len_;
+}
+
+uring_engine::uring_engine(io_handler& handler) : handler(handler) {
+    setup_ring();
+    setup_buffer_ring();
+}
+
+uring_engine::~uring_engine() {
+    // The kernel tears a ring down asynchronously. Until then, its pending
+    // requests keep their sockets alive, which would e.g. prevent the
+    // listening port from being bound again right away. Therefore, we cancel
+    // all requests and wait for their completion.
+    try {
+        cancel_all();
+    } catch (...) {
+        // nothing we can do about it
+    }
+}
+
+void uring_engine::cancel_all() {
+    if (!n_inflight)
+        return;
+
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = make_token(op::control, no_ref);
+
+    struct __kernel_timespec ts = {.tv_sec = 0, .tv_nsec = 10000000};
+    struct io_uring_getevents_arg arg = {};
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    for (int i = 0; n_inflight && (i < 100); ++i) {
+        (void)enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                sizeof(arg));
+
+        auto head = *cq_khead;
+        while (head != load_acquire(cq_ktail)) {
+            const auto& cqe = cqes[head & cq_mask];
+            if (is_final(cqe.user_data, cqe.flags))
+                --n_inflight;
+            store_release(cq_khead, ++head);
+        }
+    }
+}
+
+void uring_engine::setup_ring() {
+    struct io_uring_params p = {};
+
+    // The flags require Linux 6.1, which covers all other features used
+    // (multishot receive 6.0, provided buffer rings 5.19).
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER |
+            IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = cq_size;
+
+    if (auto fd = io_uring_setup(sq_size, &p); fd == -1)
+        throw system_error(errno, "io_uring_setup");
+    else
+        ring_fd.reset(fd);
+
+    constexpr unsigned required = IORING_FEAT_SINGLE_MMAP |
+            IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+    if ((p.features & required) != required)
+        throw system_error(ENOTSUP, "io_uring features");
+
+    auto sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    auto cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring_mem.map(std::max(sq_len, cq_len), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring_fd.get(), IORING_OFF_SQ_RING);
+    sqe_mem.map(p.sq_entries * sizeof(struct io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd.get(),
+            IORING_OFF_SQES);
+
+    auto ring = ring_mem.get();
+    sq_khead = reinterpret_cast<unsigned*>(ring + p.sq_off.head);
+    sq_ktail = reinterpret_cast<unsigned*>(ring + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(ring + p.sq_off.ring_mask);
+    sq_entries = p.sq_entries;
+    sq_tail = *sq_ktail;
+    sqes = reinterpret_cast<struct io_uring_sqe*>(sqe_mem.get());
+
+    // Submission queue entries are used in order, so the indirection array
+    // is an identity mapping.
+    auto array = reinterpret_cast<unsigned*>(ring + p.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; ++i)
+        array[i] = i;
+
+    cq_khead = reinterpret_cast<unsigned*>(ring + p.cq_off.head);
+    cq_ktail = reinterpret_cast<unsigned*>(ring + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(ring + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(ring + p.cq_off.cqes);
+}
+
+void uring_engine::setup_buffer_ring() {
+    buf_ring_mem.map(n_bufs * sizeof(struct io_uring_buf),
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    // Don't use struct io_uring_buf_ring to access the ring. Compiled as C++,
+    // the kernel headers' flexible array hack places its member bufs at
+    // offset 8 instead of 0. The tail of the ring overlays the field resv of
+    // the first buffer.
+    buf_ring = reinterpret_cast<struct io_uring_buf*>(buf_ring_mem.get());
+    buf_ring_tail = &buf_ring[0].resv;
+
+    struct io_uring_buf_reg reg = {};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = n_bufs;
+    reg.bgid = buf_group;
+    if (io_uring_register(ring_fd.get(), IORING_REGISTER_PBUF_RING, &reg, 1) ==
+            -1)
+        throw system_error(
+                errno, "io_uring_register IORING_REGISTER_PBUF_RING");
+
+    bufs = std::make_unique<uint8_t[]>(n_bufs * buf_size);
+    for (unsigned bid = 0; bid < n_bufs; ++bid)
+        recycle_buffer(bid);
+    publish_buffers();
+}
+
+struct io_uring_sqe* uring_engine::get_sqe() {
+    if (sq_tail - load_acquire(sq_khead) >= sq_entries) {
+        // The submission queue is full, pass its content to the kernel.
+        if (enter(0, 0, nullptr, 0) == -1)
+            throw system_error(errno, "io_uring_enter");
+        if (sq_tail - load_acquire(sq_khead) >= sq_entries)
+            throw system_error(EBUSY, "io_uring submission queue");
+    }
+
+    auto sqe = &sqes[sq_tail & sq_mask];
+    ++sq_tail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Submits all queued requests and optionally waits for completions.
+int uring_engine::enter(
+        unsigned min_complete, unsigned flags, const void* arg, size_t argsz) {
+    store_release(sq_ktail, sq_tail);
+    auto to_submit = sq_tail - load_acquire(sq_khead);
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd.get(),
+            to_submit, min_complete, flags, arg, argsz));
+}
+
+void uring_engine::arm_wakeup() {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeup_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = make_token(op::control, wakeup_fd);
+    ++n_inflight;
+}
+
+// A multishot accept request posts a completion for every connection as it
+// is established. So the accept queue is drained without a loop, and
+// accepted connections interleave with the completions of other requests.
+void uring_engine::arm_accept(int fd) {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = make_token(op::accept, fd);
+    ++n_inflight;
+}
+
+void uring_engine::arm_recv(io_connection& conn) {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.fd.get();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buf_group;
+    sqe->user_data = make_token(op::recv, conn.id);
+    ++n_inflight;
+    conn.engine_state |= recv_armed;
+    conn.engine_state &= ~recv_throttled;
+}
+
+void uring_engine::submit_send(io_connection& conn) {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn.fd.get();
+    sqe->addr = reinterpret_cast<uint64_t>(conn.tx.data());
+    sqe->len = conn.tx.size();
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = make_token(op::send, conn.id);
+    ++n_inflight;
+    conn.engine_state |= send_armed;
+}
+
+void uring_engine::cancel(uint64_t user_data) {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = make_token(op::control, no_ref);
+}
+
+void uring_engine::recycle_buffer(unsigned bid) {
+    auto& buf = buf_ring[buf_tail & (n_bufs - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(&bufs[bid * buf_size]);
+    buf.len = buf_size;
+    buf.bid = bid;
+    ++buf_tail;
+}
+
+void uring_engine::publish_buffers() {
+    store_release(buf_ring_tail, buf_tail);
+}
+
+void uring_engine::add_wakeup_fd(int fd) {
+    wakeup_fd = fd;
+    arm_wakeup();
+}
+
+void uring_engine::add_listener(int fd) { arm_accept(fd); }
+
+void uring_engine::add_connection(io_connection& conn) {
+    conn.engine_state = 0;
+    arm_recv(conn);
+}
+
+void uring_engine::remove_connection(io_connection& conn) {
+    // Requests in flight hold a reference to the socket, hence closing the
+    // file descriptor would neither terminate them nor the connection.
+    // Shutting the socket down completes them. Their completions are
+    // dropped, as the connection can't be found any longer.
+    //
+    // The kernel may still read the data of a send request until its
+    // completion arrives. So the buffer is kept until then.
+    if (conn.engine_state & send_armed)
+        orphaned_tx.emplace(conn.id, std::move(conn.tx_sending));
+    (void)shutdown(conn.fd.get(), SHUT_RDWR);
+}
+
+void uring_engine::pause_receive(io_connection& conn) {
+    // Data received in the meantime is queued, see deliver().
+    conn.rx_paused = true;
+}
+
+void uring_engine::resume_receive(io_connection& conn) {
+    conn.rx_paused = false;
+    if (!conn.rx_backlog.empty() || !(conn.engine_state & recv_armed))
+        ready.push_back(conn.id);
+}
+
+bool uring_engine::send(io_connection& conn, std::span<const uint8_t> data) {
+    conn.tx = data;
+    submit_send(conn);
+    return false;
+}
+
+void uring_engine::wait(int timeout) {
+    struct __kernel_timespec ts = {};
+    struct io_uring_getevents_arg arg = {};
+
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    // Don't block if there is work left from the previous iteration.
+    bool busy = !ready.empty() ||
+            (*cq_khead != load_acquire(cq_ktail));
+
+    auto flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (enter(busy ? 0 : 1, flags, &arg, sizeof(arg)) == -1) {
+        switch (errno) {
+        case ETIME:
+            [[fallthrough]];
+        case EINTR:
+            [[fallthrough]];
+        case EAGAIN:
+            [[fallthrough]];
+        case EBUSY:
+            break;
+        default:
+            throw system_error(errno, "io_uring_enter");
+        }
+    }
+}
+
+void uring_engine::dispatch() {
+    reap_completions();
+    process_ready();
+}
+
+void uring_engine::reap_completions() {
+    auto head = *cq_khead;
+
+    while (head != load_acquire(cq_ktail)) {
+        const auto& cqe = cqes[head & cq_mask];
+        auto user_data = cqe.user_data;
+        auto res = cqe.res;
+        auto flags = cqe.flags;
+
+        // Release the entry before dispatching, as the handlers may enter
+        // the kernel.
+        store_release(cq_khead, ++head);
+        if (is_final(user_data, flags))
+            --n_inflight;
+        dispatch(user_data, res, flags);
+    }
+    publish_buffers();
+}
+
+void uring_engine::dispatch(uint64_t user_data, int res, unsigned flags) {
+    auto ref = user_data & token_ref_mask;
+
+    switch (static_cast<op>(user_data >> token_ref_bits)) {
+    case op::control:
+        if (ref == no_ref)
+            break;
+        if (res < 0)
+            throw system_error(-res, "io_uring poll");
+        if (!(flags & IORING_CQE_F_MORE))
+            arm_wakeup();
+        handler.on_wakeup();
+        break;
+    case op::accept:
+        handle_accept(static_cast<int>(ref), res, flags);
+        break;
+    case op::recv:
+        handle_recv(ref, res, flags);
+        break;
+    case op::send:
+        handle_send(ref, res);
+        break;
+    default:
+        throw mboxid_error(errc::logic_error, "uring_engine::dispatch");
+    }
+}
+
+void uring_engine::handle_accept(int fd, int res, unsigned flags) {
+    if (!(flags & IORING_CQE_F_MORE))
+        arm_accept(fd);
+
+    if (res < 0) {
+        switch (-res) {
+        case ECONNABORTED:
+            [[fallthrough]];
+        case ETIMEDOUT:
+            log::error("accept aborted prematurely: {}",
+                    std::error_code(-res, std::system_category()).message());
+            return;
+        default:
+            throw system_error(-res, "io_uring accept");
+        }
+    }
+
+    unique_fd conn_fd(res);
+    struct sockaddr_storage addr; // NOLINT(*-pro-type-member-init)
+    socklen_t addrlen = sizeof(addr);
+    auto sa = reinterpret_cast<struct sockaddr*>(&addr);
+
+    // The peer may have reset the connection already.
+    if (getpeername(conn_fd.get(), sa, &addrlen) == -1) {
+        log::error("accept aborted prematurely: {}",
+                std::error_code(errno, std::system_category()).message());
+        return;
+    }
+
+    handler.on_accept(std::move(conn_fd), sa, addrlen);
+}
+
+void uring_engine::handle_recv(client_id id, int res, unsigned flags) {
+    if (flags & IORING_CQE_F_BUFFER) {
+        auto bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0)
+            deliver(id, std::span(&bufs[bid * buf_size], res));
+        recycle_buffer(bid);
+    }
+
+    auto conn = handler.find_connection(id);
+    if (!conn)
+        return;
+
+    if (!(flags & IORING_CQE_F_MORE))
+        conn->engine_state &= ~recv_armed;
+
+    if (res > 0) {
+        // A request terminated by the kernel, e.g. because it ran out of
+        // buffers, is armed again by process_ready().
+        if (!(conn->engine_state & (recv_armed | recv_throttled)))
+            ready.push_back(id);
+        return;
+    }
+
+    switch (-res) {
+    case 0:
+        conn->engine_state |= peer_closed;
+        break;
+    case ENOBUFS:
+        [[fallthrough]];
+    case ECANCELED:
+        ready.push_back(id);
+        return;
+    case ECONNRESET:
+        [[fallthrough]];
+    case ETIMEDOUT:
+        handler.on_closed(*conn);
+        return;
+    default:
+        throw system_error(-res, "io_uring recv");
+    }
+
+    // Data received before the peer closed the connection is delivered
+    // first.
+    if (!conn->rx_paused && conn->rx_backlog.empty())
+        handler.on_closed(*conn);
+}
+
+void uring_engine::handle_send(client_id id, int res) {
+    auto conn = handler.find_connection(id);
+    if (!conn) {
+        orphaned_tx.erase(id);
+        return;
+    }
+    conn->engine_state &= ~send_armed;
+
+    if (res < 0) {
+        switch (-res) {
+        case EAGAIN:
+            submit_send(*conn);
+            return;
+        case ECONNRESET:
+            [[fallthrough]];
+        case EPIPE:
+            handler.on_closed(*conn);
+            return;
+        default:
+            throw system_error(-res, "io_uring send");
+        }
+    }
+
+    conn->tx = conn->tx.subspan(res);
+    if (!conn->tx.empty()) {
+        submit_send(*conn);
+        return;
+    }
+
+    handler.on_sent(*conn);
+}
+
+// Passes received data to the reactor. Data it has no room for is queued.
+void uring_engine::deliver(client_id id, std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto conn = handler.find_connection(id);
+        if (!conn)
+            return;
+
+        auto buf = (conn->rx_paused || !conn->rx_backlog.empty())
+                ? std::span<uint8_t>()
+                : handler.receive_buffer(*conn);
+
+        if (buf.empty()) {
+            auto& backlog = conn->rx_backlog;
+            backlog.insert(backlog.end(), data.begin(), data.end());
+            if ((backlog.size() > max_backlog) &&
+                    ((conn->engine_state & (recv_armed | recv_throttled)) ==
+                            recv_armed)) {
+                cancel(make_token(op::recv, id));
+                conn->engine_state |= recv_throttled;
+            }
+            return;
+        }
+
+        auto cnt = std::min(buf.size(), data.size());
+        std::memcpy(buf.data(), data.data(), cnt);
+        data = data.subspan(cnt);
+        handler.on_received(*conn, cnt);
+    }
+}
+
+void uring_engine::drain_backlog(client_id id) {
+    for (;;) {
+        auto conn = handler.find_connection(id);
+        if (!conn || conn->rx_paused || conn->rx_backlog.empty())
+            return;
+
+        auto buf = handler.receive_buffer(*conn);
+        if (buf.empty())
+            return;
+
+        auto& backlog = conn->rx_backlog;
+        auto cnt = std::min(buf.size(), backlog.size());
+        std::memcpy(buf.data(), backlog.data(), cnt);
+        backlog.erase(backlog.begin(), backlog.begin() + cnt);
+        handler.on_received(*conn, cnt);
+    }
+}
+
+void uring_engine::process_ready() {
+    // Processing may mark connections ready again, these are served in the
+    // next iteration.
+    std::swap(ready, ready_now);
+
+    for (auto id : ready_now) {
+        drain_backlog(id);
+
+        auto conn = handler.find_connection(id);
+        if (!conn || conn->rx_paused)
+            continue;
+
+        if (conn->engine_state & peer_closed) {
+            if (conn->rx_backlog.empty())
+                handler.on_closed(*conn);
+        } else if (!(conn->engine_state & recv_armed) &&
+                (conn->rx_backlog.size() <= max_backlog))
+            arm_recv(*conn);
+    }
+    ready_now.clear();
+}
+
+} // namespace mboxid
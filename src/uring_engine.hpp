@@ -0,0 +1,133 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_URING_ENGINE_HPP
+#define LIBMBOXID_URING_ENGINE_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <linux/io_uring.h>
+#include "io_engine.hpp"
+
+namespace mboxid {
+
+/**
+ * I/O engine based on io_uring.
+ *
+ * Listening sockets are served by multishot accept requests and connections
+ * by multishot receive requests, which pick their buffers from a ring of
+ * buffers provided to the kernel. Requests created while dispatching
+ * completions are submitted together with the next wait. So, under load, a
+ * single system call per loop iteration serves all connections of the
+ * engine.
+ *
+ * The ring is set up for a single issuer, hence the engine must be created
+ * by the thread which uses it.
+ *
+ * The constructor throws system_error if the kernel does not support the
+ * required features.
+ */
+class uring_engine : public io_engine {
+public:
+    explicit uring_engine(io_handler& handler);
+    uring_engine(const uring_engine&) = delete;
+    uring_engine& operator=(const uring_engine&) = delete;
+    uring_engine(uring_engine&&) = delete;
+    uring_engine& operator=(uring_engine&&) = delete;
+
+    ~uring_engine() override;
+
+    void add_wakeup_fd(int fd) override;
+    void add_listener(int fd) override;
+    void add_connection(io_connection& conn) override;
+    void remove_connection(io_connection& conn) override;
+    void pause_receive(io_connection& conn) override;
+    void resume_receive(io_connection& conn) override;
+    bool send(io_connection& conn, std::span<const uint8_t> data) override;
+    void wait(int timeout) override;
+    void dispatch() override;
+    const char* name() const override { return "io_uring"; }
+
+private:
+    using client_id = io_handler::client_id;
+
+    // Operations, stored together with a file descriptor or a client id in
+    // the user data of a request.
+    enum class op : uint64_t { control = 0, accept, recv, send };
+
+    // Memory mapped region, unmapped on destruction.
+    class mapping {
+    public:
+        mapping() = default;
+        mapping(const mapping&) = delete;
+        mapping& operator=(const mapping&) = delete;
+        ~mapping();
+
+        void map(size_t len, int prot, int flags, int fd, off_t offset);
+        [[nodiscard]] uint8_t* get() const { return addr; }
+
+    private:
+        uint8_t* addr = nullptr;
+        size_t len = 0;
+    };
+
+    io_handler& handler;
+    unique_fd ring_fd;
+
+    mapping ring_mem;
+    mapping sqe_mem;
+    unsigned* sq_khead = nullptr;
+    unsigned* sq_ktail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sq_tail = 0;
+    struct io_uring_sqe* sqes = nullptr;
+
+    unsigned* cq_khead = nullptr;
+    unsigned* cq_ktail = nullptr;
+    unsigned cq_mask = 0;
+    struct io_uring_cqe* cqes = nullptr;
+
+    mapping buf_ring_mem;
+    struct io_uring_buf* buf_ring = nullptr;
+    uint16_t* buf_ring_tail = nullptr;
+    std::unique_ptr<uint8_t[]> bufs;
+    uint16_t buf_tail = 0;
+
+    int wakeup_fd = -1;
+    unsigned n_inflight = 0; // requests not completed yet
+
+    // Data of send requests in flight for removed connections.
+    std::unordered_map<client_id, std::vector<uint8_t>> orphaned_tx;
+
+    // Connections with pending receive work, see resume_receive().
+    std::vector<client_id> ready;
+    std::vector<client_id> ready_now;
+
+    void setup_ring();
+    void setup_buffer_ring();
+    struct io_uring_sqe* get_sqe();
+    int enter(unsigned min_complete, unsigned flags, const void* arg,
+            size_t argsz);
+    void arm_wakeup();
+    void arm_accept(int fd);
+    void arm_recv(io_connection& conn);
+    void submit_send(io_connection& conn);
+    void cancel(uint64_t user_data);
+    void cancel_all();
+    void recycle_buffer(unsigned bid);
+    void publish_buffers();
+    void reap_completions();
+    void dispatch(uint64_t user_data, int res, unsigned flags);
+    void handle_accept(int fd, int res, unsigned flags);
+    void handle_recv(client_id id, int res, unsigned flags);
+    void handle_send(client_id id, int res);
+    void deliver(client_id id, std::span<const uint8_t> data);
+    void drain_backlog(client_id id);
+    void process_ready();
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_URING_ENGINE_HPP
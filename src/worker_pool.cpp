@@ -0,0 +1,67 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "error_private.hpp"
+#include "logger_private.hpp"
+#include "worker_pool.hpp"
+
+namespace mboxid {
+
+worker_pool::worker_pool(unsigned n_workers) {
+    expects(n_workers > 0, "worker_pool: no workers");
+
+    for (unsigned i = 0; i < n_workers; ++i)
+        workers.push_back(std::make_unique<worker>());
+    for (auto& w : workers)
+        w->thd = std::thread(work, std::ref(*w));
+}
+
+worker_pool::~worker_pool() {
+    for (auto& w : workers) {
+        {
+            std::lock_guard lk(w->mtx);
+            w->stop_fl = true;
+        }
+        w->cv.notify_one();
+    }
+    for (auto& w : workers)
+        w->thd.join();
+}
+
+void worker_pool::submit(uint64_t key, job j) {
+    // Mix the upper bits in, as the lower bits of client ids are slot
+    // indexes, which are reused.
+    auto& w = *workers[(key ^ (key >> 32)) % workers.size()];
+    bool was_idle;
+    {
+        std::lock_guard lk(w.mtx);
+        was_idle = w.jobs.empty();
+        w.jobs.push_back(std::move(j));
+    }
+    if (was_idle)
+        w.cv.notify_one();
+}
+
+void worker_pool::work(worker& w) {
+    std::unique_lock lk(w.mtx);
+
+    for (;;) {
+        w.cv.wait(lk, [&]() { return w.stop_fl || !w.jobs.empty(); });
+        if (w.stop_fl)
+            return;
+
+        auto j = std::move(w.jobs.front());
+        w.jobs.pop_front();
+        lk.unlock();
+
+        try {
+            deferred_request(std::move(j.req)).execute(*j.backend);
+        } catch (const std::exception& e) {
+            log::error("worker: {}", e.what());
+        }
+
+        lk.lock();
+    }
+}
+
+} // namespace mboxid
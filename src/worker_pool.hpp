@@ -0,0 +1,59 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef LIBMBOXID_WORKER_POOL_HPP
+#define LIBMBOXID_WORKER_POOL_HPP
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <mboxid/backend_connector.hpp>
+#include "completion_queue.hpp"
+
+namespace mboxid {
+
+/**
+ * Fixed pool of threads executing requests with a synchronous backend.
+ *
+ * Each job is assigned to a worker by a key, and each worker executes its
+ * jobs in the order of submission. Jobs submitted with the same key, e.g.
+ * the requests of a client, are thereby executed one after the other in
+ * their order. Completed requests are reported through the completion queue
+ * referred to by the request.
+ */
+class worker_pool {
+public:
+    struct job {
+        completion_queue::entry req;
+        backend_connector* backend;
+    };
+
+    explicit worker_pool(unsigned n_workers);
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    // Stops the workers. Jobs not started yet are dropped.
+    ~worker_pool();
+
+    void submit(uint64_t key, job j);
+
+private:
+    struct worker {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<job> jobs;
+        bool stop_fl = false;
+        std::thread thd;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+
+    static void work(worker& w);
+};
+
+} // namespace mboxid
+
+#endif // LIBMBOXID_WORKER_POOL_HPP
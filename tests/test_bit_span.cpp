@@ -0,0 +1,120 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <mboxid/bit_span.hpp>
+#include <mboxid/error.hpp>
+#include "bit_pack.hpp"
+
+using namespace mboxid;
+
+TEST(BitSpanTest, Access) {
+    uint8_t buf[2] = {0x35, 0x07}; // bits 0, 2, 4, 5, 8, 9, 10 are set
+    bit_span bits(buf, 12);
+
+    EXPECT_EQ(bits.size(), 12);
+    EXPECT_EQ(bits.size_bytes(), 2);
+    EXPECT_TRUE(bits[0]);
+    EXPECT_FALSE(bits[1]);
+    EXPECT_TRUE(bits.test(10));
+    EXPECT_FALSE(bits.test(11));
+
+    bits.set(11);
+    bits.reset(0);
+    EXPECT_EQ(buf[0], 0x34);
+    EXPECT_EQ(buf[1], 0x0f);
+
+    const_bit_span cbits = bits;
+    EXPECT_EQ(cbits.data(), buf);
+    EXPECT_TRUE(cbits[11]);
+    EXPECT_TRUE(const_bit_span().empty());
+}
+
+TEST(BitSpanTest, PackUnpack) {
+    bool src[] = {true, false, true, true, false, false, true, true, true, true,
+            false, true, false, true, true, false, true, false, true};
+    uint8_t packed[3] = {0xff, 0xff, 0xff};
+
+    pack_bits(src, bit_span(packed, std::size(src)));
+    EXPECT_EQ(packed[0], 0xcd);
+    EXPECT_EQ(packed[1], 0x6b);
+    EXPECT_EQ(packed[2], 0x05); // unused bits are cleared
+
+    bool dst[std::size(src)];
+    unpack_bits(const_bit_span(packed, std::size(src)), dst);
+    EXPECT_TRUE(std::equal(std::begin(src), std::end(src), dst));
+
+    EXPECT_THROW(pack_bits(src, bit_span(packed, 8)), mboxid_error);
+    EXPECT_THROW(unpack_bits(const_bit_span(packed, 8), dst), mboxid_error);
+}
+
+struct kernels {
+    const char* name;
+    pack_bits_fn pack;
+    unpack_bits_fn unpack;
+    bool supported;
+};
+
+class BitPackKernelTest : public testing::TestWithParam<kernels> {};
+
+static void naive_pack(const bool* src, size_t n, uint8_t* dst) {
+    std::fill(dst, dst + (n + 7) / 8, 0);
+    for (size_t i = 0; i < n; ++i)
+        dst[i / 8] |= src[i] << (i % 8);
+}
+
+static void naive_unpack(const uint8_t* src, size_t n, bool* dst) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = src[i / 8] & (1 << (i % 8));
+}
+
+// Compares the kernels against a naive implementation for all sizes up to
+// the largest request, with unaligned source and destination.
+TEST_P(BitPackKernelTest, MatchesNaiveImplementation) {
+    auto k = GetParam();
+    if (!k.supported)
+        GTEST_SKIP() << k.name << " not supported by CPU";
+
+    constexpr size_t max_bits = 2000;
+    std::mt19937 rng(1);
+    std::vector<uint8_t> random(max_bits / 8 + 2);
+    for (auto& v : random)
+        v = static_cast<uint8_t>(rng());
+
+    std::vector<uint8_t> expected_bytes(max_bits / 8 + 2);
+    auto bools = std::make_unique<bool[]>(max_bits + 2);
+    std::vector<uint8_t> bytes(max_bits / 8 + 2);
+
+    for (size_t n = 0; n <= max_bits; n += (n < 300) ? 1 : 37) {
+        auto b = std::make_unique<bool[]>(n);
+        naive_unpack(random.data(), n, b.get());
+
+        std::fill(bytes.begin(), bytes.end(), 0xff);
+        std::fill(expected_bytes.begin(), expected_bytes.end(), 0xff);
+        naive_pack(b.get(), n, expected_bytes.data() + 1);
+        k.pack(b.get(), n, bytes.data() + 1);
+        ASSERT_EQ(bytes, expected_bytes) << k.name << " pack n=" << n;
+
+        std::fill(bools.get(), bools.get() + max_bits + 2, false);
+        k.unpack(random.data() + 1, n, bools.get() + 1);
+        naive_unpack(random.data() + 1, n, b.get());
+        ASSERT_TRUE(std::equal(b.get(), b.get() + n, bools.get() + 1))
+                << k.name << " unpack n=" << n;
+        ASSERT_FALSE(bools[n + 1]) << k.name << " unpack n=" << n;
+    }
+}
+
+static std::vector<kernels> all_kernels() {
+    return {
+            {"scalar", pack_bits_scalar, unpack_bits_scalar, true},
+#if defined(MBOXID_HAVE_X86_SIMD)
+            {"sse2", pack_bits_sse2, unpack_bits_sse2, true},
+            {"avx2", pack_bits_avx2, unpack_bits_avx2, cpu_has_avx2()},
+#endif
+    };
+}
+
+INSTANTIATE_TEST_SUITE_P(, BitPackKernelTest, testing::ValuesIn(all_kernels()),
+        [](const auto& info) { return std::string(info.param.name); });
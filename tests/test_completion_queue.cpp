@@ -0,0 +1,95 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <thread>
+#include <vector>
+#include <sys/eventfd.h>
+#include <gtest/gtest.h>
+#include "unique_fd.hpp"
+#include "completion_queue.hpp"
+
+using namespace mboxid;
+
+static completion_queue::entry make_entry(uint64_t client, uint64_t seq) {
+    auto e = std::make_unique<deferred_request::state>();
+    e->client = client;
+    e->seq = seq;
+    return e;
+}
+
+TEST(CompletionQueueTest, ClosedQueueDropsEntries) {
+    unique_fd efd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    ASSERT_NE(efd.get(), -1);
+    completion_queue queue(efd.get());
+    std::vector<completion_queue::entry> entries;
+
+    queue.post(make_entry(1, 0));
+    queue.take(entries);
+    EXPECT_TRUE(entries.empty());
+
+    queue.open();
+    queue.post(make_entry(1, 0));
+    queue.post(make_entry(1, 1));
+    queue.close();
+    queue.take(entries);
+    EXPECT_TRUE(entries.empty());
+}
+
+TEST(CompletionQueueTest, ConsumerIsNotWokenUpByItself) {
+    unique_fd efd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    ASSERT_NE(efd.get(), -1);
+    completion_queue queue(efd.get());
+    queue.open();
+
+    queue.post(make_entry(1, 0));
+    eventfd_t cnt;
+    EXPECT_EQ(eventfd_read(efd.get(), &cnt), -1);
+
+    std::thread([&]() { queue.post(make_entry(2, 0)); }).join();
+    EXPECT_EQ(eventfd_read(efd.get(), &cnt), -1) << "list was not empty";
+
+    std::vector<completion_queue::entry> entries;
+    queue.take(entries);
+    ASSERT_EQ(entries.size(), 2);
+    EXPECT_EQ(entries[0]->client, 1);
+    EXPECT_EQ(entries[1]->client, 2);
+
+    std::thread([&]() { queue.post(make_entry(3, 0)); }).join();
+    EXPECT_EQ(eventfd_read(efd.get(), &cnt), 0);
+    EXPECT_EQ(cnt, 1);
+}
+
+TEST(CompletionQueueTest, ManyProducers) {
+    constexpr int n_producers = 4;
+    constexpr uint64_t n_entries = 10000;
+
+    unique_fd efd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    ASSERT_NE(efd.get(), -1);
+    completion_queue queue(efd.get());
+    queue.open();
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < n_producers; ++i) {
+        producers.emplace_back([&queue, i]() {
+            for (uint64_t seq = 0; seq < n_entries; ++seq)
+                queue.post(make_entry(i, seq));
+        });
+    }
+
+    // The entries of each producer are taken in the order of posting.
+    std::vector<uint64_t> next_seq(n_producers, 0);
+    std::vector<completion_queue::entry> entries;
+    uint64_t total = 0;
+    while (total < n_producers * n_entries) {
+        queue.take(entries);
+        for (const auto& e : entries) {
+            EXPECT_EQ(e->seq, next_seq[e->client]);
+            ++next_seq[e->client];
+        }
+        total += entries.size();
+        entries.clear();
+    }
+
+    for (auto& t : producers)
+        t.join();
+}
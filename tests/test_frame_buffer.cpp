@@ -0,0 +1,122 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include "error_private.hpp"
+#include "frame_buffer.hpp"
+
+using namespace mboxid;
+using ::testing::ElementsAreArray;
+using ::testing::HasSubstr;
+
+// Read holding registers request with the given transaction id.
+static std::vector<uint8_t> make_request(uint8_t tid) {
+    return {0x00, tid, 0x00, 0x00, 0x00, 0x06, 0xff, 0x03, 0x00, 0x00, 0x00,
+            0x01};
+}
+
+static void put(frame_buffer& fb, std::span<const uint8_t> data) {
+    auto space = fb.space();
+    ASSERT_GE(space.size(), data.size());
+    std::copy(data.begin(), data.end(), space.begin());
+    fb.commit(data.size());
+}
+
+TEST(FrameBufferTest, SeveralFramesAtOnce) {
+    frame_buffer fb;
+    mbap_header header;
+    auto req1 = make_request(1);
+    auto req2 = make_request(2);
+
+    std::vector<uint8_t> data(req1);
+    data.insert(data.end(), req2.begin(), req2.end());
+    data.insert(data.end(), req1.begin(), req1.begin() + 3);
+    put(fb, data);
+
+    EXPECT_THAT(fb.next_frame(header), ElementsAreArray(req1));
+    EXPECT_EQ(header.transaction_id, 1);
+    EXPECT_EQ(header.unit_id, 0xff);
+    EXPECT_THAT(fb.next_frame(header), ElementsAreArray(req2));
+    EXPECT_EQ(header.transaction_id, 2);
+    EXPECT_TRUE(fb.next_frame(header).empty());
+    EXPECT_EQ(fb.size(), 3);
+}
+
+TEST(FrameBufferTest, FrameInPieces) {
+    frame_buffer fb;
+    mbap_header header;
+    auto req = make_request(7);
+
+    for (size_t i = 0; i < req.size(); ++i) {
+        EXPECT_TRUE(fb.next_frame(header).empty());
+        put(fb, std::span(req).subspan(i, 1));
+    }
+    EXPECT_THAT(fb.next_frame(header), ElementsAreArray(req));
+    EXPECT_EQ(header.transaction_id, 7);
+    EXPECT_TRUE(fb.empty());
+}
+
+TEST(FrameBufferTest, FramesStayContiguous) {
+    frame_buffer fb;
+    mbap_header header;
+    auto req = make_request(3);
+
+    // Feed the buffer with chunks not aligned to frames until it has been
+    // compacted several times.
+    std::vector<uint8_t> stream;
+    for (int i = 0; i < 1000; ++i)
+        stream.insert(stream.end(), req.begin(), req.end());
+
+    size_t n_frames = 0;
+    std::span<const uint8_t> data(stream);
+    while (!data.empty()) {
+        auto cnt = std::min<size_t>(data.size(), 100);
+        cnt = std::min(cnt, fb.space().size());
+        ASSERT_GT(cnt, 0);
+        put(fb, data.subspan(0, cnt));
+        data = data.subspan(cnt);
+
+        // Consume only one frame per chunk, so data accumulates.
+        if (auto frame = fb.next_frame(header); !frame.empty()) {
+            EXPECT_THAT(frame, ElementsAreArray(req));
+            ++n_frames;
+        }
+    }
+    while (!fb.next_frame(header).empty())
+        ++n_frames;
+
+    EXPECT_EQ(n_frames, 1000);
+    EXPECT_TRUE(fb.empty());
+}
+
+TEST(FrameBufferTest, FullBufferContainsFrame) {
+    frame_buffer fb;
+    mbap_header header;
+    auto req = make_request(4);
+
+    while (!fb.full()) {
+        auto space = fb.space();
+        auto cnt = std::min(space.size(), req.size());
+        std::copy(req.begin(), req.begin() + cnt, space.begin());
+        fb.commit(cnt);
+    }
+    EXPECT_TRUE(fb.space().empty());
+    EXPECT_FALSE(fb.next_frame(header).empty());
+    EXPECT_FALSE(fb.space().empty());
+}
+
+TEST(FrameBufferTest, InvalidHeader) {
+    frame_buffer fb;
+    mbap_header header;
+    auto req = make_request(5);
+    req[2] = 0x01; // protocol identifier
+
+    put(fb, req);
+    EXPECT_EQ(fb.error(), errc::none);
+    EXPECT_TRUE(fb.next_frame(header).empty());
+    EXPECT_EQ(fb.error(), errc::parse_error);
+    EXPECT_THAT(fb.error_message(), HasSubstr("protocol identifier"));
+}
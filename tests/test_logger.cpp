@@ -1,8 +1,14 @@
 // Copyright (c) 2024, Franz Hollerer.
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <fmt/format.h>
 #include <mboxid/error.hpp>
 #include "logger_private.hpp"
 
@@ -45,3 +51,130 @@ TEST(LoggerTest, UseLogger) {
     //      deleted but never is.
     install_logger(log::make_standard_logger());
 }
+
+// Counts how often it is formatted.
+struct counted_arg {};
+static int n_formatted = 0;
+
+template <> struct fmt::formatter<counted_arg> : fmt::formatter<int> {
+    auto format(const counted_arg&, fmt::format_context& ctx) const {
+        ++n_formatted;
+        return fmt::formatter<int>::format(42, ctx);
+    }
+};
+
+TEST(LoggerTest, LevelFiltering) {
+    auto logger = std::make_unique<LoggerMock>();
+    install_logger(std::move(logger));
+    const auto* mock = dynamic_cast<const LoggerMock*>(log::borrow_logger());
+
+    EXPECT_CALL(*mock, debug).Times(0);
+    EXPECT_CALL(*mock, info).Times(0);
+    EXPECT_CALL(*mock, auth).Times(0);
+    EXPECT_CALL(*mock, warning("warning 42")).Times(1);
+    EXPECT_CALL(*mock, error("error 42")).Times(1);
+
+    log::set_level(log::level::warning);
+    EXPECT_EQ(log::get_level(), log::level::warning);
+
+    n_formatted = 0;
+    log::debug("debug {}", counted_arg{});
+    log::info("info {}", counted_arg{});
+    log::auth("auth {}", counted_arg{});
+    EXPECT_EQ(n_formatted, 0);
+
+    log::warning("warning {}", counted_arg{});
+    log::error("error {}", counted_arg{});
+    EXPECT_EQ(n_formatted, 2);
+
+    log::set_level(log::level::off);
+    log::error("error {}", counted_arg{});
+    EXPECT_EQ(n_formatted, 2);
+
+    log::set_level(log::level::debug);
+    install_logger(log::make_standard_logger());
+}
+
+TEST(LoggerTest, AsyncLogger) {
+    auto sink = std::make_unique<LoggerMock>();
+    const auto* mock = sink.get();
+    install_logger(std::make_unique<log::async_logger>(std::move(sink)));
+    const auto* logger =
+            dynamic_cast<const log::async_logger*>(log::borrow_logger());
+
+    EXPECT_CALL(*mock, debug("debug 3.14")).Times(1);
+    EXPECT_CALL(*mock, info("info 3.15")).Times(1);
+    EXPECT_CALL(*mock, warning("warning 3.16")).Times(1);
+    EXPECT_CALL(*mock, error(("error 3.17 [::1]:1502"))).Times(1);
+    EXPECT_CALL(*mock, auth("auth 3.18")).Times(1);
+    EXPECT_CALL(*mock, info("passed as is")).Times(1);
+
+    log::debug("debug {}.{}", 3, 14);
+    log::info("info {}", 3.15);
+    log::warning("warning {}.{}", 3, 16);
+    {
+        // The strings are copied, not referenced.
+        std::string host("::1");
+        std::string msg("3.17");
+        log::error("error {} [{}]:{}", msg.c_str(), host, "1502");
+    }
+    log::auth("auth {}.{}", 3, 18);
+    logger->info("passed as is");
+
+    logger->flush();
+    EXPECT_EQ(logger->dropped(), 0);
+
+    install_logger(log::make_standard_logger());
+}
+
+// Sink which blocks on the first message until it is released.
+class blocking_sink : public log::logger_base {
+public:
+    void debug(std::string_view msg) const override { put(msg); }
+    void info(std::string_view msg) const override { put(msg); }
+    void warning(std::string_view msg) const override { put(msg); }
+    void error(std::string_view msg) const override { put(msg); }
+    void auth(std::string_view msg) const override { put(msg); }
+
+    std::vector<std::string> messages() const {
+        std::lock_guard lk(mtx);
+        return msgs;
+    }
+
+    mutable std::atomic<bool> blocked{false};
+    mutable std::atomic<bool> released{false};
+
+private:
+    mutable std::mutex mtx;
+    mutable std::vector<std::string> msgs;
+
+    void put(std::string_view msg) const {
+        if (!blocked.exchange(true)) {
+            while (!released)
+                std::this_thread::yield();
+        }
+        std::lock_guard lk(mtx);
+        msgs.emplace_back(msg);
+    }
+};
+
+TEST(LoggerTest, AsyncLoggerDropsMessages) {
+    auto sink = std::make_unique<blocking_sink>();
+    auto* blocking = sink.get();
+    log::async_logger logger(std::move(sink), 2);
+
+    logger.info("first");
+    while (!blocking->blocked)
+        std::this_thread::yield();
+
+    // The ring holds two messages while the sink is blocked.
+    for (int i = 0; i < 10; ++i)
+        logger.info(std::to_string(i));
+    EXPECT_EQ(logger.dropped(), 8);
+
+    blocking->released = true;
+    logger.flush();
+    EXPECT_EQ(blocking->messages(),
+            (std::vector<std::string>{
+                    "first", "0", "1", "8 log message(s) dropped"}));
+}
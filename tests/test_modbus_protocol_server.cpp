@@ -1,6 +1,10 @@
 // Copyright (c) 2024, Franz Hollerer.
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <mboxid/error.hpp>
@@ -13,6 +17,27 @@ using testing::Return;
 using testing::DoAll;
 using testing::Exactly;
 
+// Counts the heap allocations of this test program. The operators are not
+// inlined, as GCC would then warn about memory allocated by new being
+// released by free().
+static std::atomic<std::size_t> n_allocs{0};
+
+__attribute__((noinline)) void* operator new(std::size_t sz) {
+    ++n_allocs;
+    if (auto p = std::malloc(sz ? sz : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(
+        void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
 using U8Vec = std::vector<uint8_t>;
 using U16Vec = std::vector<uint16_t>;
 using BoolVec = std::vector<bool>;
@@ -45,6 +70,82 @@ public:
             (override));
 };
 
+// Backend implementing the allocation-free interface only.
+class SpanBackend : public backend_connector {
+public:
+    errc read_coils_span(unsigned addr, bit_span bits) override {
+        for (std::size_t i = 0; i < bits.size(); ++i)
+            bits.set(i, coils[addr + i]);
+        return errc::none;
+    }
+
+    errc read_holding_registers_span(
+            unsigned addr, std::span<std::uint16_t> regs) override {
+        std::copy_n(holding_registers + addr, regs.size(), regs.begin());
+        return errc::none;
+    }
+
+    errc write_coils_span(unsigned addr, const_bit_span bits) override {
+        for (std::size_t i = 0; i < bits.size(); ++i)
+            coils[addr + i] = bits[i];
+        return errc::none;
+    }
+
+    errc write_holding_registers_span(
+            unsigned addr, std::span<const std::uint16_t> regs) override {
+        std::copy(regs.begin(), regs.end(), holding_registers + addr);
+        return errc::none;
+    }
+
+    errc write_read_holding_registers_span(unsigned addr_wr,
+            std::span<const std::uint16_t> regs_wr, unsigned addr_rd,
+            std::span<std::uint16_t> regs_rd) override {
+        write_holding_registers_span(addr_wr, regs_wr);
+        return read_holding_registers_span(addr_rd, regs_rd);
+    }
+
+    bool coils[32] = {};
+    uint16_t holding_registers[32] = {};
+};
+
+TEST(ModbusProtocolServerTest, SpanInterfaceDoesNotAllocate) {
+    SpanBackend backend;
+    std::vector<U8Vec> reqs{
+            {0x0f, 0x00, 0x02, 0x00, 0x0a, 0x02, 0xcd, 0x01}, // write coils
+            {0x05, 0x00, 0x00, 0xff, 0x00},                   // write coil
+            {0x01, 0x00, 0x00, 0x00, 0x0c},                   // read coils
+            {0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0a, 0x01, 0x02},
+            {0x06, 0x00, 0x00, 0x12, 0x34},                   // write register
+            {0x16, 0x00, 0x00, 0x00, 0xf2, 0x00, 0x25},       // mask write
+            {0x03, 0x00, 0x00, 0x00, 0x03},                   // read registers
+            {0x17, 0x00, 0x01, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x02, 0xab,
+                    0xcd},                                    // read/write
+    };
+    std::vector<U8Vec> rsps_expected{
+            {0x0f, 0x00, 0x02, 0x00, 0x0a},
+            {0x05, 0x00, 0x00, 0xff, 0x00},
+            {0x01, 0x02, 0x35, 0x07},
+            {0x10, 0x00, 0x01, 0x00, 0x02},
+            {0x06, 0x00, 0x00, 0x12, 0x34},
+            {0x16, 0x00, 0x00, 0x00, 0xf2, 0x00, 0x25},
+            {0x03, 0x06, 0x00, 0x35, 0x00, 0x0a, 0x01, 0x02},
+            {0x17, 0x02, 0x00, 0x0a},
+    };
+    std::vector<U8Vec> rsps(reqs.size(), U8Vec(max_pdu_size));
+    std::vector<size_t> cnts(reqs.size());
+
+    auto allocs_before = n_allocs.load();
+    for (size_t i = 0; i < reqs.size(); ++i)
+        cnts[i] = server_engine(backend, reqs[i], rsps[i]);
+    EXPECT_EQ(n_allocs.load(), allocs_before);
+
+    for (size_t i = 0; i < reqs.size(); ++i) {
+        rsps[i].resize(cnts[i]);
+        EXPECT_EQ(rsps[i], rsps_expected[i]) << "request " << i;
+    }
+    EXPECT_EQ(backend.holding_registers[2], 0xabcd);
+}
+
 TEST(ModbusProtocolServerTest, IllegalFunction) {
     U8Vec req{0x55, 0};
     U8Vec rsp_expected{0x55 | 0x80, 1};
@@ -57,6 +158,31 @@ TEST(ModbusProtocolServerTest, IllegalFunction) {
     EXPECT_EQ(rsp, rsp_expected);
 }
 
+TEST(ModbusProtocolServerTest, MalformedRequests) {
+    BackendConnectorMock backend;
+    backend_state state;
+    U8Vec rsp(max_pdu_size);
+
+    const U8Vec reqs[] = {
+        {0x03},                                     // too short for any PDU
+        {0x01, 0x00, 0x00, 0x00},                   // wrong length
+        {0x03, 0x00, 0x00, 0x00, 0x01, 0x00},       // wrong length
+        {0x05, 0x00, 0x00, 0xff},                   // wrong length
+        {0x0f, 0x00, 0x00, 0x00},                   // too short
+        {0x0f, 0x00, 0x00, 0x00, 0x10, 0x02, 0xff}, // data truncated
+        {0x10, 0x00, 0x00, 0x00, 0x02, 0x04, 0x00, 0x01}, // data truncated
+        {0x17, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00},
+        {0x2b, 0x0e, 0x01},                         // wrong length
+    };
+
+    for (const auto& req : reqs) {
+        size_t cnt = 0;
+        EXPECT_EQ(server_engine(backend, &state, 1, req, rsp, cnt),
+                errc::parse_error);
+        EXPECT_EQ(cnt, 0);
+    }
+}
+
 TEST(ModbusProtocolServerTest, ReadCoils) {
     {
         // successful request
@@ -591,14 +717,15 @@ TEST(ModbusProtocolServerTest, ReadDeviceIdentification) {
         EXPECT_EQ(rsp, rsp_expected);
     }
     {
-        // wrong object id --> illegal data address exception
+        // unknown object id --> stream restarts at object 0
         mboxid::backend_connector backend;
         U8Vec req{0x2b, 0x0e, 0x01, 0xff};
-        U8Vec rsp_expected{0x80 | 0x2b, 0x02};
+        U8Vec req_first{0x2b, 0x0e, 0x01, 0x00};
         U8Vec rsp(max_pdu_size);
+        U8Vec rsp_expected(max_pdu_size);
 
         auto cnt = server_engine(backend, req, rsp);
-        EXPECT_EQ(cnt, rsp_expected.size());
+        rsp_expected.resize(server_engine(backend, req_first, rsp_expected));
         rsp.resize(cnt);
         EXPECT_EQ(rsp, rsp_expected);
     }
@@ -616,6 +743,179 @@ TEST(ModbusProtocolServerTest, ReadDeviceIdentification) {
     }
 }
 
+// Backend with regular and extended objects, which counts how often they are
+// read.
+class DeviceIdentificationBackend : public backend_connector {
+public:
+    errc get_device_identification(device_identification& id) override {
+        ++reads;
+        id = ident;
+        return errc::none;
+    }
+
+    std::uint64_t device_identification_revision() override {
+        return revision;
+    }
+
+    device_identification ident{"vendor", "code", "1.0", "url", "", "model",
+            "app", {{0x80, std::string(200, 'a')}, {0x81, "b"},
+                           {0x90, std::string(240, 'c')}}};
+    std::uint64_t revision = 0;
+    int reads = 0;
+};
+
+// Returns the response header for the object list \a objects.
+static U8Vec device_identification_response(unsigned code, unsigned more,
+        unsigned next_id, const std::vector<std::pair<unsigned, std::string>>&
+                objects) {
+    U8Vec rsp{0x2b, 0x0e, static_cast<uint8_t>(code), 0x03,
+            static_cast<uint8_t>(more), static_cast<uint8_t>(next_id),
+            static_cast<uint8_t>(objects.size())};
+    for (const auto& [id, val] : objects) {
+        rsp.push_back(id);
+        rsp.push_back(val.size());
+        rsp.insert(rsp.end(), val.begin(), val.end());
+    }
+    return rsp;
+}
+
+TEST(ModbusProtocolServerTest, ReadDeviceIdentificationCategories) {
+    DeviceIdentificationBackend backend;
+    backend_state state;
+    U8Vec rsp(max_pdu_size);
+
+    auto request = [&](uint8_t code, uint8_t id) {
+        U8Vec req{0x2b, 0x0e, code, id};
+        size_t cnt = 0;
+        if (auto res = server_engine(backend, &state, 1, req, rsp, cnt);
+                res != errc::none)
+            throw mboxid_error(res, "server engine");
+        return U8Vec(rsp.begin(), rsp.begin() + cnt);
+    };
+
+    // basic and regular objects, the empty product name is skipped
+    EXPECT_EQ(request(0x01, 0x00),
+            device_identification_response(0x01, 0x00, 0x00,
+                    {{0x00, "vendor"}, {0x01, "code"}, {0x02, "1.0"}}));
+    EXPECT_EQ(request(0x02, 0x01),
+            device_identification_response(0x02, 0x00, 0x00,
+                    {{0x01, "code"}, {0x02, "1.0"}, {0x03, "url"},
+                            {0x05, "model"}, {0x06, "app"}}));
+
+    // The extended objects don't fit into a single response.
+    EXPECT_EQ(request(0x03, 0x00),
+            device_identification_response(0x03, 0xff, 0x90,
+                    {{0x00, "vendor"}, {0x01, "code"}, {0x02, "1.0"},
+                            {0x03, "url"}, {0x05, "model"}, {0x06, "app"},
+                            {0x80, std::string(200, 'a')}, {0x81, "b"}}));
+    EXPECT_EQ(request(0x03, 0x80),
+            device_identification_response(0x03, 0xff, 0x90,
+                    {{0x80, std::string(200, 'a')}, {0x81, "b"}}));
+    EXPECT_EQ(request(0x03, 0x90),
+            device_identification_response(0x03, 0x00, 0x00,
+                    {{0x90, std::string(240, 'c')}}));
+
+    // A stream access starting at an object which doesn't exist or is not
+    // part of the category restarts at object 0.
+    auto regular = device_identification_response(0x02, 0x00, 0x00,
+            {{0x00, "vendor"}, {0x01, "code"}, {0x02, "1.0"}, {0x03, "url"},
+                    {0x05, "model"}, {0x06, "app"}});
+    EXPECT_EQ(request(0x02, 0x04), regular);
+    EXPECT_EQ(request(0x02, 0x80), regular);
+    EXPECT_EQ(request(0x01, 0x03),
+            device_identification_response(0x01, 0x00, 0x00,
+                    {{0x00, "vendor"}, {0x01, "code"}, {0x02, "1.0"}}));
+    EXPECT_EQ(request(0x03, 0x7f),
+            device_identification_response(0x03, 0xff, 0x90,
+                    {{0x00, "vendor"}, {0x01, "code"}, {0x02, "1.0"},
+                            {0x03, "url"}, {0x05, "model"}, {0x06, "app"},
+                            {0x80, std::string(200, 'a')}, {0x81, "b"}}));
+
+    // individual access is not supported
+    EXPECT_EQ(request(0x04, 0x00), (U8Vec{0x80 | 0x2b, 0x03}));
+
+    // The objects are read again only if their revision changes.
+    EXPECT_EQ(backend.reads, 1);
+    backend.ident.vendor_name = "other";
+    ++backend.revision;
+    EXPECT_EQ(request(0x01, 0x00),
+            device_identification_response(0x01, 0x00, 0x00,
+                    {{0x00, "other"}, {0x01, "code"}, {0x02, "1.0"}}));
+    EXPECT_EQ(backend.reads, 2);
+
+    // objects too long to fit into a response
+    backend.ident.extended[0x82] = std::string(245, 'x');
+    ++backend.revision;
+    EXPECT_THROW(request(0x01, 0x00), mboxid_error);
+}
+
+TEST(ModbusProtocolServerTest, UserFunctionHandlers) {
+    BackendConnectorMock backend;
+    function_table functions;
+    backend_state state;
+    state.functions = &functions;
+    U8Vec rsp(max_pdu_size);
+
+    auto execute = [&](const U8Vec& req) {
+        size_t cnt = 0;
+        return server_engine(backend, &state, 1, req, rsp, cnt);
+    };
+    auto request = [&](const U8Vec& req) {
+        size_t cnt = 0;
+        EXPECT_EQ(server_engine(backend, &state, 1, req, rsp, cnt), errc::none);
+        return U8Vec(rsp.begin(), rsp.begin() + cnt);
+    };
+
+    // echoes the request with the function code 0x41
+    functions.set_handler(0x41,
+            [](backend_connector&, std::span<const uint8_t> req,
+                    std::span<uint8_t> rsp, size_t& rsp_size) {
+                if (req.size() < 3)
+                    return errc::modbus_exception_illegal_data_value;
+                std::copy(req.begin(), req.end(), rsp.begin());
+                rsp_size = req.size();
+                return errc::none;
+            });
+    EXPECT_EQ(request({0x41, 1, 2, 3}), (U8Vec{0x41, 1, 2, 3}));
+    EXPECT_EQ(request({0x41, 1}), (U8Vec{0x80 | 0x41, 0x03}));
+
+    // Other function codes are still illegal.
+    EXPECT_EQ(request({0x42, 1}), (U8Vec{0x80 | 0x42, 0x01}));
+    EXPECT_EQ(request({0x80 | 0x41, 1}), (U8Vec{0x80 | 0x41, 0x01}));
+
+    // errors of the handler
+    functions.set_handler(0x42,
+            [](backend_connector&, std::span<const uint8_t>,
+                    std::span<uint8_t>, size_t&) { return errc::timeout; });
+    EXPECT_EQ(execute({0x42, 1}), errc::timeout);
+    functions.set_handler(0x43,
+            [](backend_connector&, std::span<const uint8_t>,
+                    std::span<uint8_t> rsp, size_t& rsp_size) {
+                rsp_size = rsp.size() + 1;
+                return errc::none;
+            });
+    EXPECT_EQ(request({0x43, 1}), (U8Vec{0x80 | 0x43, 0x04}));
+    functions.set_handler(0x44,
+            [](backend_connector&, std::span<const uint8_t>,
+                    std::span<uint8_t>, size_t& rsp_size) {
+                rsp_size = 0;
+                return errc::none;
+            });
+    EXPECT_EQ(request({0x44, 1}), (U8Vec{0x80 | 0x44, 0x04}));
+
+    // removal
+    functions.set_handler(0x41, nullptr);
+    EXPECT_EQ(request({0x41, 1, 2, 3}), (U8Vec{0x80 | 0x41, 0x01}));
+
+    // The standard function codes can't be replaced.
+    auto handler = [](backend_connector&, std::span<const uint8_t>,
+                           std::span<uint8_t>, size_t&) { return errc::none; };
+    EXPECT_THROW(functions.set_handler(0x03, handler), mboxid_error);
+    EXPECT_THROW(functions.set_handler(0x2b, handler), mboxid_error);
+    EXPECT_THROW(functions.set_handler(0x00, handler), mboxid_error);
+    EXPECT_THROW(functions.set_handler(0x80, handler), mboxid_error);
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
     GTEST_FLAG_SET(catch_exceptions, 0);
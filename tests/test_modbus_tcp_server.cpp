@@ -3,9 +3,15 @@
 
 #include <thread>
 #include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <mboxid/modbus_tcp_server.hpp>
+#include <mboxid/async_backend_connector.hpp>
+#include <mboxid/register_map_backend.hpp>
 #include "modbus_protocol_common.hpp"
 #include "network_private.hpp"
 
@@ -33,6 +39,30 @@ TEST(ModbusTcpServerBasicTest, Shutdown) {
     (void)f.get(); // check for exception thrown by the server
 }
 
+TEST(ModbusTcpServerBasicTest, PipelineDepth) {
+    modbus_tcp_server server;
+    EXPECT_THROW(server.set_pipeline_depth(0), mboxid_error);
+    EXPECT_THROW(server.set_pipeline_depth(65), mboxid_error);
+    EXPECT_NO_THROW(server.set_pipeline_depth(1));
+    EXPECT_NO_THROW(server.set_pipeline_depth(64));
+}
+
+// The replicas of a backend factory are only invoked by their own thread,
+// which worker threads would break.
+TEST(ModbusTcpServerBasicTest, BackendFactoryWithWorkers) {
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502");
+    server.set_backend_factory(
+            []() { return std::make_unique<backend_connector>(); });
+    server.set_worker_threads(1);
+    try {
+        server.run();
+        ADD_FAILURE() << "run() accepted a backend factory with workers";
+    } catch (const mboxid_error& e) {
+        EXPECT_EQ(e.code(), errc::invalid_argument);
+    }
+}
+
 class BackendConnectorMock : public backend_connector {
 public:
     MOCK_METHOD(void, ticker, (), (override));
@@ -46,13 +76,17 @@ public:
     MOCK_METHOD(void, alive, (client_id id), (override));
 };
 
-class ModbusTcpServerTest : public ::testing::Test {
+using transport = modbus_tcp_server::transport;
+
+// The server tests are run with every transport.
+class ModbusTcpServerTest : public ::testing::TestWithParam<transport> {
 protected:
     ModbusTcpServerTest() {
         using namespace std::chrono_literals;
 
         server = std::make_unique<modbus_tcp_server>();
         server->set_server_addr("localhost", "1502");
+        server->set_transport(GetParam());
         auto backend_ = std::make_unique<NiceMock<BackendConnectorMock>>();
         server->set_backend(std::move(backend_));
         backend = dynamic_cast<BackendConnectorMock*>(server->borrow_backend());
@@ -104,12 +138,12 @@ static ssize_t receive_all(int fd, uint8_t* buf, size_t cnt) {
     return static_cast<ssize_t>(cnt);
 }
 
-TEST_F(ModbusTcpServerTest, Ticker) {
+TEST_P(ModbusTcpServerTest, Ticker) {
     EXPECT_CALL(*backend, ticker).Times(Between(1, 2));
     sleep(2);
 }
 
-TEST_F(ModbusTcpServerTest, RequestResponse) {
+TEST_P(ModbusTcpServerTest, RequestResponse) {
     using namespace std::chrono_literals;
 
     EXPECT_CALL(*backend, authorize).Times(1).WillOnce(Return(true));
@@ -143,7 +177,128 @@ TEST_F(ModbusTcpServerTest, RequestResponse) {
     usleep(100000);
 }
 
-TEST_F(ModbusTcpServerTest, CloseClientConnection) {
+TEST_P(ModbusTcpServerTest, MultipleClients) {
+    using namespace std::chrono_literals;
+    constexpr int n_clients = 4;
+
+    EXPECT_CALL(*backend, authorize).Times(n_clients).WillRepeatedly(
+            Return(true));
+    EXPECT_CALL(*backend, disconnect).Times(n_clients);
+    EXPECT_CALL(*backend, alive).Times(2 * n_clients);
+
+    std::vector<int> fds;
+    for (int i = 0; i < n_clients; ++i) {
+        int fd = connect_to_server();
+        ASSERT_NE(fd, -1);
+        fds.push_back(fd);
+    }
+
+    U8Vec req{0x47, 0x11, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x01, 0x00, 0x00, 0x00,
+            0x01};
+    U8Vec rsp_expected{0x47, 0x11, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x81, 0x01};
+
+    // Two rounds to make sure each connection switches back to receiving
+    // after the response has been sent.
+    for (int round = 0; round < 2; ++round) {
+        for (auto fd : fds) {
+            auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+            EXPECT_EQ(res, req.size());
+        }
+
+        for (auto fd : fds) {
+            U8Vec rsp(rsp_expected.size());
+            auto f = std::async(std::launch::async, receive_all, fd,
+                    rsp.data(), rsp.size());
+
+            EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+                    << "server did not respond within the time limit";
+            EXPECT_GT(f.get(), 0);
+            EXPECT_EQ(rsp, rsp_expected);
+        }
+    }
+
+    for (auto fd : fds)
+        close(fd);
+    // give server time to close the connections
+    usleep(100000);
+}
+
+TEST_P(ModbusTcpServerTest, BackToBackRequests) {
+    using namespace std::chrono_literals;
+
+    EXPECT_CALL(*backend, authorize).Times(1).WillOnce(Return(true));
+    EXPECT_CALL(*backend, disconnect).Times(1);
+    EXPECT_CALL(*backend, alive).Times(2);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    // The second request arrives while the server is busy with the first.
+    U8Vec req{0x47, 0x11, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x01, 0x00, 0x00, 0x00,
+            0x01, 0x47, 0x12, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x01, 0x00, 0x00,
+            0x00, 0x01};
+    U8Vec rsp_expected{0x47, 0x11, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x81, 0x01,
+            0x47, 0x12, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x81, 0x01};
+    U8Vec rsp(rsp_expected.size());
+
+    auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+    EXPECT_EQ(res, req.size());
+
+    auto f = std::async(
+            std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+
+    EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f.get(), 0);
+    EXPECT_EQ(rsp, rsp_expected);
+
+    close(fd);
+    // give server time to close the connection
+    usleep(100000);
+}
+
+TEST_P(ModbusTcpServerTest, RequestBurstExceedingReceiveBuffer) {
+    using namespace std::chrono_literals;
+    constexpr int n_requests = 500;
+
+    EXPECT_CALL(*backend, authorize).Times(1).WillOnce(Return(true));
+    EXPECT_CALL(*backend, disconnect).Times(1);
+    EXPECT_CALL(*backend, alive).Times(n_requests);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    // The requests don't fit into the receive buffer of the server at once.
+    U8Vec req;
+    U8Vec rsp_expected;
+    for (int i = 0; i < n_requests; ++i) {
+        uint8_t hi = i >> 8;
+        uint8_t lo = i & 0xff;
+        U8Vec r{hi, lo, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x01, 0x00, 0x00, 0x00,
+                0x01};
+        U8Vec e{hi, lo, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x81, 0x01};
+        req.insert(req.end(), r.begin(), r.end());
+        rsp_expected.insert(rsp_expected.end(), e.begin(), e.end());
+    }
+    U8Vec rsp(rsp_expected.size());
+
+    auto f = std::async(
+            std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+
+    auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+    EXPECT_EQ(res, req.size());
+
+    EXPECT_EQ(f.wait_for(1000ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f.get(), 0);
+    EXPECT_EQ(rsp, rsp_expected);
+
+    close(fd);
+    // give server time to close the connection
+    usleep(100000);
+}
+
+TEST_P(ModbusTcpServerTest, CloseClientConnection) {
     using namespace std::chrono_literals;
 
     volatile modbus_tcp_server::client_id id = 0;
@@ -174,7 +329,7 @@ TEST_F(ModbusTcpServerTest, CloseClientConnection) {
     close(fd);
 }
 
-TEST_F(ModbusTcpServerTest, IdleTimeout) {
+TEST_P(ModbusTcpServerTest, IdleTimeout) {
     using namespace std::chrono_literals;
 
     EXPECT_CALL(*backend, authorize).Times(1).WillOnce(Return(true));
@@ -192,11 +347,12 @@ TEST_F(ModbusTcpServerTest, IdleTimeout) {
             << "server did not respond within the time limit";
     auto res = f.get(); // check for exception thrown by the server
     EXPECT_EQ(res, 0);
+    EXPECT_EQ(server->metrics().idle_timeouts, 1);
 
     close(fd);
 }
 
-TEST_F(ModbusTcpServerTest, RequestTimeout) {
+TEST_P(ModbusTcpServerTest, RequestTimeout) {
     using namespace std::chrono_literals;
 
     EXPECT_CALL(*backend, authorize).Times(1).WillOnce(Return(true));
@@ -221,8 +377,933 @@ TEST_F(ModbusTcpServerTest, RequestTimeout) {
             << "server did not respond within the time limit";
     res = f.get(); // check for exception thrown by the server
     EXPECT_EQ(res, 0);
+    EXPECT_EQ(server->metrics().request_complete_timeouts, 1);
+
+    close(fd);
+}
+
+INSTANTIATE_TEST_SUITE_P(Transports, ModbusTcpServerTest,
+        testing::Values(transport::epoll, transport::io_uring),
+        [](const auto& info) {
+            return (info.param == transport::epoll) ? "epoll" : "io_uring";
+        });
+
+// Backend used by several server threads. Each instance records the clients
+// it has been asked to authorize.
+class RecordingBackend : public backend_connector {
+public:
+    RecordingBackend(std::mutex& mtx, std::vector<client_id>& ids)
+            : mtx(mtx), ids(ids) {}
+
+    bool authorize(client_id id, const net::endpoint_addr&, const sockaddr*,
+            socklen_t) override {
+        std::lock_guard lk(mtx);
+        ids.push_back(id);
+        return true;
+    }
+
+private:
+    std::mutex& mtx;
+    std::vector<client_id>& ids;
+};
+
+class ModbusTcpServerThreadTest : public ::testing::TestWithParam<transport> {
+};
+
+TEST_P(ModbusTcpServerThreadTest, MultipleThreads) {
+    using namespace std::chrono_literals;
+    constexpr unsigned n_threads = 4;
+    constexpr int n_clients = 4;
+
+    std::mutex mtx;
+    std::vector<modbus_tcp_server::client_id> ids;
+    std::atomic<unsigned> n_backends = 0;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_thread_count(n_threads);
+    server.set_transport(GetParam());
+    server.set_backend_factory([&]() {
+        ++n_backends;
+        return std::make_unique<RecordingBackend>(mtx, ids);
+    });
+    EXPECT_EQ(server.borrow_backend(), nullptr);
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+    EXPECT_EQ(n_backends, n_threads);
+
+    std::vector<int> fds;
+    for (int i = 0; i < n_clients; ++i) {
+        int fd = connect_to_server();
+        ASSERT_NE(fd, -1);
+        fds.push_back(fd);
+    }
+
+    U8Vec req{0x47, 0x11, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x01, 0x00, 0x00, 0x00,
+            0x01};
+    U8Vec rsp_expected{0x47, 0x11, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x81, 0x01};
+
+    for (auto fd : fds) {
+        auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+        EXPECT_EQ(res, req.size());
+
+        U8Vec rsp(rsp_expected.size());
+        auto f = std::async(
+                std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+        EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+                << "server did not respond within the time limit";
+        EXPECT_GT(f.get(), 0);
+        EXPECT_EQ(rsp, rsp_expected);
+    }
+
+    // Closing a connection is routed to the thread serving it.
+    std::vector<modbus_tcp_server::client_id> ids_;
+    {
+        std::lock_guard lk(mtx);
+        ids_ = ids;
+    }
+    ASSERT_EQ(ids_.size(), n_clients);
+    for (auto id : ids_)
+        server.close_client_connection(id);
+
+    for (auto fd : fds) {
+        U8Vec rsp(max_pdu_size);
+        auto f = std::async(
+                std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+        EXPECT_EQ(f.wait_for(500ms), std::future_status::ready)
+                << "server did not close the connection";
+        EXPECT_EQ(f.get(), 0);
+        close(fd);
+    }
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// Backend answering read requests with as many registers as requested.
+class BulkReadBackend : public RecordingBackend {
+public:
+    using RecordingBackend::RecordingBackend;
+
+    errc read_holding_registers(unsigned, std::size_t cnt,
+            std::vector<uint16_t>& regs) override {
+        regs.assign(cnt, 0);
+        return errc::none;
+    }
+};
+
+// A client which does not read its responses is closed while the server
+// is still sending. The server keeps serving other clients.
+TEST_P(ModbusTcpServerThreadTest, CloseWhileSending) {
+    using namespace std::chrono_literals;
+
+    std::mutex mtx;
+    std::vector<modbus_tcp_server::client_id> ids;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<BulkReadBackend>(mtx, ids));
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+    ASSERT_NE(fcntl(fd, F_SETFL, O_NONBLOCK), -1);
+
+    // read 125 holding registers, until neither side accepts more data
+    U8Vec req{0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00, 0x00,
+            0x00, 0x7d};
+    for (int n_blocked = 0; n_blocked < 3;) {
+        if (write(fd, req.data(), req.size()) != -1) {
+            n_blocked = 0;
+            continue;
+        }
+        ASSERT_EQ(errno, EAGAIN);
+        ++n_blocked;
+        usleep(50000);
+    }
+
+    modbus_tcp_server::client_id id;
+    {
+        std::lock_guard lk(mtx);
+        ASSERT_EQ(ids.size(), 1);
+        id = ids.front();
+    }
+    server.close_client_connection(id);
+    usleep(100000);
+    close(fd);
+
+    fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+    auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+    EXPECT_EQ(res, req.size());
+    U8Vec rsp(mbap_header_size + 2 + 2 * 125);
+    auto f = std::async(
+            std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+    EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f.get(), 0);
+    close(fd);
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+INSTANTIATE_TEST_SUITE_P(Transports, ModbusTcpServerThreadTest,
+        testing::Values(transport::epoll, transport::io_uring),
+        [](const auto& info) {
+            return (info.param == transport::epoll) ? "epoll" : "io_uring";
+        });
+
+// Asynchronous backend which leaves the completion of requests to the test.
+class DeferringBackend : public async_backend_connector {
+public:
+    void submit(deferred_request req) override {
+        std::lock_guard lk(mtx);
+        reqs.push_back(std::move(req));
+        cv.notify_all();
+    }
+
+    errc read_holding_registers(unsigned addr, std::size_t cnt,
+            std::vector<uint16_t>& regs) override {
+        regs.assign(cnt, addr);
+        return errc::none;
+    }
+
+    // Waits until n requests have been submitted and takes them.
+    std::vector<deferred_request> take(size_t n) {
+        using namespace std::chrono_literals;
+        std::unique_lock lk(mtx);
+        if (!cv.wait_for(lk, 1s, [&]() { return reqs.size() >= n; }))
+            return {};
+        return std::move(reqs);
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<deferred_request> reqs;
+};
+
+class ModbusTcpServerAsyncTest : public ::testing::TestWithParam<transport> {
+};
+
+TEST_P(ModbusTcpServerAsyncTest, DeferredCompletion) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<DeferringBackend>());
+    auto backend = dynamic_cast<DeferringBackend*>(server.borrow_backend());
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    // read holding registers 1, 2 and 3
+    U8Vec req{0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00, 0x01,
+            0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00,
+            0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03,
+            0x00, 0x03, 0x00, 0x01};
+    U8Vec rsp_expected{0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+            0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+            0x00, 0x02, 0x00, 0x03, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+            0x00, 0x03};
+    U8Vec rsp(rsp_expected.size());
+
+    auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+    EXPECT_EQ(res, req.size());
+
+    auto reqs = backend->take(3);
+    ASSERT_EQ(reqs.size(), 3);
+    EXPECT_EQ(reqs[0].function_code(), 0x03);
+
+    // Complete the requests in reverse order from another thread. The
+    // responses are sent in the order of the requests nevertheless.
+    std::thread([&]() {
+        for (auto it = reqs.rbegin(); it != reqs.rend(); ++it) {
+            it->execute(*backend);
+            EXPECT_FALSE(*it);
+            usleep(10000);
+        }
+    }).join();
+
+    auto f = std::async(
+            std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+    EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f.get(), 0);
+    EXPECT_EQ(rsp, rsp_expected);
+
+    // A request dropped by the backend fails with an exception response.
+    res = TEMP_FAILURE_RETRY(write(fd, req.data(), mbap_header_size + 5));
+    EXPECT_EQ(res, mbap_header_size + 5);
+    reqs = backend->take(1);
+    ASSERT_EQ(reqs.size(), 1);
+    reqs.clear();
+
+    U8Vec exc_expected{0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x83, 0x04};
+    U8Vec exc(exc_expected.size());
+    f = std::async(
+            std::launch::async, receive_all, fd, exc.data(), exc.size());
+    EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f.get(), 0);
+    EXPECT_EQ(exc, exc_expected);
 
     close(fd);
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// Three clients read holding register 1, the last one reads register 2 as
+// well. The backend reads each register once.
+TEST_P(ModbusTcpServerAsyncTest, ReadCoalescing) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<DeferringBackend>());
+    server.set_read_coalescing(true);
+    auto backend = dynamic_cast<DeferringBackend*>(server.borrow_backend());
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fds[3];
+    for (auto& fd : fds) {
+        fd = connect_to_server();
+        ASSERT_NE(fd, -1);
+    }
+
+    for (uint8_t i = 0; i < 3; ++i) {
+        U8Vec req{0x00, i, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00, 0x01,
+                0x00, 0x01};
+        if (i == 2)
+            req.insert(req.end(), {0x00, 0x10, 0x00, 0x00, 0x00, 0x06, 0xaa,
+                                          0x03, 0x00, 0x02, 0x00, 0x01});
+        auto res = TEMP_FAILURE_RETRY(write(fds[i], req.data(), req.size()));
+        EXPECT_EQ(res, req.size());
+        usleep(10000);
+    }
+
+    auto reqs = backend->take(2);
+    ASSERT_EQ(reqs.size(), 2);
+    for (auto& req : reqs)
+        req.execute(*backend);
+
+    for (uint8_t i = 0; i < 3; ++i) {
+        U8Vec rsp_expected{0x00, i, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+                0x00, 0x01};
+        if (i == 2)
+            rsp_expected.insert(rsp_expected.end(),
+                    {0x00, 0x10, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+                            0x00, 0x02});
+        U8Vec rsp(rsp_expected.size());
+
+        auto f = std::async(std::launch::async, receive_all, fds[i],
+                rsp.data(), rsp.size());
+        EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+                << "server did not respond within the time limit";
+        EXPECT_GT(f.get(), 0);
+        EXPECT_EQ(rsp, rsp_expected);
+        close(fds[i]);
+    }
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// Deferring backend with a single holding register, which can be written.
+class DeferringRegisterBackend : public DeferringBackend {
+public:
+    errc read_holding_registers(unsigned, std::size_t cnt,
+            std::vector<uint16_t>& regs) override {
+        regs.assign(cnt, value);
+        return errc::none;
+    }
+
+    errc write_holding_registers(
+            unsigned, const std::vector<uint16_t>& regs) override {
+        value = regs.front();
+        return errc::none;
+    }
+
+private:
+    uint16_t value = 0;
+};
+
+// Client 1 reads holding register 1. While the read is outstanding, client 2
+// writes the register and reads it back. The read of client 2 must not be
+// coalesced with the one of client 1, which may precede the write.
+TEST_P(ModbusTcpServerAsyncTest, ReadCoalescingAfterWrite) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<DeferringRegisterBackend>());
+    server.set_read_coalescing(true);
+    auto backend =
+            dynamic_cast<DeferringRegisterBackend*>(server.borrow_backend());
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd1 = connect_to_server();
+    ASSERT_NE(fd1, -1);
+    int fd2 = connect_to_server();
+    ASSERT_NE(fd2, -1);
+
+    U8Vec req1{0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00, 0x01,
+            0x00, 0x01};
+    auto res = TEMP_FAILURE_RETRY(write(fd1, req1.data(), req1.size()));
+    EXPECT_EQ(res, req1.size());
+    usleep(10000);
+
+    U8Vec req2{0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00, 0x01,
+            0x12, 0x34, 0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00,
+            0x01, 0x00, 0x01};
+    res = TEMP_FAILURE_RETRY(write(fd2, req2.data(), req2.size()));
+    EXPECT_EQ(res, req2.size());
+
+    auto reqs = backend->take(3);
+    ASSERT_EQ(reqs.size(), 3);
+    for (auto& req : reqs)
+        req.execute(*backend);
+
+    U8Vec rsp1_expected{0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+            0x00, 0x00};
+    U8Vec rsp2_expected{0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00,
+            0x01, 0x12, 0x34, 0x00, 0x03, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03,
+            0x02, 0x12, 0x34};
+    for (auto [fd, rsp_expected] :
+            {std::pair{fd1, rsp1_expected}, std::pair{fd2, rsp2_expected}}) {
+        U8Vec rsp(rsp_expected.size());
+        auto f = std::async(
+                std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+        EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+                << "server did not respond within the time limit";
+        EXPECT_GT(f.get(), 0);
+        EXPECT_EQ(rsp, rsp_expected);
+        close(fd);
+    }
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// Clients 1 and 2 read holding register 1, and the reads are coalesced.
+// While they are outstanding, client 3 writes the register, and clients 1 and
+// 2 read it again. The second round of reads must not join the first one, but
+// must be coalesced in turn.
+TEST_P(ModbusTcpServerAsyncTest, ReadCoalescingRoundsAroundWrite) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<DeferringRegisterBackend>());
+    server.set_read_coalescing(true);
+    auto backend =
+            dynamic_cast<DeferringRegisterBackend*>(server.borrow_backend());
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fds[3];
+    for (auto& fd : fds) {
+        fd = connect_to_server();
+        ASSERT_NE(fd, -1);
+    }
+
+    auto send = [](int fd, const U8Vec& req) {
+        auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+        EXPECT_EQ(res, req.size());
+        usleep(10000);
+    };
+    auto read_req = [](uint8_t tid) {
+        return U8Vec{0x00, tid, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00,
+                0x01, 0x00, 0x01};
+    };
+    U8Vec write_req{0x00, 0x10, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00,
+            0x01, 0x12, 0x34};
+
+    send(fds[0], read_req(1));
+    send(fds[1], read_req(2));
+    send(fds[2], write_req);
+    send(fds[0], read_req(3));
+    send(fds[1], read_req(4));
+
+    // one read per round and the write
+    auto reqs = backend->take(3);
+    ASSERT_EQ(reqs.size(), 3);
+    for (auto& req : reqs)
+        req.execute(*backend);
+
+    // responses to a read of the old value followed by a read of the new one
+    auto read_rsps = [](uint8_t tid1, uint8_t tid2) {
+        return U8Vec{0x00, tid1, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+                0x00, 0x00, 0x00, tid2, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03,
+                0x02, 0x12, 0x34};
+    };
+    std::pair<int, U8Vec> expected[] = {{fds[0], read_rsps(1, 3)},
+            {fds[1], read_rsps(2, 4)}, {fds[2], write_req}};
+    for (auto& [fd, rsp_expected] : expected) {
+        U8Vec rsp(rsp_expected.size());
+        auto f = std::async(
+                std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+        EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+                << "server did not respond within the time limit";
+        EXPECT_GT(f.get(), 0);
+        EXPECT_EQ(rsp, rsp_expected);
+        close(fd);
+    }
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// A handler registered for a custom function code is invoked when the
+// asynchronous backend executes the request.
+TEST_P(ModbusTcpServerAsyncTest, FunctionHandler) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<DeferringBackend>());
+    server.set_function_handler(0x41,
+            [](backend_connector&, std::span<const uint8_t> req,
+                    std::span<uint8_t> rsp, std::size_t& rsp_size) {
+                rsp[0] = req[0];
+                rsp[1] = static_cast<uint8_t>(req[1] + 1);
+                rsp_size = 2;
+                return errc::none;
+            });
+    auto backend = dynamic_cast<DeferringBackend*>(server.borrow_backend());
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    U8Vec req{0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x41, 0x07};
+    U8Vec rsp_expected{0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0xaa, 0x41, 0x08};
+    U8Vec rsp(rsp_expected.size());
+
+    auto res = TEMP_FAILURE_RETRY(write(fd, req.data(), req.size()));
+    EXPECT_EQ(res, req.size());
+
+    auto reqs = backend->take(1);
+    ASSERT_EQ(reqs.size(), 1);
+    EXPECT_EQ(reqs[0].function_code(), 0x41);
+    reqs[0].execute(*backend);
+
+    auto f = std::async(
+            std::launch::async, receive_all, fd, rsp.data(), rsp.size());
+    EXPECT_EQ(f.wait_for(200ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f.get(), 0);
+    EXPECT_EQ(rsp, rsp_expected);
+
+    close(fd);
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+INSTANTIATE_TEST_SUITE_P(Transports, ModbusTcpServerAsyncTest,
+        testing::Values(transport::epoll, transport::io_uring),
+        [](const auto& info) {
+            return (info.param == transport::epoll) ? "epoll" : "io_uring";
+        });
+
+// Backend which takes its time to read holding registers.
+class SlowReadBackend : public backend_connector {
+public:
+    errc read_holding_registers(unsigned addr, std::size_t cnt,
+            std::vector<uint16_t>& regs) override {
+        usleep(200000);
+        regs.assign(cnt, addr);
+        return errc::none;
+    }
+
+    errc write_holding_registers(
+            unsigned, const std::vector<uint16_t>& regs) override {
+        last_written = regs.front();
+        return errc::none;
+    }
+
+    std::atomic<uint16_t> last_written = 0;
+};
+
+TEST_P(ModbusTcpServerAsyncTest, WorkerThreads) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<SlowReadBackend>());
+    server.set_worker_threads(2);
+    server.set_offload_policy([](uint8_t fc) { return fc == 0x03; });
+    auto backend = dynamic_cast<SlowReadBackend*>(server.borrow_backend());
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd1 = connect_to_server();
+    ASSERT_NE(fd1, -1);
+    int fd2 = connect_to_server();
+    ASSERT_NE(fd2, -1);
+
+    // Client 1 reads holding register 1, and writes 0x1234 to holding
+    // register 1. The write must be executed after the read, although it
+    // isn't offloaded by the policy.
+    U8Vec req1{0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x03, 0x00, 0x01,
+            0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00,
+            0x01, 0x12, 0x34};
+    U8Vec rsp1_expected{0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x03, 0x02,
+            0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00,
+            0x01, 0x12, 0x34};
+    U8Vec rsp1(rsp1_expected.size());
+
+    // Client 2 writes 0x5678 to holding register 2. The request is executed
+    // by the server thread, while the read of client 1 is still in progress.
+    U8Vec req2{0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00, 0x02,
+            0x56, 0x78};
+    U8Vec rsp2_expected{0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0xaa, 0x06, 0x00,
+            0x02, 0x56, 0x78};
+    U8Vec rsp2(rsp2_expected.size());
+
+    auto f1 = std::async(
+            std::launch::async, receive_all, fd1, rsp1.data(), rsp1.size());
+    auto f2 = std::async(
+            std::launch::async, receive_all, fd2, rsp2.data(), rsp2.size());
+
+    auto res = TEMP_FAILURE_RETRY(write(fd1, req1.data(), req1.size()));
+    EXPECT_EQ(res, req1.size());
+    usleep(10000);
+    res = TEMP_FAILURE_RETRY(write(fd2, req2.data(), req2.size()));
+    EXPECT_EQ(res, req2.size());
+
+    EXPECT_EQ(f2.wait_for(100ms), std::future_status::ready)
+            << "server thread blocked by slow request";
+    EXPECT_GT(f2.get(), 0);
+    EXPECT_EQ(rsp2, rsp2_expected);
+    EXPECT_EQ(backend->last_written, 0x5678);
+
+    EXPECT_EQ(f1.wait_for(500ms), std::future_status::ready)
+            << "server did not respond within the time limit";
+    EXPECT_GT(f1.get(), 0);
+    EXPECT_EQ(rsp1, rsp1_expected);
+    EXPECT_EQ(backend->last_written, 0x1234);
+
+    close(fd1);
+    close(fd2);
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// Requests are executed by the server thread and by a worker, and answered
+// with normal and exception responses.
+TEST_P(ModbusTcpServerAsyncTest, Metrics) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<register_map_backend>(0, 0, 0, 10));
+    server.set_worker_threads(1);
+    server.set_offload_policy([](uint8_t fc) { return fc == 0x03; });
+    server.set_latency_histograms(true);
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    auto transact = [fd](const U8Vec& req, size_t rsp_size) {
+        U8Vec rsp(rsp_size);
+        EXPECT_EQ(TEMP_FAILURE_RETRY(write(fd, req.data(), req.size())),
+                req.size());
+        EXPECT_EQ(receive_all(fd, rsp.data(), rsp.size()), rsp.size());
+        return rsp;
+    };
+
+    // write single register
+    transact({0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x01,
+                     0x00, 0x03},
+            12);
+    transact({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x64,
+                     0x00, 0x03},
+            9);
+
+    // read holding registers
+    transact({0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x01,
+                     0x00, 0x01},
+            11);
+    transact({0x00, 0x04, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x64,
+                     0x00, 0x01},
+            9);
+
+    close(fd);
+    // give server time to close the connection
+    usleep(100000);
+
+    auto m = server.metrics();
+    EXPECT_EQ(m.requests[0x03], 2);
+    EXPECT_EQ(m.requests[0x06], 2);
+    EXPECT_EQ(m.total_requests(), 4);
+    EXPECT_EQ(m.exceptions[0x03], 1);
+    EXPECT_EQ(m.exceptions[0x06], 1);
+    EXPECT_EQ(m.total_exceptions(), 2);
+    EXPECT_EQ(m.bytes_received, 4 * 12);
+    EXPECT_EQ(m.bytes_sent, 12 + 9 + 11 + 9);
+    EXPECT_EQ(m.connections_accepted, 1);
+    EXPECT_EQ(m.connections_denied, 0);
+    EXPECT_EQ(m.connections_closed, 1);
+    EXPECT_EQ(m.idle_timeouts, 0);
+    EXPECT_EQ(m.request_complete_timeouts, 0);
+    EXPECT_EQ(m.processing_time.count(), 4);
+    EXPECT_EQ(m.backend_time.count(), 4);
+    EXPECT_GT(m.processing_time.quantile(1.0), 0ns);
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+#ifdef MBOXID_ENABLE_TRACING
+// Every second request is traced, once executed by the server thread and once
+// by a worker.
+TEST_P(ModbusTcpServerAsyncTest, RequestTracing) {
+    using namespace std::chrono_literals;
+    using request_trace = modbus_tcp_server::request_trace;
+
+    std::mutex mtx;
+    std::vector<request_trace> traces;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_transport(GetParam());
+    server.set_backend(std::make_unique<register_map_backend>(0, 0, 0, 10));
+    server.set_worker_threads(1);
+    server.set_offload_policy([](uint8_t fc) { return fc == 0x03; });
+    EXPECT_THROW(server.set_request_tracer({}, 0), mboxid_error);
+    server.set_request_tracer(
+            [&](const request_trace& t) {
+                std::lock_guard lk(mtx);
+                traces.push_back(t);
+            },
+            2);
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    auto transact = [fd](const U8Vec& req, size_t rsp_size) {
+        U8Vec rsp(rsp_size);
+        EXPECT_EQ(TEMP_FAILURE_RETRY(write(fd, req.data(), req.size())),
+                req.size());
+        EXPECT_EQ(receive_all(fd, rsp.data(), rsp.size()), rsp.size());
+        return rsp;
+    };
+
+    for (uint8_t tid = 1; tid <= 2; ++tid)
+        transact({0x00, tid, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x01,
+                         0x00, 0x03},
+                12);
+    for (uint8_t tid = 3; tid <= 4; ++tid)
+        transact({0x00, tid, 0x00, 0x00, 0x00, 0x06, 0x02, 0x03, 0x00, 0x01,
+                         0x00, 0x01},
+                11);
+
+    // give server time to pass the last trace
+    usleep(100000);
+
+    {
+        std::lock_guard lk(mtx);
+        ASSERT_EQ(traces.size(), 2);
+        EXPECT_EQ(traces[0].transaction_id, 1);
+        EXPECT_EQ(traces[0].unit_id, 1);
+        EXPECT_EQ(traces[0].function_code, 0x06);
+        EXPECT_EQ(traces[1].transaction_id, 3);
+        EXPECT_EQ(traces[1].unit_id, 2);
+        EXPECT_EQ(traces[1].function_code, 0x03);
+        for (const auto& t : traces) {
+            EXPECT_NE(t.client, 0);
+            EXPECT_NE(t.first_byte_received, request_trace::time_point{});
+            EXPECT_LE(t.first_byte_received, t.frame_complete);
+            EXPECT_LE(t.frame_complete, t.backend_entered);
+            EXPECT_LE(t.backend_entered, t.backend_returned);
+            EXPECT_LE(t.backend_returned, t.response_sent);
+        }
+    }
+
+    close(fd);
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+#endif
+
+// Reads are answered from the cache until a client writes to the range. The
+// write is executed by a worker.
+TEST(ModbusTcpServerBasicTest, ResponseCache) {
+    using namespace std::chrono_literals;
+
+    modbus_tcp_server server;
+    EXPECT_THROW(server.set_response_cache(-1ms), mboxid_error);
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_backend(std::make_unique<register_map_backend>(0, 0, 0, 10));
+    server.set_response_cache(1h);
+    server.set_worker_threads(1);
+    server.set_offload_policy([](uint8_t fc) { return fc == 0x06; });
+    auto backend = dynamic_cast<register_map_backend*>(server.borrow_backend());
+    backend->set_holding_register(1, 1);
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    int fd = connect_to_server();
+    ASSERT_NE(fd, -1);
+
+    auto transact = [fd](const U8Vec& req, size_t rsp_size) {
+        U8Vec rsp(rsp_size);
+        EXPECT_EQ(TEMP_FAILURE_RETRY(write(fd, req.data(), req.size())),
+                req.size());
+        EXPECT_EQ(receive_all(fd, rsp.data(), rsp.size()), rsp.size());
+        return rsp;
+    };
+
+    U8Vec req_read{0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x01,
+            0x00, 0x01};
+    EXPECT_EQ(transact(req_read, 11),
+            (U8Vec{0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x01, 0x03, 0x02, 0x00,
+                    0x01}));
+
+    // An update by the application is not seen.
+    backend->set_holding_register(1, 2);
+    req_read[1] = 0x02;
+    EXPECT_EQ(transact(req_read, 11),
+            (U8Vec{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0x01, 0x03, 0x02, 0x00,
+                    0x01}));
+
+    // A write by a client invalidates the cached response.
+    U8Vec req_write{0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x01,
+            0x00, 0x03};
+    EXPECT_EQ(transact(req_write, 12), req_write);
+    req_read[1] = 0x04;
+    EXPECT_EQ(transact(req_read, 11),
+            (U8Vec{0x00, 0x04, 0x00, 0x00, 0x00, 0x05, 0x01, 0x03, 0x02, 0x00,
+                    0x03}));
+
+    close(fd);
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(1s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
+}
+
+// Backend which keeps the server busy while clients connect.
+class SlowBackend : public backend_connector {
+public:
+    bool authorize(client_id, const net::endpoint_addr&, const sockaddr*,
+            socklen_t) override {
+        usleep(200000);
+        return true;
+    }
+};
+
+TEST(ModbusTcpServerBasicTest, AcceptQueueOverflow) {
+    using namespace std::chrono_literals;
+    constexpr int n_clients = 16;
+
+    modbus_tcp_server server;
+    server.set_server_addr("localhost", "1502", net::ip_protocol_version::v4);
+    server.set_backend(std::make_unique<SlowBackend>());
+    server.set_listen_backlog(1);
+    EXPECT_THROW(server.set_listen_backlog(0), mboxid_error);
+
+    auto f_run =
+            std::async(std::launch::async, &modbus_tcp_server::run, &server);
+    // give server time to complete passive open
+    usleep(100000);
+
+    auto endpoints = resolve_endpoint("localhost", "1502",
+            net::ip_protocol_version::v4, net::endpoint_usage::active_open);
+    auto& ep = endpoints.front();
+
+    std::vector<int> fds;
+    for (int i = 0; i < n_clients; ++i) {
+        int fd = socket(ep.family, ep.socktype | SOCK_NONBLOCK, ep.protocol);
+        ASSERT_NE(fd, -1);
+        (void)connect(fd, ep.addr.get(), ep.addrlen);
+        fds.push_back(fd);
+    }
+
+    // The server samples the drop counters once per second.
+    usleep(1500000);
+    EXPECT_GT(server.accept_queue_overflows(), 0);
+
+    for (auto fd : fds)
+        close(fd);
+
+    server.shutdown();
+    EXPECT_EQ(f_run.wait_for(5s), std::future_status::ready)
+            << "failed to stop server";
+    (void)f_run.get(); // check for exception thrown by the server
 }
 
 int main(int argc, char** argv) {
@@ -0,0 +1,78 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "reg_codec.hpp"
+
+using namespace mboxid;
+
+TEST(RegCodecTest, DecodeEncode) {
+    uint8_t src[] = {0x12, 0x34, 0xab, 0xcd, 0x00, 0xff};
+    uint16_t regs[3];
+
+    decode_regs_be(src, 3, regs);
+    EXPECT_EQ(regs[0], 0x1234);
+    EXPECT_EQ(regs[1], 0xabcd);
+    EXPECT_EQ(regs[2], 0x00ff);
+
+    uint8_t dst[sizeof(src)] = {};
+    encode_regs_be(regs, 3, dst);
+    EXPECT_TRUE(std::equal(std::begin(src), std::end(src), dst));
+}
+
+struct kernel {
+    const char* name;
+    swap16_fn swap16;
+    bool supported;
+};
+
+class RegCodecKernelTest : public testing::TestWithParam<kernel> {};
+
+// Compares the kernels against a byte by byte conversion for all block sizes
+// up to the largest request, with every alignment of source and destination.
+// The bytes around the destination must not be touched.
+TEST_P(RegCodecKernelTest, SwapsBytesOfUnalignedBlocks) {
+    auto k = GetParam();
+    if (!k.supported)
+        GTEST_SKIP() << k.name << " not supported by CPU";
+
+    constexpr size_t max_regs = 125;
+    constexpr size_t buf_size = 2 * max_regs + 8;
+    std::mt19937 rng(1);
+    std::vector<uint8_t> src(buf_size);
+    for (auto& v : src)
+        v = static_cast<uint8_t>(rng());
+
+    for (size_t n = 0; n <= max_regs; ++n) {
+        for (size_t src_offs = 0; src_offs < 4; ++src_offs) {
+            for (size_t dst_offs = 0; dst_offs < 4; ++dst_offs) {
+                std::vector<uint8_t> expected(buf_size, 0x55);
+                for (size_t i = 0; i < n; ++i) {
+                    expected[dst_offs + 2 * i] = src[src_offs + 2 * i + 1];
+                    expected[dst_offs + 2 * i + 1] = src[src_offs + 2 * i];
+                }
+
+                std::vector<uint8_t> dst(buf_size, 0x55);
+                k.swap16(src.data() + src_offs, n, dst.data() + dst_offs);
+                ASSERT_EQ(dst, expected)
+                        << k.name << " n=" << n << " src_offs=" << src_offs
+                        << " dst_offs=" << dst_offs;
+            }
+        }
+    }
+}
+
+static std::vector<kernel> all_kernels() {
+    return {
+            {"scalar", swap16_scalar, true},
+#if defined(MBOXID_HAVE_X86_SIMD)
+            {"ssse3", swap16_ssse3, cpu_has_ssse3()},
+            {"avx2", swap16_avx2, cpu_has_avx2()},
+#endif
+    };
+}
+
+INSTANTIATE_TEST_SUITE_P(, RegCodecKernelTest, testing::ValuesIn(all_kernels()),
+        [](const auto& info) { return std::string(info.param.name); });
@@ -0,0 +1,191 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include <mboxid/error.hpp>
+#include <mboxid/register_map_backend.hpp>
+#include "modbus_protocol_common.hpp"
+#include "modbus_protocol_server.hpp"
+
+using namespace mboxid;
+
+using U8Vec = std::vector<uint8_t>;
+
+TEST(RegisterMapBackendTest, Sizes) {
+    register_map_backend backend(10, 20, 30, 0x10000);
+    EXPECT_EQ(backend.coil_count(), 10);
+    EXPECT_EQ(backend.discrete_input_count(), 20);
+    EXPECT_EQ(backend.input_register_count(), 30);
+    EXPECT_EQ(backend.holding_register_count(), 0x10000);
+
+    EXPECT_THROW(register_map_backend(0x10001, 0, 0, 0), mboxid_error);
+}
+
+TEST(RegisterMapBackendTest, SingleValues) {
+    register_map_backend backend(10, 10, 10, 10);
+
+    backend.set_coil(9, true);
+    backend.set_discrete_input(0, true);
+    backend.set_input_register(1, 0x1234);
+    backend.set_holding_register(9, 0xabcd);
+
+    EXPECT_TRUE(backend.get_coil(9));
+    EXPECT_FALSE(backend.get_coil(8));
+    EXPECT_TRUE(backend.get_discrete_input(0));
+    EXPECT_EQ(backend.get_input_register(1), 0x1234);
+    EXPECT_EQ(backend.get_holding_register(9), 0xabcd);
+
+    backend.set_coil(9, false);
+    EXPECT_FALSE(backend.get_coil(9));
+
+    EXPECT_THROW(backend.get_coil(10), mboxid_error);
+    EXPECT_THROW(backend.set_holding_register(10, 0), mboxid_error);
+
+    uint16_t regs[2];
+    EXPECT_THROW(backend.get_input_registers(9, regs), mboxid_error);
+}
+
+// Writes and reads random bit ranges, which start and end at arbitrary
+// positions within the 64-bit words of the table.
+TEST(RegisterMapBackendTest, BitRanges) {
+    constexpr size_t n = 300;
+    register_map_backend backend(n, 0, 0, 0);
+    std::vector<bool> expected(n);
+    std::mt19937 rng(1);
+
+    for (int round = 0; round < 1000; ++round) {
+        size_t addr = rng() % n;
+        size_t cnt = rng() % (n - addr + 1);
+
+        U8Vec bytes((cnt + 7) / 8);
+        for (auto& v : bytes)
+            v = static_cast<uint8_t>(rng());
+        const_bit_span src(bytes.data(), cnt);
+        backend.set_coils(addr, src);
+        for (size_t i = 0; i < cnt; ++i)
+            expected[addr + i] = src[i];
+
+        addr = rng() % n;
+        cnt = rng() % (n - addr + 1);
+        U8Vec out((cnt + 7) / 8, 0xff);
+        backend.get_coils(addr, bit_span(out.data(), cnt));
+        for (size_t i = 0; i < cnt; ++i)
+            ASSERT_EQ(const_bit_span(out.data(), cnt)[i], expected[addr + i])
+                    << "addr=" << addr << " i=" << i;
+        if (cnt % 8) {
+            ASSERT_EQ(out.back() >> (cnt % 8), 0); // unused bits cleared
+        }
+    }
+}
+
+TEST(RegisterMapBackendTest, ServesRequests) {
+    register_map_backend backend(20, 0, 0, 4);
+    U8Vec rsp(max_pdu_size);
+
+    // write multiple coils
+    U8Vec req{0x0f, 0x00, 0x02, 0x00, 0x0a, 0x02, 0xcd, 0x01};
+    auto cnt = server_engine(backend, req, rsp);
+    EXPECT_EQ(U8Vec(rsp.begin(), rsp.begin() + cnt),
+            (U8Vec{0x0f, 0x00, 0x02, 0x00, 0x0a}));
+    EXPECT_TRUE(backend.get_coil(2));
+    EXPECT_FALSE(backend.get_coil(3));
+    EXPECT_TRUE(backend.get_coil(10));
+
+    // read holding registers
+    uint16_t regs[] = {0x0102, 0x0304, 0x0506};
+    backend.set_holding_registers(1, regs);
+    req = {0x03, 0x00, 0x01, 0x00, 0x03};
+    cnt = server_engine(backend, req, rsp);
+    EXPECT_EQ(U8Vec(rsp.begin(), rsp.begin() + cnt),
+            (U8Vec{0x03, 0x06, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06}));
+
+    // read beyond the end of the table
+    req = {0x03, 0x00, 0x02, 0x00, 0x03};
+    cnt = server_engine(backend, req, rsp);
+    EXPECT_EQ(U8Vec(rsp.begin(), rsp.begin() + cnt), (U8Vec{0x83, 0x02}));
+
+    // table without input registers
+    req = {0x04, 0x00, 0x00, 0x00, 0x01};
+    cnt = server_engine(backend, req, rsp);
+    EXPECT_EQ(U8Vec(rsp.begin(), rsp.begin() + cnt), (U8Vec{0x84, 0x02}));
+}
+
+// Two threads update different coils of the same 64-bit word. No update
+// must get lost.
+TEST(RegisterMapBackendTest, ConcurrentBitUpdates) {
+    register_map_backend backend(64, 0, 0, 0);
+    constexpr int rounds = 10000;
+
+    auto writer = [&](unsigned first) {
+        uint8_t ones[] = {0xff, 0xff, 0xff, 0xff};
+        uint8_t zeros[] = {0, 0, 0, 0};
+        for (int i = 0; i < rounds; ++i) {
+            backend.set_coils(first, const_bit_span(zeros, 32));
+            backend.set_coils(first, const_bit_span(ones, 32));
+        }
+    };
+
+    std::thread t1(writer, 0);
+    std::thread t2(writer, 32);
+    t1.join();
+    t2.join();
+
+    for (unsigned i = 0; i < 64; ++i)
+        EXPECT_TRUE(backend.get_coil(i)) << i;
+}
+
+// Writers update 64-bit values spanning the boundary between two blocks of
+// registers, while readers serve read requests. Each writer writes the same
+// counter value to all registers of the range, so that a torn read shows up
+// as a response with differing registers.
+TEST(RegisterMapBackendTest, ConsistentRegisterSnapshots) {
+    register_map_backend backend(0, 0, 0, 128);
+    constexpr unsigned addr = 62;
+    constexpr unsigned cnt = 4;
+    constexpr int rounds = 20000;
+    std::atomic<bool> done{false};
+
+    auto writer = [&](uint16_t first) {
+        uint16_t regs[cnt];
+        for (int i = 0; i < rounds; ++i) {
+            std::fill(std::begin(regs), std::end(regs),
+                    static_cast<uint16_t>(first + 2 * i));
+            backend.set_holding_registers(addr, regs);
+        }
+    };
+
+    auto reader = [&](int& torn) {
+        U8Vec req{0x03, 0x00, addr, 0x00, cnt};
+        U8Vec rsp(max_pdu_size);
+        uint16_t regs[cnt];
+        while (!done.load()) {
+            server_engine(backend, req, rsp);
+            parse_regs(std::span(rsp).subspan(2), regs);
+            if (std::count(std::begin(regs), std::end(regs), regs[0]) != cnt)
+                ++torn;
+        }
+    };
+
+    int torn[2] = {};
+    std::thread r1(reader, std::ref(torn[0]));
+    std::thread r2(reader, std::ref(torn[1]));
+    std::thread w1(writer, 0);
+    std::thread w2(writer, 1);
+    w1.join();
+    w2.join();
+    done = true;
+    r1.join();
+    r2.join();
+
+    EXPECT_EQ(torn[0], 0);
+    EXPECT_EQ(torn[1], 0);
+
+    uint16_t regs[cnt];
+    backend.get_holding_registers(addr, regs);
+    EXPECT_EQ(std::count(std::begin(regs), std::end(regs), regs[0]), cnt);
+}
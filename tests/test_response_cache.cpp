@@ -0,0 +1,138 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <mboxid/register_map_backend.hpp>
+#include "modbus_protocol_common.hpp"
+#include "modbus_protocol_server.hpp"
+#include "response_cache.hpp"
+
+using namespace mboxid;
+using namespace std::chrono_literals;
+
+using U8Vec = std::vector<uint8_t>;
+
+// Counts the reads reaching the backend.
+class counting_backend : public register_map_backend {
+public:
+    counting_backend() : register_map_backend(100, 100, 100, 100) {}
+
+    errc read_coils_span(unsigned addr, bit_span bits) override {
+        ++reads;
+        return register_map_backend::read_coils_span(addr, bits);
+    }
+
+    errc read_holding_registers_span(
+            unsigned addr, std::span<uint16_t> regs) override {
+        ++reads;
+        return register_map_backend::read_holding_registers_span(addr, regs);
+    }
+
+    int reads = 0;
+};
+
+class ResponseCacheTest : public testing::Test {
+protected:
+    ResponseCacheTest() {
+        state.responses = std::make_unique<response_cache>(1h);
+    }
+
+    counting_backend backend;
+    backend_state state;
+
+    U8Vec execute(const U8Vec& req, unsigned unit_id = 1) {
+        U8Vec rsp(max_pdu_size);
+        size_t cnt = 0;
+        EXPECT_EQ(server_engine(backend, &state, unit_id, req, rsp, cnt),
+                errc::none);
+        rsp.resize(cnt);
+        return rsp;
+    }
+};
+
+TEST_F(ResponseCacheTest, RepeatedReadsAreServedFromCache) {
+    backend.set_holding_register(11, 0x1234);
+    U8Vec req{0x03, 0x00, 0x0a, 0x00, 0x02};
+    U8Vec expected{0x03, 0x04, 0x00, 0x00, 0x12, 0x34};
+
+    EXPECT_EQ(execute(req), expected);
+    EXPECT_EQ(execute(req), expected);
+    EXPECT_EQ(backend.reads, 1);
+
+    // other unit, address or count
+    execute(req, 2);
+    execute({0x03, 0x00, 0x0b, 0x00, 0x02});
+    execute({0x03, 0x00, 0x0a, 0x00, 0x03});
+    EXPECT_EQ(backend.reads, 4);
+
+    state.responses->clear();
+    EXPECT_EQ(execute(req), expected);
+    EXPECT_EQ(backend.reads, 5);
+}
+
+TEST_F(ResponseCacheTest, WritesInvalidateOverlappingRanges) {
+    U8Vec req{0x03, 0x00, 0x0a, 0x00, 0x02};
+    execute(req);
+
+    // write single register far from the cached range
+    execute({0x06, 0x00, 0x40, 0x12, 0x34});
+    execute(req);
+    EXPECT_EQ(backend.reads, 1);
+
+    // write single register
+    execute({0x06, 0x00, 0x0b, 0x56, 0x78});
+    EXPECT_EQ(execute(req), (U8Vec{0x03, 0x04, 0x00, 0x00, 0x56, 0x78}));
+    EXPECT_EQ(backend.reads, 2);
+
+    // write multiple registers
+    execute({0x10, 0x00, 0x09, 0x00, 0x02, 0x04, 0x00, 0x01, 0x00, 0x02});
+    EXPECT_EQ(execute(req), (U8Vec{0x03, 0x04, 0x00, 0x02, 0x56, 0x78}));
+    EXPECT_EQ(backend.reads, 3);
+
+    // mask write register, which reads the register itself
+    execute({0x16, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x10});
+    EXPECT_EQ(execute(req), (U8Vec{0x03, 0x04, 0x00, 0x10, 0x56, 0x78}));
+    EXPECT_EQ(backend.reads, 5);
+
+    // read/write multiple registers, which reads register 0 and writes 10
+    execute({0x17, 0x00, 0x00, 0x00, 0x01, 0x00, 0x0a, 0x00, 0x01, 0x02, 0xab,
+            0xcd});
+    EXPECT_EQ(execute(req), (U8Vec{0x03, 0x04, 0xab, 0xcd, 0x56, 0x78}));
+
+    // coils
+    U8Vec req_coils{0x01, 0x00, 0x00, 0x00, 0x10};
+    execute(req_coils);
+    execute({0x05, 0x00, 0x03, 0xff, 0x00});
+    EXPECT_EQ(execute(req_coils), (U8Vec{0x01, 0x02, 0x08, 0x00}));
+    execute({0x0f, 0x00, 0x08, 0x00, 0x02, 0x01, 0x03});
+    EXPECT_EQ(execute(req_coils), (U8Vec{0x01, 0x02, 0x08, 0x03}));
+}
+
+TEST_F(ResponseCacheTest, ExceptionResponsesAreNotCached) {
+    U8Vec req{0x03, 0x00, 0x63, 0x00, 0x02};
+    EXPECT_EQ(execute(req), (U8Vec{0x83, 0x02}));
+    EXPECT_EQ(execute(req), (U8Vec{0x83, 0x02}));
+    EXPECT_EQ(backend.reads, 2);
+}
+
+TEST(ResponseCacheExpiryTest, ResponsesExpire) {
+    counting_backend backend;
+    backend_state state;
+    state.responses = std::make_unique<response_cache>(20ms);
+    U8Vec req{0x01, 0x00, 0x00, 0x00, 0x08};
+    U8Vec rsp(max_pdu_size);
+    size_t cnt = 0;
+
+    server_engine(backend, &state, 1, req, rsp, cnt);
+    backend.set_coil(0, true); // not seen by the cache
+    server_engine(backend, &state, 1, req, rsp, cnt);
+    EXPECT_EQ(rsp[2], 0x00);
+    EXPECT_EQ(backend.reads, 1);
+
+    std::this_thread::sleep_for(30ms);
+    server_engine(backend, &state, 1, req, rsp, cnt);
+    EXPECT_EQ(rsp[2], 0x01);
+    EXPECT_EQ(backend.reads, 2);
+}
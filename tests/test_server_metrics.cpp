@@ -0,0 +1,91 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <mboxid/server_metrics.hpp>
+#include "metrics_recorder.hpp"
+
+using namespace mboxid;
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogramTest, Buckets) {
+    using h = latency_histogram;
+
+    EXPECT_EQ(h::bucket(0), 0);
+    EXPECT_EQ(h::bucket(15), 15);
+    EXPECT_EQ(h::bucket(16), 16);
+    EXPECT_EQ(h::bucket(31), 31);
+    EXPECT_EQ(h::bucket(32), 32);
+    EXPECT_EQ(h::bucket(33), 32);
+    EXPECT_EQ(h::bucket(34), 33);
+    EXPECT_EQ(h::bucket(UINT64_MAX), h::n_buckets - 1);
+
+    // The buckets cover the durations without gaps.
+    EXPECT_EQ(h::lower_bound(0), 0);
+    for (unsigned i = 0; i < h::n_buckets; ++i) {
+        EXPECT_EQ(h::bucket(h::lower_bound(i)), i);
+        EXPECT_EQ(h::bucket(h::upper_bound(i)), i);
+        if (i) {
+            EXPECT_EQ(h::lower_bound(i), h::upper_bound(i - 1) + 1);
+        }
+    }
+
+    // relative error below 1/16
+    for (unsigned i = h::sub_buckets; i < h::n_buckets; ++i) {
+        auto lo = h::lower_bound(i);
+        EXPECT_LT((h::upper_bound(i) - lo) * 16, lo);
+    }
+}
+
+TEST(LatencyHistogramTest, Quantile) {
+    latency_histogram h;
+    EXPECT_EQ(h.quantile(0.5), 0ns);
+
+    for (unsigned i = 0; i < 99; ++i)
+        ++h.counts[latency_histogram::bucket(1000)];
+    ++h.counts[latency_histogram::bucket(1000000)];
+    EXPECT_EQ(h.count(), 100);
+
+    auto in_bucket = [](std::chrono::nanoseconds d, uint64_t ns) {
+        return latency_histogram::bucket(d.count()) ==
+                latency_histogram::bucket(ns);
+    };
+    EXPECT_TRUE(in_bucket(h.quantile(0.0), 1000));
+    EXPECT_TRUE(in_bucket(h.quantile(0.5), 1000));
+    EXPECT_TRUE(in_bucket(h.quantile(0.99), 1000));
+    EXPECT_TRUE(in_bucket(h.quantile(0.999), 1000000));
+    EXPECT_TRUE(in_bucket(h.quantile(1.0), 1000000));
+}
+
+TEST(MetricsRecorderTest, Read) {
+    metrics_recorder rec;
+    rec.request(0x03);
+    rec.request(0x03);
+    rec.exception(0x03);
+    rec.received(12);
+    rec.sent(11);
+    rec.accepted();
+    rec.closed();
+    rec.processing(2us);
+    rec.backend(-1ns); // clock went backwards
+
+    server_metrics m;
+    rec.read(m);
+    rec.read(m);
+    EXPECT_EQ(m.requests[0x03], 4);
+    EXPECT_EQ(m.total_requests(), 4);
+    EXPECT_EQ(m.exceptions[0x03], 2);
+    EXPECT_EQ(m.bytes_received, 24);
+    EXPECT_EQ(m.bytes_sent, 22);
+    EXPECT_EQ(m.connections_accepted, 2);
+    EXPECT_EQ(m.connections_closed, 2);
+    EXPECT_EQ(m.connections_denied, 0);
+    EXPECT_EQ(m.processing_time.count(), 2);
+    EXPECT_EQ(m.backend_time.counts[0], 2);
+
+    server_metrics sum;
+    sum += m;
+    sum += m;
+    EXPECT_EQ(sum.total_requests(), 8);
+    EXPECT_EQ(sum.processing_time.count(), 4);
+}
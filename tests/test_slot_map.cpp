@@ -0,0 +1,73 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <memory>
+#include <set>
+#include <gtest/gtest.h>
+#include "slot_map.hpp"
+
+using namespace mboxid;
+
+TEST(SlotMapTest, InsertFindErase) {
+    slot_map<int> map;
+    EXPECT_TRUE(map.empty());
+
+    auto k1 = map.insert(1);
+    auto k2 = map.insert(2);
+    auto k3 = map.insert(3);
+    EXPECT_NE(k1, 0);
+    EXPECT_EQ(map.size(), 3);
+
+    ASSERT_NE(map.find(k2), nullptr);
+    EXPECT_EQ(*map.find(k2), 2);
+
+    EXPECT_TRUE(map.erase(k1));
+    EXPECT_FALSE(map.erase(k1));
+    EXPECT_EQ(map.find(k1), nullptr);
+    EXPECT_EQ(map.size(), 2);
+
+    // remaining elements are still reachable after compaction
+    ASSERT_NE(map.find(k2), nullptr);
+    EXPECT_EQ(*map.find(k2), 2);
+    ASSERT_NE(map.find(k3), nullptr);
+    EXPECT_EQ(*map.find(k3), 3);
+
+    std::multiset<int> values(map.begin(), map.end());
+    EXPECT_EQ(values, std::multiset<int>({2, 3}));
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.find(k2), nullptr);
+    EXPECT_EQ(map.find(k3), nullptr);
+}
+
+TEST(SlotMapTest, StaleKeys) {
+    slot_map<std::unique_ptr<int>> map;
+
+    auto k1 = map.insert(std::make_unique<int>(1));
+    EXPECT_TRUE(map.erase(k1));
+
+    // the slot is reused, but the old key must not match the new element
+    auto k2 = map.insert(std::make_unique<int>(2));
+    EXPECT_NE(k1, k2);
+    EXPECT_EQ(map.find(k1), nullptr);
+    EXPECT_FALSE(map.erase(k1));
+    ASSERT_NE(map.find(k2), nullptr);
+    EXPECT_EQ(**map.find(k2), 2);
+
+    // keys forged for vacated or unknown slots are rejected
+    EXPECT_TRUE(map.erase(k2));
+    EXPECT_EQ(map.find(k2 + (uint64_t{1} << 32)), nullptr);
+    EXPECT_EQ(map.find(k2 + 1), nullptr);
+    EXPECT_EQ(map.find(0), nullptr);
+}
+
+TEST(SlotMapTest, KeysLeaveTagBitsClear) {
+    slot_map<int> map;
+
+    for (int i = 0; i < 100; ++i) {
+        auto key = map.insert(i);
+        EXPECT_EQ(key >> 62, 0);
+        map.erase(key);
+    }
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+#include "timer_wheel.hpp"
+
+using namespace mboxid;
+using namespace std::chrono_literals;
+using std::chrono::milliseconds;
+
+class TimerWheelTest : public testing::Test {
+protected:
+    timer_wheel::time_point t0 = timer_wheel::clock::now();
+    timer_wheel wheel{t0};
+    std::vector<int> fired;
+
+    auto on_expiry(int tag) {
+        return [this, tag]() { fired.push_back(tag); };
+    }
+};
+
+TEST_F(TimerWheelTest, NoTimers) {
+    EXPECT_EQ(wheel.poll_timeout(t0), -1);
+    wheel.advance(t0 + 10h);
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST_F(TimerWheelTest, ExpiryOrderAndTimeout) {
+    timer_wheel::timer t1(on_expiry(1));
+    timer_wheel::timer t2(on_expiry(2));
+    timer_wheel::timer t3(on_expiry(3));
+
+    wheel.arm(t1, t0 + 10ms);
+    wheel.arm(t2, t0 + 100ms);  // level 1
+    wheel.arm(t3, t0 + 5000ms); // level 2
+    EXPECT_EQ(wheel.size(), 3);
+    EXPECT_EQ(wheel.poll_timeout(t0), 10);
+
+    wheel.advance(t0 + 9ms);
+    EXPECT_TRUE(fired.empty());
+    EXPECT_EQ(wheel.poll_timeout(t0 + 9ms), 1);
+
+    wheel.advance(t0 + 10ms);
+    EXPECT_EQ(fired, std::vector<int>{1});
+    EXPECT_FALSE(t1.armed());
+
+    // the wheel wakes up at the latest when the timer has to be cascaded
+    auto to = wheel.poll_timeout(t0 + 10ms);
+    EXPECT_GT(to, 0);
+    EXPECT_LE(to, 90);
+
+    wheel.advance(t0 + 99ms);
+    EXPECT_EQ(fired, std::vector<int>{1});
+    wheel.advance(t0 + 100ms);
+    EXPECT_EQ(fired, (std::vector<int>{1, 2}));
+
+    wheel.advance(t0 + 4999ms);
+    EXPECT_EQ(fired, (std::vector<int>{1, 2}));
+    wheel.advance(t0 + 5000ms);
+    EXPECT_EQ(fired, (std::vector<int>{1, 2, 3}));
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST_F(TimerWheelTest, LargeStep) {
+    std::vector<std::unique_ptr<timer_wheel::timer>> timers;
+
+    for (int i = 0; i < 1000; ++i) {
+        timers.push_back(std::make_unique<timer_wheel::timer>(on_expiry(i)));
+        wheel.arm(*timers.back(), t0 + milliseconds(i * 37));
+    }
+
+    wheel.advance(t0 + milliseconds(500 * 37));
+    EXPECT_EQ(fired.size(), 501);
+    wheel.advance(t0 + 1h);
+    EXPECT_EQ(fired.size(), 1000);
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST_F(TimerWheelTest, BeyondRange) {
+    timer_wheel::timer t(on_expiry(1));
+
+    wheel.arm(t, t0 + 10h);
+    wheel.advance(t0 + 5h);
+    EXPECT_TRUE(fired.empty());
+    EXPECT_TRUE(t.armed());
+    wheel.advance(t0 + 10h - 1ms);
+    EXPECT_TRUE(fired.empty());
+    wheel.advance(t0 + 10h);
+    EXPECT_EQ(fired, std::vector<int>{1});
+}
+
+TEST_F(TimerWheelTest, CancelAndRearm) {
+    timer_wheel::timer t1(on_expiry(1));
+    timer_wheel::timer t2(on_expiry(2));
+
+    wheel.arm(t1, t0 + 10ms);
+    wheel.arm(t2, t0 + 20ms);
+    wheel.cancel(t1);
+    EXPECT_FALSE(t1.armed());
+    EXPECT_EQ(wheel.size(), 1);
+
+    // re-arming moves the timer
+    wheel.arm(t2, t0 + 2000ms);
+    wheel.advance(t0 + 1000ms);
+    EXPECT_TRUE(fired.empty());
+    EXPECT_EQ(wheel.size(), 1);
+
+    {
+        timer_wheel::timer t3(on_expiry(3));
+        wheel.arm(t3, t0 + 1500ms);
+        EXPECT_EQ(wheel.size(), 2);
+    }
+    // destroyed timers are disarmed
+    EXPECT_EQ(wheel.size(), 1);
+
+    wheel.advance(t0 + 2000ms);
+    EXPECT_EQ(fired, std::vector<int>{2});
+}
+
+TEST_F(TimerWheelTest, DeadlineInThePast) {
+    wheel.advance(t0 + 100ms);
+
+    timer_wheel::timer t(on_expiry(1));
+    wheel.arm(t, t0 + 50ms);
+    EXPECT_EQ(wheel.poll_timeout(t0 + 100ms), 0);
+    wheel.advance(t0 + 100ms);
+    EXPECT_EQ(fired, std::vector<int>{1});
+}
+
+TEST_F(TimerWheelTest, CallbackArmsAndCancels) {
+    timer_wheel::timer t2(on_expiry(2));
+    timer_wheel::timer periodic;
+    timer_wheel::timer t1([&]() {
+        fired.push_back(1);
+        wheel.cancel(t2); // expires in the same tick
+    });
+    periodic.set_callback([&]() {
+        fired.push_back(3);
+        wheel.arm(periodic, t0 + 2000ms);
+    });
+
+    wheel.arm(t1, t0 + 10ms);
+    wheel.arm(t2, t0 + 10ms);
+    wheel.arm(periodic, t0 + 1000ms);
+
+    wheel.advance(t0 + 1000ms);
+    EXPECT_EQ(fired, (std::vector<int>{1, 3}));
+    EXPECT_TRUE(periodic.armed());
+    wheel.advance(t0 + 2000ms);
+    EXPECT_EQ(fired, (std::vector<int>{1, 3, 3}));
+}
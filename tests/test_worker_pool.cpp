@@ -0,0 +1,74 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <sys/eventfd.h>
+#include <gtest/gtest.h>
+#include "unique_fd.hpp"
+#include "worker_pool.hpp"
+
+using namespace mboxid;
+
+// Records the addresses read per client, the client being encoded in the
+// upper bits of the address.
+class RecordingBackend : public backend_connector {
+public:
+    errc read_holding_registers(unsigned addr, std::size_t cnt,
+            std::vector<uint16_t>& regs) override {
+        std::lock_guard lk(mtx);
+        reads[addr >> 12].push_back(addr & 0xfff);
+        regs.assign(cnt, addr);
+        return errc::none;
+    }
+
+    std::mutex mtx;
+    std::map<unsigned, std::vector<unsigned>> reads;
+};
+
+TEST(WorkerPoolTest, RequestsOfClientExecutedInOrder) {
+    constexpr unsigned n_clients = 8;
+    constexpr unsigned n_requests = 500;
+
+    unique_fd efd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    ASSERT_NE(efd.get(), -1);
+    auto queue = std::make_shared<completion_queue>(efd.get());
+    queue->open();
+
+    RecordingBackend backend;
+    {
+        worker_pool pool(3);
+
+        for (unsigned seq = 0; seq < n_requests; ++seq) {
+            for (unsigned client = 0; client < n_clients; ++client) {
+                auto st = std::make_unique<deferred_request::state>();
+                unsigned addr = client << 12 | seq;
+                uint8_t pdu[] = {0x03, static_cast<uint8_t>(addr >> 8),
+                        static_cast<uint8_t>(addr), 0x00, 0x01};
+                std::copy(std::begin(pdu), std::end(pdu), st->req);
+                st->req_size = sizeof(pdu);
+                st->queue = queue;
+                st->client = client;
+                st->seq = seq;
+                pool.submit(client, {std::move(st), &backend});
+            }
+        }
+
+        std::vector<completion_queue::entry> entries;
+        while (entries.size() < n_clients * n_requests)
+            queue->take(entries);
+
+        for (const auto& e : entries) {
+            EXPECT_FALSE(e->error);
+            EXPECT_EQ(e->rsp_size, 4);
+        }
+    }
+
+    ASSERT_EQ(backend.reads.size(), n_clients);
+    for (const auto& [client, addrs] : backend.reads) {
+        ASSERT_EQ(addrs.size(), n_requests);
+        for (unsigned i = 0; i < n_requests; ++i)
+            EXPECT_EQ(addrs[i], i) << "client " << client;
+    }
+}
@@ -0,0 +1,706 @@
+// Copyright (c) 2024, Franz Hollerer.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Load generator for Modbus TCP servers.
+//
+// Each thread drives its share of the connections with an epoll loop. In
+// closed-loop mode, every connection keeps the configured number of requests
+// outstanding and sends a new request as soon as a response arrives. In
+// open-loop mode, requests are scheduled at a fixed rate, regardless of the
+// responses. A request which cannot be sent at its scheduled time, as all
+// connections have reached the pipeline depth, waits in a backlog. Its
+// latency is measured from the scheduled time, so a slow server cannot hide
+// its queueing delay by slowing down the generator.
+//
+// Requests are serialized with the library's client codec and responses are
+// framed with the receive buffer of the server.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <mboxid/error.hpp>
+#include <mboxid/server_metrics.hpp>
+#include "frame_buffer.hpp"
+#include "modbus_protocol_client.hpp"
+#include "modbus_protocol_common.hpp"
+#include "network_private.hpp"
+#include "unique_fd.hpp"
+
+using namespace mboxid;
+
+using clock_type = std::chrono::steady_clock;
+using time_point = clock_type::time_point;
+using std::chrono::nanoseconds;
+
+struct mix_entry {
+    function_code fc;
+    unsigned weight;
+};
+
+struct options {
+    std::string host = "localhost";
+    std::string port = "502";
+    unsigned connections = 1;
+    unsigned threads = 1;
+    unsigned depth = 1;      // outstanding requests per connection
+    double rate = 0;         // requests per second, 0 for closed loop
+    double duration = 10;    // seconds
+    unsigned unit_id = 1;
+    std::vector<mix_entry> mix{{function_code::read_holding_registers, 1}};
+    unsigned addr = 0;       // first address of the range
+    unsigned range = 100;    // number of addresses in the range
+    unsigned quantity = 1;   // coils or registers per request
+};
+
+// Results of a thread.
+struct results {
+    uint64_t responses = 0;
+    uint64_t exceptions = 0;
+    uint64_t errors = 0; // unexpected responses and failed connections
+    uint64_t unanswered = 0;
+    latency_histogram latency;
+    nanoseconds max_latency{0};
+
+    results& operator+=(const results& other) {
+        responses += other.responses;
+        exceptions += other.exceptions;
+        errors += other.errors;
+        unanswered += other.unanswered;
+        latency += other.latency;
+        max_latency = std::max(max_latency, other.max_latency);
+        return *this;
+    }
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -H, --host HOST          server host (localhost)\n"
+            "  -p, --port PORT          server port (502)\n"
+            "  -c, --connections N      number of connections (1)\n"
+            "  -t, --threads N          number of threads (1)\n"
+            "  -q, --depth N            outstanding requests per "
+            "connection (1)\n"
+            "  -r, --rate R             requests per second in total, open "
+            "loop;\n"
+            "                           0 for closed loop (0)\n"
+            "  -d, --duration S         run duration in seconds (10)\n"
+            "  -u, --unit-id ID         unit identifier (1)\n"
+            "  -m, --mix FC:W[,FC:W]    function codes and their weights "
+            "(3:1)\n"
+            "  -a, --address A:N        range of N addresses starting at A "
+            "(0:100)\n"
+            "  -n, --quantity N         coils or registers per request (1)\n"
+            "  -h, --help               print this help\n",
+            prog);
+}
+
+static unsigned to_unsigned(const char* s, const char* what) {
+    char* end;
+    errno = 0;
+    auto val = strtoul(s, &end, 0);
+    if (errno || (end == s) || *end || (val > UINT32_MAX))
+        throw mboxid_error(errc::invalid_argument, what);
+    return static_cast<unsigned>(val);
+}
+
+static double to_double(const char* s, const char* what) {
+    char* end;
+    errno = 0;
+    auto val = strtod(s, &end);
+    if (errno || (end == s) || *end || (val < 0))
+        throw mboxid_error(errc::invalid_argument, what);
+    return val;
+}
+
+// Parses a list such as "3:80,16:20". The weight defaults to 1.
+static std::vector<mix_entry> parse_mix(const char* s) {
+    std::vector<mix_entry> mix;
+    std::string list(s);
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        auto end = std::min(list.find(',', pos), list.size());
+        auto item = list.substr(pos, end - pos);
+        auto colon = item.find(':');
+        auto fc = to_unsigned(item.substr(0, colon).c_str(), "function code");
+        unsigned weight = 1;
+        if (colon != std::string::npos)
+            weight = to_unsigned(item.substr(colon + 1).c_str(), "weight");
+        if (weight)
+            mix.push_back({static_cast<function_code>(fc), weight});
+        pos = end + 1;
+    }
+    if (mix.empty())
+        throw mboxid_error(errc::invalid_argument, "function code mix");
+    return mix;
+}
+
+static options parse_options(int argc, char* argv[]) {
+    static const option long_options[] = {
+        {"host", required_argument, nullptr, 'H'},
+        {"port", required_argument, nullptr, 'p'},
+        {"connections", required_argument, nullptr, 'c'},
+        {"threads", required_argument, nullptr, 't'},
+        {"depth", required_argument, nullptr, 'q'},
+        {"rate", required_argument, nullptr, 'r'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"unit-id", required_argument, nullptr, 'u'},
+        {"mix", required_argument, nullptr, 'm'},
+        {"address", required_argument, nullptr, 'a'},
+        {"quantity", required_argument, nullptr, 'n'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    options opts;
+    int c;
+    while ((c = getopt_long(argc, argv, "H:p:c:t:q:r:d:u:m:a:n:h",
+                    long_options, nullptr)) != -1) {
+        switch (c) {
+        case 'H':
+            opts.host = optarg;
+            break;
+        case 'p':
+            opts.port = optarg;
+            break;
+        case 'c':
+            opts.connections = to_unsigned(optarg, "connections");
+            break;
+        case 't':
+            opts.threads = to_unsigned(optarg, "threads");
+            break;
+        case 'q':
+            opts.depth = to_unsigned(optarg, "depth");
+            break;
+        case 'r':
+            opts.rate = to_double(optarg, "rate");
+            break;
+        case 'd':
+            opts.duration = to_double(optarg, "duration");
+            break;
+        case 'u':
+            opts.unit_id = to_unsigned(optarg, "unit id");
+            break;
+        case 'm':
+            opts.mix = parse_mix(optarg);
+            break;
+        case 'a': {
+            std::string s(optarg);
+            auto colon = s.find(':');
+            opts.addr = to_unsigned(s.substr(0, colon).c_str(), "address");
+            if (colon != std::string::npos)
+                opts.range = to_unsigned(
+                        s.substr(colon + 1).c_str(), "address range");
+            break;
+        }
+        case 'n':
+            opts.quantity = to_unsigned(optarg, "quantity");
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind < argc) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!opts.connections || !opts.threads || !opts.depth)
+        throw mboxid_error(errc::invalid_argument,
+                "connections, threads and depth must be at least 1");
+    if (opts.unit_id > 0xff)
+        throw mboxid_error(errc::invalid_argument, "unit id");
+    if (!opts.quantity || (opts.range < opts.quantity) ||
+            (opts.addr + opts.range > 0x10000))
+        throw mboxid_error(errc::invalid_argument, "address range");
+    opts.threads = std::min(opts.threads, opts.connections);
+    return opts;
+}
+
+// Serializes the requests of the mix with random addresses in the range.
+class request_factory {
+public:
+    request_factory(const options& opts, unsigned seed)
+            : opts(opts), gen(seed),
+              pick_addr(opts.addr, opts.addr + opts.range - opts.quantity),
+              bits(opts.quantity, true), regs(opts.quantity, 0x1234) {
+        unsigned sum = 0;
+        for (const auto& e : opts.mix) {
+            sum += e.weight;
+            cumulated_weights.push_back(sum);
+        }
+        pick_weight = std::uniform_int_distribution<unsigned>(0, sum - 1);
+    }
+
+    function_code next_function_code() {
+        auto w = pick_weight(gen);
+        auto it = std::upper_bound(
+                cumulated_weights.begin(), cumulated_weights.end(), w);
+        return opts.mix[it - cumulated_weights.begin()].fc;
+    }
+
+    // Stores the PDU of a request with the function code \a fc in \a dst
+    // and returns its size.
+    size_t serialize(std::span<uint8_t> dst, function_code fc) {
+        auto addr = pick_addr(gen);
+        switch (fc) {
+        case function_code::read_coils:
+        case function_code::read_discrete_inputs:
+            return serialize_read_bits_request(dst, fc, addr, opts.quantity);
+        case function_code::read_holding_registers:
+        case function_code::read_input_registers:
+            return serialize_read_registers_request(
+                    dst, fc, addr, opts.quantity);
+        case function_code::write_single_coil:
+            return serialize_write_single_coil_request(dst, addr, true);
+        case function_code::write_single_register:
+            return serialize_write_single_register_request(dst, addr, 0x1234);
+        case function_code::write_multiple_coils:
+            return serialize_write_multiple_coils_request(dst, addr, bits);
+        case function_code::write_multiple_registers:
+            return serialize_write_multiple_registers_request(
+                    dst, addr, regs);
+        case function_code::mask_write_register:
+            return serialize_mask_write_register_request(
+                    dst, addr, 0xf0f0, 0x0101);
+        case function_code::read_write_multiple_registers:
+            return serialize_read_write_multiple_registers_request(
+                    dst, addr, regs, addr, opts.quantity);
+        default:
+            throw mboxid_error(
+                    errc::invalid_argument, "unsupported function code");
+        }
+    }
+
+private:
+    const options& opts;
+    std::mt19937 gen;
+    std::uniform_int_distribution<unsigned> pick_addr;
+    std::uniform_int_distribution<unsigned> pick_weight;
+    std::vector<unsigned> cumulated_weights;
+    std::vector<bool> bits;
+    std::vector<uint16_t> regs;
+};
+
+static unique_fd connect_to_server(const options& opts) {
+    auto endpoints = net::resolve_endpoint(opts.host.c_str(),
+            opts.port.c_str(), net::ip_protocol_version::any,
+            net::endpoint_usage::active_open);
+
+    int err = 0;
+    for (const auto& ep : endpoints) {
+        unique_fd fd(socket(ep.family, ep.socktype, ep.protocol));
+        if (fd.get() == -1)
+            throw system_error(errno, "socket");
+        if (connect(fd.get(), ep.addr.get(), ep.addrlen) == 0) {
+            int on = 1;
+            setsockopt(fd.get(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            return fd;
+        }
+        err = errno;
+    }
+    throw system_error(err, "connect");
+}
+
+class load_thread {
+public:
+    load_thread(const options& opts, unsigned index, unsigned n_conns,
+            double rate)
+            : opts(opts), requests(opts, index + 1), rate(rate),
+              epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+              timer_fd(timerfd_create(
+                      CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+        if ((epoll_fd.get() == -1) || (timer_fd.get() == -1))
+            throw system_error(errno, "epoll_create1/timerfd_create");
+        add_fd(timer_fd.get(), EPOLLIN, timer_tag);
+
+        for (unsigned i = 0; i < n_conns; ++i) {
+            auto c = std::make_unique<connection>();
+            c->fd = connect_to_server(opts);
+            add_fd(c->fd.get(), EPOLLIN, i);
+            conns.push_back(std::move(c));
+        }
+        n_alive = conns.size();
+    }
+
+    // Generates load from \a start until \a stop.
+    void run(time_point start, time_point stop) {
+        if (rate > 0) {
+            interval = nanoseconds(static_cast<int64_t>(1e9 / rate));
+            next_send = start;
+        } else {
+            for (unsigned i = 0; i < conns.size(); ++i) {
+                for (unsigned j = 0; j < opts.depth; ++j)
+                    send_request(i, start);
+            }
+        }
+
+        epoll_event events[64];
+        for (;;) {
+            auto now = clock_type::now();
+            if (now >= stop)
+                break;
+            if (rate > 0) {
+                for (; next_send <= now; next_send += interval)
+                    backlog.push_back(next_send);
+                dispatch_backlog();
+                arm_timer(std::min(next_send, stop));
+            } else
+                arm_timer(stop);
+
+            auto n = epoll_wait(epoll_fd.get(), events,
+                    static_cast<int>(std::size(events)), -1);
+            if (n == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw system_error(errno, "epoll_wait");
+            }
+            for (int i = 0; i < n; ++i) {
+                auto tag = events[i].data.u32;
+                if (tag == timer_tag) {
+                    uint64_t expirations;
+                    (void)read(timer_fd.get(), &expirations,
+                            sizeof(expirations));
+                    continue;
+                }
+                if (!conns[tag]->alive)
+                    continue;
+                if (events[i].events & EPOLLOUT)
+                    flush(tag);
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                    receive(tag);
+            }
+            if (!n_alive)
+                break;
+        }
+
+        for (const auto& c : conns)
+            res.unanswered += c->outstanding.size();
+        res.unanswered += backlog.size();
+    }
+
+    const results& get_results() const { return res; }
+
+private:
+    static constexpr uint32_t timer_tag = UINT32_MAX;
+
+    struct request {
+        uint16_t transaction_id;
+        uint8_t fc;
+        time_point start; // scheduled or actual send time
+    };
+
+    struct connection {
+        unique_fd fd;
+        frame_buffer rx;
+        std::vector<uint8_t> tx;
+        size_t tx_sent = 0;
+        bool tx_blocked = false;
+        std::deque<request> outstanding;
+        uint16_t next_transaction_id = 0;
+        bool alive = true;
+    };
+
+    void add_fd(int fd, uint32_t events, uint32_t tag) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u32 = tag;
+        if (epoll_ctl(epoll_fd.get(), EPOLL_CTL_ADD, fd, &ev) == -1)
+            throw system_error(errno, "epoll_ctl");
+    }
+
+    void modify_fd(int fd, uint32_t events, uint32_t tag) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u32 = tag;
+        if (epoll_ctl(epoll_fd.get(), EPOLL_CTL_MOD, fd, &ev) == -1)
+            throw system_error(errno, "epoll_ctl");
+    }
+
+    void arm_timer(time_point t) {
+        if (t == armed_at)
+            return;
+        auto ns = t.time_since_epoch().count();
+        itimerspec spec{};
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+        // steady_clock is CLOCK_MONOTONIC on Linux.
+        if (timerfd_settime(timer_fd.get(), TFD_TIMER_ABSTIME, &spec,
+                    nullptr) == -1)
+            throw system_error(errno, "timerfd_settime");
+        armed_at = t;
+    }
+
+    // Sends the requests of the backlog on connections below the pipeline
+    // depth, in round robin.
+    void dispatch_backlog() {
+        for (size_t tries = 0; !backlog.empty() && (tries < conns.size());) {
+            auto i = next_conn;
+            next_conn = (next_conn + 1) % conns.size();
+            const auto& c = *conns[i];
+            if (!c.alive || (c.outstanding.size() >= opts.depth)) {
+                ++tries;
+                continue;
+            }
+            tries = 0;
+            send_request(i, backlog.front());
+            backlog.pop_front();
+        }
+    }
+
+    void send_request(uint32_t i, time_point start) {
+        auto& c = *conns[i];
+        if (!c.alive)
+            return;
+        auto fc = requests.next_function_code();
+
+        auto offs = c.tx.size();
+        c.tx.resize(offs + max_adu_size);
+        auto adu = std::span(c.tx).subspan(offs);
+        auto pdu_size = requests.serialize(adu.subspan(mbap_header_size), fc);
+        mbap_header header{c.next_transaction_id++, 0, 0,
+                static_cast<uint8_t>(opts.unit_id)};
+        set_pdu_size(header, pdu_size);
+        serialize_mbap_header(adu, header);
+        c.tx.resize(offs + get_adu_size(header));
+
+        c.outstanding.push_back(
+                {header.transaction_id, static_cast<uint8_t>(fc), start});
+        if (!c.tx_blocked)
+            flush(i);
+    }
+
+    void flush(uint32_t i) {
+        auto& c = *conns[i];
+        while (c.tx_sent < c.tx.size()) {
+            auto res = send(c.fd.get(), c.tx.data() + c.tx_sent,
+                    c.tx.size() - c.tx_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN) {
+                    if (!c.tx_blocked)
+                        modify_fd(c.fd.get(), EPOLLIN | EPOLLOUT, i);
+                    c.tx_blocked = true;
+                    return;
+                }
+                fail(i, strerror(errno));
+                return;
+            }
+            c.tx_sent += res;
+        }
+        c.tx.clear();
+        c.tx_sent = 0;
+        if (c.tx_blocked)
+            modify_fd(c.fd.get(), EPOLLIN, i);
+        c.tx_blocked = false;
+    }
+
+    void receive(uint32_t i) {
+        auto& c = *conns[i];
+        for (;;) {
+            auto space = c.rx.space();
+            auto res = recv(c.fd.get(), space.data(), space.size(),
+                    MSG_DONTWAIT);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN)
+                    fail(i, strerror(errno));
+                return;
+            }
+            if (res == 0) {
+                fail(i, "connection closed by server");
+                return;
+            }
+            c.rx.commit(res);
+            if (!process_responses(i))
+                return;
+        }
+    }
+
+    bool process_responses(uint32_t i) {
+        auto& c = *conns[i];
+        mbap_header header; // NOLINT(*-pro-type-member-init)
+        for (;;) {
+            auto adu = c.rx.next_frame(header);
+            if (adu.empty()) {
+                if (c.rx.error() == errc::none)
+                    return true;
+                fail(i, c.rx.error_message());
+                return false;
+            }
+
+            auto now = clock_type::now();
+
+            // Servers usually respond in order, so the response matches the
+            // oldest outstanding request.
+            auto it = std::find_if(c.outstanding.begin(), c.outstanding.end(),
+                    [&](const auto& r) {
+                        return r.transaction_id == header.transaction_id;
+                    });
+            if (it == c.outstanding.end()) {
+                ++res.errors;
+                continue;
+            }
+
+            auto fc = adu[mbap_header_size];
+            if (fc == (it->fc | 0x80))
+                ++res.exceptions;
+            else if (fc != it->fc)
+                ++res.errors;
+            ++res.responses;
+
+            auto latency = std::chrono::duration_cast<nanoseconds>(
+                    now - it->start);
+            ++res.latency.counts[latency_histogram::bucket(latency.count())];
+            res.max_latency = std::max(res.max_latency, latency);
+            c.outstanding.erase(it);
+
+            if (rate > 0)
+                dispatch_backlog();
+            else
+                send_request(i, now);
+            if (!c.alive)
+                return false;
+        }
+    }
+
+    void fail(uint32_t i, const char* what) {
+        auto& c = *conns[i];
+        if (!c.alive)
+            return;
+        fprintf(stderr, "connection %u: %s\n", i, what);
+        ++res.errors;
+        res.unanswered += c.outstanding.size();
+        c.outstanding.clear();
+        (void)epoll_ctl(epoll_fd.get(), EPOLL_CTL_DEL, c.fd.get(), nullptr);
+        c.fd.reset();
+        c.alive = false;
+        --n_alive;
+    }
+
+    const options& opts;
+    request_factory requests;
+    double rate;
+    unique_fd epoll_fd;
+    unique_fd timer_fd;
+    std::vector<std::unique_ptr<connection>> conns;
+    size_t n_alive = 0;
+    size_t next_conn = 0;
+    nanoseconds interval{0};
+    time_point next_send;
+    time_point armed_at;
+    std::deque<time_point> backlog;
+    results res;
+};
+
+static double to_us(nanoseconds d) {
+    return static_cast<double>(d.count()) / 1000.0;
+}
+
+static void print_results(const options& opts, const results& res,
+        std::chrono::duration<double> elapsed) {
+    printf("connections: %u, threads: %u, depth: %u, mode: ", opts.connections,
+            opts.threads, opts.depth);
+    if (opts.rate > 0)
+        printf("open loop at %.0f req/s\n", opts.rate);
+    else
+        printf("closed loop\n");
+    printf("duration: %.2f s\n", elapsed.count());
+    printf("responses: %llu (%.0f/s), exceptions: %llu, errors: %llu, "
+           "unanswered: %llu\n",
+            static_cast<unsigned long long>(res.responses),
+            static_cast<double>(res.responses) / elapsed.count(),
+            static_cast<unsigned long long>(res.exceptions),
+            static_cast<unsigned long long>(res.errors),
+            static_cast<unsigned long long>(res.unanswered));
+    printf("latency [us]: p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+            to_us(res.latency.quantile(0.5)),
+            to_us(res.latency.quantile(0.99)),
+            to_us(res.latency.quantile(0.999)), to_us(res.max_latency));
+}
+
+static int main_(int argc, char* argv[]) {
+    auto opts = parse_options(argc, argv);
+
+    // Check the requests of the mix upfront, e.g. for the quantity limits.
+    {
+        request_factory check(opts, 0);
+        uint8_t pdu[max_pdu_size];
+        for (const auto& e : opts.mix)
+            check.serialize(pdu, e.fc);
+    }
+
+    std::vector<std::unique_ptr<load_thread>> loaders;
+    for (unsigned i = 0; i < opts.threads; ++i) {
+        auto n_conns = opts.connections / opts.threads +
+                (i < opts.connections % opts.threads ? 1 : 0);
+        auto rate = opts.rate * n_conns / opts.connections;
+        loaders.push_back(
+                std::make_unique<load_thread>(opts, i, n_conns, rate));
+    }
+
+    auto start = clock_type::now() + std::chrono::milliseconds(10);
+    auto stop = start +
+            std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(opts.duration));
+
+    std::vector<std::exception_ptr> errors(opts.threads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < opts.threads; ++i) {
+        threads.emplace_back([&, i]() {
+            try {
+                std::this_thread::sleep_until(start);
+                loaders[i]->run(start, stop);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    for (auto& e : errors) {
+        if (e)
+            std::rethrow_exception(e);
+    }
+
+    std::chrono::duration<double> elapsed =
+            std::min(clock_type::now(), stop) - start;
+    results total;
+    for (const auto& l : loaders)
+        total += l->get_results();
+    print_results(opts, total, elapsed);
+
+    return total.errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        return main_(argc, argv);
+    } catch (const mboxid::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+    }
+    return EXIT_FAILURE;
+}